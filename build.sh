@@ -9,4 +9,15 @@ cd "$build"
 compiler_flags="-O0 -g -Werror -Wall -Wextra -Wshadow -Wconversion -Wno-unused-function -Wno-unused-parameter -Wno-unused-variable -Wno-unused-but-set-variable -Wno-string-conversion"
 
 echo Starting build.
-clang $compiler_flags "$code"/trayge.c -o trayge $(pkgconf --cflags --libs dbus-1)
+clang $compiler_flags "$code"/trayge.c -o trayge $(pkgconf --cflags --libs dbus-1) -lpthread
+clang $compiler_flags "$code"/trayge_pixel_bench.c -o trayge_pixel_bench
+clang $compiler_flags "$code"/trayge_bench.c -o trayge_bench $(pkgconf --cflags --libs dbus-1)
+clang $compiler_flags "$code"/trayge_replay.c -o trayge_replay $(pkgconf --cflags --libs dbus-1)
+clang $compiler_flags -fPIC -shared "$code"/libtrayge.c -o libtrayge.so $(pkgconf --cflags --libs dbus-1) -lpthread
+clang $compiler_flags "$code"/libtrayge_example.c -o libtrayge_example -L. -ltrayge -Wl,-rpath,'$ORIGIN'
+
+if [ "$1" = bench ]; then
+    shift
+    echo Running bench.
+    ./trayge_bench "$@"
+fi
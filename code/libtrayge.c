@@ -0,0 +1,197 @@
+//
+// NOTE(trayge): libtrayge is trayge.c built as one translation unit with main left out, plus
+// the public entry points below. They run on the application's thread and only ever touch the
+// submission queue, the frames on loan, and WantsFrames; everything else in State belongs to
+// the service thread.
+//
+
+#include <pthread.h>
+#include <sched.h>
+
+#include "libtrayge.h"
+
+#define TRAYGE_LIBRARY 1
+#include "trayge.c"
+
+struct trayge
+{
+    trayge_state State;
+    pthread_t Thread;
+    
+    // NOTE(trayge): Discarded frames stay on the application side and are handed out again
+    // before anything new is taken from the free ring.
+    u32 StashCount;
+    icon_frame *Stash[LentFrameBudget];
+};
+
+function void *
+RunTraygeThread(void *Parameter)
+{
+    trayge *Trayge = Parameter;
+    RunTraygeLoop(&Trayge->State);
+    
+    return 0;
+}
+
+function b32
+PushSubmission(trayge *Trayge, submission *Submission)
+{
+    submission_queue *Queue = Trayge->State.Submissions;
+    
+    b32 WasDrained = false;
+    b32 Result = RingPush(&Queue->Submissions, Submission, &WasDrained);
+    if(Result && WasDrained)
+    {
+        u64 One = 1;
+        ssize_t Written = write(Queue->Source.FileHandle, &One, sizeof(One));
+        (void)Written;
+    }
+    
+    return Result;
+}
+
+trayge *
+trayge_start(const trayge_config *Config)
+{
+    trayge *Result = calloc(1, sizeof(trayge));
+    if(Result)
+    {
+        dbus_threads_init_default();
+        
+        trayge_options Options = {};
+        Options.IconSizeMask = Config->icon_sizes & IconSizeAll;
+        Options.MaxFramesPerSecond = 120;
+        Options.IdleFramesPerSecond = 1;
+        Options.ItemCount = Config->item_count;
+        Options.MaxPixelKernelLevel = PixelKernel_Count - 1;
+        Options.Id = (char *)Config->id;
+        Options.Title = (char *)Config->title;
+        Options.LogEnabled = (Config->log != 0);
+        Options.Embedded = true;
+        
+        trayge_state *State = &Result->State;
+        State->ConsumerQueueLimit = 1024*1024;
+        
+        if(!InitTrayge(State, &Options) ||
+           pthread_create(&Result->Thread, 0, RunTraygeThread, Result) != 0)
+        {
+            ShutdownTrayge(State);
+            free(Result);
+            Result = 0;
+        }
+    }
+    
+    return Result;
+}
+
+void
+trayge_stop(trayge *Trayge)
+{
+    if(Trayge)
+    {
+        submission Submission = {};
+        Submission.Type = Submission_Quit;
+        while(!PushSubmission(Trayge, &Submission))
+        {
+            sched_yield();
+        }
+        
+        pthread_join(Trayge->Thread, 0);
+        ShutdownTrayge(&Trayge->State);
+        free(Trayge);
+    }
+}
+
+int
+trayge_acquire_frame(trayge *Trayge, trayge_frame *Frame)
+{
+    icon_frame *IconFrame = 0;
+    if(Trayge->StashCount)
+    {
+        IconFrame = Trayge->Stash[--Trayge->StashCount];
+    }
+    else
+    {
+        RingPop(&Trayge->State.Submissions->FreeFrames, &IconFrame);
+    }
+    
+    if(IconFrame)
+    {
+        u32 SizeMask = Trayge->State.IconSizeMask;
+        
+        *Frame = (trayge_frame){};
+        Frame->handle = IconFrame;
+        for(u32 SizeIndex = 0;
+            SizeIndex < IconSize_Count;
+            ++SizeIndex)
+        {
+            if(SizeMask & (1u << SizeIndex))
+            {
+                trayge_image *Image = Frame->images + Frame->image_count++;
+                Image->size = IconSizes[SizeIndex];
+                Image->pixels = IconFrame->Bytes + IconImageOffset(SizeMask, SizeIndex);
+            }
+        }
+    }
+    
+    int Result = (IconFrame != 0);
+    return Result;
+}
+
+int
+trayge_submit_frame(trayge *Trayge, uint32_t Item, trayge_frame *Frame)
+{
+    b32 Result = false;
+    
+    if(Item < Trayge->State.ItemCount && Frame->handle)
+    {
+        submission Submission = {};
+        Submission.Type = Submission_Frame;
+        Submission.ItemIndex = Item;
+        Submission.Frame = Frame->handle;
+        
+        Result = PushSubmission(Trayge, &Submission);
+        if(Result)
+        {
+            Frame->handle = 0;
+        }
+    }
+    
+    return Result;
+}
+
+void
+trayge_discard_frame(trayge *Trayge, trayge_frame *Frame)
+{
+    if(Frame->handle && Trayge->StashCount < ArrayCount(Trayge->Stash))
+    {
+        Trayge->Stash[Trayge->StashCount++] = Frame->handle;
+        Frame->handle = 0;
+    }
+}
+
+int
+trayge_set_string(trayge *Trayge, uint32_t Item, trayge_string Which, const char *Value)
+{
+    b32 Result = false;
+    
+    if(Item < Trayge->State.ItemCount && (u32)Which < TrayString_Count)
+    {
+        submission Submission = {};
+        Submission.Type = Submission_String;
+        Submission.ItemIndex = Item;
+        Submission.String = (tray_string_type)Which;
+        snprintf(Submission.Value, sizeof(Submission.Value), "%s", Value ? Value : "");
+        
+        Result = PushSubmission(Trayge, &Submission);
+    }
+    
+    return Result;
+}
+
+int
+trayge_wants_frames(trayge *Trayge)
+{
+    int Result = (__atomic_load_n(&Trayge->State.Submissions->WantsFrames, __ATOMIC_RELAXED) != 0);
+    return Result;
+}
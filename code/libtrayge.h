@@ -0,0 +1,101 @@
+#ifndef LIBTRAYGE_H
+#define LIBTRAYGE_H
+
+//
+// libtrayge runs trayge's StatusNotifierItem service on a thread of its own inside an
+// application. The application renders icon frames and changes strings from its own thread;
+// nothing it calls here ever waits on the bus, and a slow or stalled bus never blocks it.
+//
+// Every function except trayge_wants_frames must be called from one application thread at a
+// time: submissions travel through a single-producer queue.
+//
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct trayge trayge;
+
+enum
+{
+    TRAYGE_ICON_16  = 1u << 0,
+    TRAYGE_ICON_22  = 1u << 1,
+    TRAYGE_ICON_24  = 1u << 2,
+    TRAYGE_ICON_32  = 1u << 3,
+    TRAYGE_ICON_48  = 1u << 4,
+    TRAYGE_ICON_64  = 1u << 5,
+    TRAYGE_ICON_256 = 1u << 6,
+};
+
+#define TRAYGE_MAX_IMAGES 7
+#define TRAYGE_MAX_STRING 255
+
+typedef enum trayge_string
+{
+    TRAYGE_TITLE,
+    TRAYGE_STATUS,
+    TRAYGE_TOOLTIP_TITLE,
+    TRAYGE_TOOLTIP_DESCRIPTION,
+} trayge_string;
+
+// Zero-initialize and fill in what you need. Items past the first get "_<n>" appended to id
+// and " <n>" to title. icon_sizes is a mask of TRAYGE_ICON_*; 0 means every size.
+typedef struct trayge_config
+{
+    const char *id;
+    const char *title;
+    uint32_t item_count;
+    uint32_t icon_sizes;
+    int log;
+} trayge_config;
+
+// Square images, one per configured size, in ascending order. Pixels are ARGB32 in network
+// byte order (alpha first in memory), the StatusNotifierItem IconPixmap format.
+typedef struct trayge_image
+{
+    int32_t size;
+    uint8_t *pixels;
+} trayge_image;
+
+typedef struct trayge_frame
+{
+    uint32_t image_count;
+    trayge_image images[TRAYGE_MAX_IMAGES];
+    void *handle;
+} trayge_frame;
+
+// Connects to the session bus, registers the items and starts the service thread. Returns 0
+// when the bus is unreachable.
+trayge *trayge_start(const trayge_config *config);
+
+// Stops the service thread, unregisters from the bus and frees everything.
+void trayge_stop(trayge *t);
+
+// Fills in an empty frame to draw into. Returns 0 when every frame is still in use, which
+// means the service thread has not caught up with the frames already submitted.
+int trayge_acquire_frame(trayge *t, trayge_frame *frame);
+
+// Publishes a frame with every image drawn for the given item. On success the frame belongs
+// to trayge again; on failure (the queue is full) it stays with the caller, who can retry or
+// discard it.
+int trayge_submit_frame(trayge *t, uint32_t item, trayge_frame *frame);
+
+// Returns an acquired frame unused.
+void trayge_discard_frame(trayge *t, trayge_frame *frame);
+
+// Sets a string property of an item; values longer than TRAYGE_MAX_STRING are cut. Returns 0
+// when the queue is full or the item does not exist.
+int trayge_set_string(trayge *t, uint32_t item, trayge_string which, const char *value);
+
+// Nonzero while a tray host is registered and the session is not locked. Rendering while it
+// is zero is wasted work; the frames are kept but nobody fetches them. Callable from any
+// thread.
+int trayge_wants_frames(trayge *t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,154 @@
+//
+// NOTE(trayge): Smallest useful libtrayge client: one animated item per --items, drawn on the
+// application's own thread at --fps, with a tooltip that counts the frames. It only uses the
+// public header, so it doubles as a check that libtrayge.h stands on its own. trayge_bench can
+// drive it in place of trayge with --trayge build/libtrayge_example.
+//
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "libtrayge.h"
+
+static volatile sig_atomic_t Running = 1;
+
+static void
+HandleStopSignal(int Signal)
+{
+    Running = 0;
+}
+
+static void
+DrawImage(trayge_image *Image, uint32_t Phase)
+{
+    uint8_t *Pixel = Image->pixels;
+    for(int32_t Y = 0;
+        Y < Image->size;
+        ++Y)
+    {
+        for(int32_t X = 0;
+            X < Image->size;
+            ++X)
+        {
+            Pixel[0] = 0xFF;
+            Pixel[1] = (uint8_t)((uint32_t)(X*256/Image->size) + Phase);
+            Pixel[2] = (uint8_t)((uint32_t)(Y*256/Image->size) + Phase);
+            Pixel[3] = (uint8_t)(Phase*2);
+            Pixel += 4;
+        }
+    }
+}
+
+int
+main(int ArgumentCount, char **Arguments)
+{
+    trayge_config Config = {0};
+    Config.id = "libtrayge_example";
+    Config.title = "libtrayge Example";
+    Config.item_count = 1;
+    
+    long FramesPerSecond = 60;
+    
+    for(int ArgumentIndex = 1;
+        ArgumentIndex < ArgumentCount;
+        ++ArgumentIndex)
+    {
+        char *Argument = Arguments[ArgumentIndex];
+        if(strcmp(Argument, "--items") == 0 && ArgumentIndex + 1 < ArgumentCount)
+        {
+            Config.item_count = (uint32_t)strtoul(Arguments[++ArgumentIndex], 0, 10);
+        }
+        else if(strcmp(Argument, "--fps") == 0 && ArgumentIndex + 1 < ArgumentCount)
+        {
+            FramesPerSecond = strtol(Arguments[++ArgumentIndex], 0, 10);
+        }
+        else if(strcmp(Argument, "--log") == 0)
+        {
+            Config.log = 1;
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--items N] [--fps N] [--log]\n", Arguments[0]);
+            return 1;
+        }
+    }
+    
+    if(Config.item_count == 0)
+    {
+        Config.item_count = 1;
+    }
+    if(FramesPerSecond <= 0 || FramesPerSecond > 1000)
+    {
+        FramesPerSecond = 60;
+    }
+    
+    signal(SIGTERM, HandleStopSignal);
+    signal(SIGINT, HandleStopSignal);
+    
+    trayge *Trayge = trayge_start(&Config);
+    if(!Trayge)
+    {
+        fprintf(stderr, "Could not start trayge\n");
+        return 1;
+    }
+    
+    struct timespec Interval = {0, 1000000000L / FramesPerSecond};
+    uint32_t Phase = 0;
+    uint64_t FramesSubmitted = 0;
+    uint64_t FramesDropped = 0;
+    
+    while(Running)
+    {
+        if(trayge_wants_frames(Trayge))
+        {
+            for(uint32_t Item = 0;
+                Item < Config.item_count;
+                ++Item)
+            {
+                trayge_frame Frame;
+                if(trayge_acquire_frame(Trayge, &Frame))
+                {
+                    for(uint32_t ImageIndex = 0;
+                        ImageIndex < Frame.image_count;
+                        ++ImageIndex)
+                    {
+                        DrawImage(Frame.images + ImageIndex, Phase + Item*32);
+                    }
+                    
+                    if(trayge_submit_frame(Trayge, Item, &Frame))
+                    {
+                        ++FramesSubmitted;
+                    }
+                    else
+                    {
+                        trayge_discard_frame(Trayge, &Frame);
+                        ++FramesDropped;
+                    }
+                }
+                else
+                {
+                    ++FramesDropped;
+                }
+            }
+            
+            if((Phase % (uint32_t)FramesPerSecond) == 0)
+            {
+                char ToolTip[64];
+                snprintf(ToolTip, sizeof(ToolTip), "%llu frames submitted", (unsigned long long)FramesSubmitted);
+                trayge_set_string(Trayge, 0, TRAYGE_TOOLTIP_DESCRIPTION, ToolTip);
+            }
+            
+            ++Phase;
+        }
+        
+        nanosleep(&Interval, 0);
+    }
+    
+    trayge_stop(Trayge);
+    printf("%llu frames submitted, %llu dropped\n", (unsigned long long)FramesSubmitted, (unsigned long long)FramesDropped);
+    
+    return 0;
+}
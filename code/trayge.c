@@ -1,27 +1,41 @@
+#ifndef TRAYGE_LIBRARY
+#define TRAYGE_LIBRARY 0
+#endif
+
 #include <unistd.h>
 #include <fcntl.h>
-#include <poll.h>
+#include <sys/epoll.h>
 #include <errno.h>
 #include <time.h>
 #include <sys/timerfd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/signalfd.h>
+#include <sys/eventfd.h>
+#include <signal.h>
+#include <pthread.h>
+
+#include <stdlib.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdarg.h>
 
 #include <dbus/dbus.h>
 
 #include "trayge_types.h"
+#include "trayge_memory.h"
+#include "trayge_stats.h"
 #include "trayge_string.h"
+#include "trayge_trace.h"
+#include "trayge_table.h"
+#include "trayge_pixel.h"
+#include "trayge_icon.h"
+#include "trayge_png.h"
+#include "trayge_timer.h"
+#include "trayge_ring.h"
+#include "trayge_menu.h"
 #include "trayge.h"
 
-#include <stdlib.h>
-#include <stdio.h>
-
-#define ZeroStruct(pointer) ZeroSize(pointer, sizeof(*(pointer)))
-
-function void
-ZeroSize(void *Dest, u64 Count)
-{
-    asm volatile("rep stosb" : "+D"(Dest), "+c"(Count) : "a"(0) : "memory");
-}
-
 function read_result
 WrappedRead(s32 Handle, void *Dest, u64 Size)
 {
@@ -54,38 +68,133 @@ WrappedRead(s32 Handle, void *Dest, u64 Size)
     return Result;
 }
 
-function dbus_bool_t
-HandleDBusAddWatch(DBusWatch *WatchHandle, void *UserData)
+function u64
+GetMonotonicTime(void)
+{
+    struct timespec Time = {};
+    clock_gettime(CLOCK_MONOTONIC, &Time);
+    
+    u64 Result = (u64)Time.tv_sec*Billion + (u64)Time.tv_nsec;
+    return Result;
+}
+
+function u32
+EpollFlagsFromWatch(DBusWatch *WatchHandle)
 {
-    dbus_bool_t Result = true;
+    u32 Result = 0;
     
     if(dbus_watch_get_enabled(WatchHandle))
     {
-        trayge_state *State = UserData;
-        
-        dbus_watch_entry *WatchEntry = malloc(sizeof(dbus_watch_entry));
-        ZeroStruct(WatchEntry);
-        
-        WatchEntry->Next = &State->WatchSentinel;
-        WatchEntry->Prev = State->WatchSentinel.Prev;
-        WatchEntry->Next->Prev = WatchEntry;
-        WatchEntry->Prev->Next = WatchEntry;
-        
-        WatchEntry->WatchHandle = WatchHandle;
-        WatchEntry->FileHandle = dbus_watch_get_unix_fd(WatchHandle);
-        
         u32 WatchFlags = dbus_watch_get_flags(WatchHandle);
         if(WatchFlags & DBUS_WATCH_READABLE)
         {
-            WatchEntry->PollFlags |= POLLIN;
+            Result |= EPOLLIN;
         }
         
         if(WatchFlags & DBUS_WATCH_WRITABLE)
         {
-            WatchEntry->PollFlags |= POLLOUT;
+            Result |= EPOLLOUT;
         }
+    }
+    
+    return Result;
+}
+
+function u32
+WatchFlagsFromEpoll(u32 Events)
+{
+    u32 Result = 0;
+    
+    if(Events & EPOLLIN)
+    {
+        Result |= DBUS_WATCH_READABLE;
+    }
+    
+    if(Events & EPOLLOUT)
+    {
+        Result |= DBUS_WATCH_WRITABLE;
+    }
+    
+    if(Events & EPOLLERR)
+    {
+        Result |= DBUS_WATCH_ERROR;
+    }
+    
+    if(Events & EPOLLHUP)
+    {
+        Result |= DBUS_WATCH_HANGUP;
+    }
+    
+    return Result;
+}
+
+function void
+RegisterEventSource(trayge_state *State, event_source *Source, u32 Events)
+{
+    struct epoll_event Event = {};
+    Event.events = Events;
+    Event.data.ptr = Source;
+    
+    epoll_ctl(State->EpollHandle, EPOLL_CTL_ADD, Source->FileHandle, &Event);
+}
+
+function void
+ModifyEventSource(trayge_state *State, event_source *Source, u32 Events)
+{
+    struct epoll_event Event = {};
+    Event.events = Events;
+    Event.data.ptr = Source;
+    
+    epoll_ctl(State->EpollHandle, EPOLL_CTL_MOD, Source->FileHandle, &Event);
+}
+
+function void
+RetireEventSource(trayge_state *State, event_source *Source)
+{
+    epoll_ctl(State->EpollHandle, EPOLL_CTL_DEL, Source->FileHandle, 0);
+    close(Source->FileHandle);
+    
+    Source->Retired = true;
+    Source->NextRetired = State->RetiredSources;
+    State->RetiredSources = Source;
+}
+
+function void
+FreeRetiredEventSources(trayge_state *State)
+{
+    while(State->RetiredSources)
+    {
+        event_source *Source = State->RetiredSources;
+        State->RetiredSources = Source->NextRetired;
+        
+        Assert(Source->Type == EventSource_Watch);
+        PoolFree(&State->WatchPool, Source);
+    }
+}
+
+function dbus_bool_t
+HandleDBusAddWatch(DBusWatch *WatchHandle, void *UserData)
+{
+    dbus_bool_t Result = false;
+    
+    trayge_state *State = UserData;
+    
+    // NOTE(trayge): libdbus hands out separate read and write watches on the same socket, and
+    // epoll only accepts a file descriptor once, so every watch polls its own duplicate.
+    s32 FileHandle = fcntl(dbus_watch_get_unix_fd(WatchHandle), F_DUPFD_CLOEXEC, 0);
+    if(FileHandle >= 0)
+    {
+        dbus_watch_entry *WatchEntry = PoolAllocate(&State->WatchPool);
+        
+        WatchEntry->Source.Type = EventSource_Watch;
+        WatchEntry->Source.FileHandle = FileHandle;
+        WatchEntry->WatchHandle = WatchHandle;
+        
+        RegisterEventSource(State, &WatchEntry->Source, EpollFlagsFromWatch(WatchHandle));
+        ++State->WatchCount;
         
         dbus_watch_set_data(WatchHandle, WatchEntry, 0);
+        Result = true;
     }
     
     return Result;
@@ -98,10 +207,7 @@ HandleDBusRemoveWatch(DBusWatch *WatchHandle, void *UserData)
     dbus_watch_entry *WatchEntry = dbus_watch_get_data(WatchHandle);
     if(WatchEntry)
     {
-        WatchEntry->Next->Prev = WatchEntry->Prev;
-        WatchEntry->Prev->Next = WatchEntry->Next;
-        
-        free(WatchEntry);
+        RetireEventSource(State, &WatchEntry->Source);
         --State->WatchCount;
         
         dbus_watch_set_data(WatchHandle, 0, 0);
@@ -111,43 +217,65 @@ HandleDBusRemoveWatch(DBusWatch *WatchHandle, void *UserData)
 function void
 HandleDBusToggleWatch(DBusWatch *WatchHandle, void *UserData)
 {
-    if(dbus_watch_get_enabled(WatchHandle))
+    trayge_state *State = UserData;
+    dbus_watch_entry *WatchEntry = dbus_watch_get_data(WatchHandle);
+    if(WatchEntry)
+    {
+        ModifyEventSource(State, &WatchEntry->Source, EpollFlagsFromWatch(WatchHandle));
+    }
+}
+
+function void
+ArmTimerSource(trayge_state *State)
+{
+    timer_entry *Next = PeekTimer(&State->Timers);
+    u64 Deadline = Next ? Next->Deadline : 0;
+    
+    if(Deadline != State->ArmedDeadline)
+    {
+        struct itimerspec TimerArgs = {};
+        TimerArgs.it_value.tv_sec = (s64)(Deadline / Billion);
+        TimerArgs.it_value.tv_nsec = (s64)(Deadline % Billion);
+        
+        timerfd_settime(State->TimerSource.FileHandle, TFD_TIMER_ABSTIME, &TimerArgs, 0);
+        State->ArmedDeadline = Deadline;
+    }
+}
+
+function void
+ScheduleDBusTimeout(trayge_state *State, timer_entry *Timer)
+{
+    if(dbus_timeout_get_enabled(Timer->TimeoutHandle))
     {
-        HandleDBusAddWatch(WatchHandle, UserData);
+        Timer->Interval = (u64)Million*(u64)dbus_timeout_get_interval(Timer->TimeoutHandle);
+        ScheduleTimer(&State->Timers, Timer, GetMonotonicTime() + Timer->Interval);
     }
     else
     {
-        HandleDBusRemoveWatch(WatchHandle, UserData);
+        UnscheduleTimer(&State->Timers, Timer);
     }
+    
+    ArmTimerSource(State);
 }
 
 function dbus_bool_t
 HandleDBusAddTimeout(DBusTimeout *TimeoutHandle, void *UserData)
 {
-    dbus_bool_t Result = true;
+    dbus_bool_t Result = false;
     
     trayge_state *State = UserData;
-    if(dbus_timeout_get_enabled(TimeoutHandle))
+    
+    timer_entry *Timer = PoolAllocate(&State->TimerPool);
+    if(Timer)
     {
-        dbus_timeout_entry *TimeoutEntry = malloc(sizeof(dbus_timeout_entry));
-        ZeroStruct(TimeoutEntry);
-        
-        TimeoutEntry->Next = &State->TimeoutSentinel;
-        TimeoutEntry->Prev = State->TimeoutSentinel.Prev;
-        TimeoutEntry->Next->Prev = TimeoutEntry;
-        TimeoutEntry->Prev->Next = TimeoutEntry;
+        Timer->Type = Timer_DBusTimeout;
+        Timer->TimeoutHandle = TimeoutHandle;
         
-        TimeoutEntry->TimeoutHandle = TimeoutHandle;
-        TimeoutEntry->FileHandle = timerfd_create(CLOCK_MONOTONIC, 0);
+        ++State->TimeoutCount;
+        dbus_timeout_set_data(TimeoutHandle, Timer, 0);
         
-        s64 Nanoseconds = Million*dbus_timeout_get_interval(TimeoutHandle);
-        
-        struct itimerspec TimerArgument = {};
-        TimerArgument.it_value.tv_sec = Nanoseconds / Billion;
-        TimerArgument.it_value.tv_nsec = Nanoseconds % Billion;
-        TimerArgument.it_value = TimerArgument.it_interval;
-        
-        timerfd_settime(TimeoutEntry->FileHandle, 0, &TimerArgument, 0);
+        ScheduleDBusTimeout(State, Timer);
+        Result = true;
     }
     
     return Result;
@@ -157,576 +285,3770 @@ function void
 HandleDBusRemoveTimeout(DBusTimeout *TimeoutHandle, void *UserData)
 {
     trayge_state *State = UserData;
-    dbus_timeout_entry *TimeoutEntry = dbus_timeout_get_data(TimeoutHandle);
-    if(TimeoutEntry)
+    timer_entry *Timer = dbus_timeout_get_data(TimeoutHandle);
+    if(Timer)
     {
-        TimeoutEntry->Next->Prev = TimeoutEntry->Prev;
-        TimeoutEntry->Prev->Next = TimeoutEntry->Next;
+        UnscheduleTimer(&State->Timers, Timer);
+        ArmTimerSource(State);
         
-        close(TimeoutEntry->FileHandle);
-        free(TimeoutEntry);
+        PoolFree(&State->TimerPool, Timer);
         --State->TimeoutCount;
+        
+        dbus_timeout_set_data(TimeoutHandle, 0, 0);
     }
 }
 
 function void
 HandleDBusToggleTimeout(DBusTimeout *TimeoutHandle, void *UserData)
 {
-    if(dbus_timeout_get_enabled(TimeoutHandle))
+    trayge_state *State = UserData;
+    timer_entry *Timer = dbus_timeout_get_data(TimeoutHandle);
+    if(Timer)
     {
-        HandleDBusAddTimeout(TimeoutHandle, UserData);
+        ScheduleDBusTimeout(State, Timer);
     }
-    else
+}
+
+function void
+AppendString(DBusMessageIter *Iter, char *Value)
+{
+    dbus_message_iter_append_basic(Iter, DBUS_TYPE_STRING, &Value);
+}
+
+// NOTE(trayge): libdbus has no way to ask for a message's wire size short of marshalling it,
+// so this costs one copy. Cached templates pay it once per version and their copies reuse that
+// size; everything else is sampled by EstimateMessageSize.
+function u64
+MarshalledMessageSize(trayge_state *State, DBusMessage *Message)
+{
+    u64 Result = 0;
+    
+    char *Bytes = 0;
+    s32 Count = 0;
+    if(dbus_message_marshal(Message, &Bytes, &Count))
     {
-        HandleDBusRemoveTimeout(TimeoutHandle, UserData);
+        Result = (u64)Count;
+        dbus_free(Bytes);
     }
+    
+    AtomicAddU64(&State->Stats->Counters[StatsCounter_BytesMarshalled], Result);
+    
+    return Result;
 }
 
-function char *
-TrayPropertyTypeToName(dbus_tray_property_type Type)
+function consumer *
+FindConsumer(trayge_state *State, const char *Name)
 {
-    char *Result = 0;
+    consumer *Result = 0;
+    consumer *Free = 0;
     
-    switch(Type)
+    hashed_string Key = StrHashed(Name);
+    for(u32 ConsumerIndex = 0;
+        !Result && ConsumerIndex < MaxConsumers;
+        ++ConsumerIndex)
     {
-        case DBusTrayProperty_Category:
-        {
-            Result = "Category";
-        } break;
-        
-        case DBusTrayProperty_Id:
-        {
-            Result = "Id";
-        } break;
-        
-        case DBusTrayProperty_Title:
-        {
-            Result = "Title";
-        } break;
-        
-        case DBusTrayProperty_Status:
-        {
-            Result = "Status";
-        } break;
-        
-        case DBusTrayProperty_IconThemePath:
+        consumer *Consumer = State->Consumers + ConsumerIndex;
+        if(Consumer->Hash == Key.Hash && StringsAreEqual(Str(Consumer->Name), Key.String, 0))
         {
-            Result = "IconThemePath";
-        } break;
-        
-        case DBusTrayProperty_Menu:
-        {
-            Result = "Menu";
-        } break;
-        
-        case DBusTrayProperty_ItemIsMenu:
-        {
-            Result = "ItemIsMenu";
-        } break;
-        
-        case DBusTrayProperty_IconName:
-        {
-            Result = "IconName";
-        } break;
-        
-        case DBusTrayProperty_IconPixmap:
+            Result = Consumer;
+        }
+        else if(!Free && !Consumer->QueuedBytes && !Consumer->DeferredCount)
         {
-            Result = "IconPixmap";
-        } break;
-        
-        case DBusTrayProperty_AttentionIconName:
+            Free = Consumer;
+        }
+    }
+    
+    // NOTE(trayge): Idle slots are recycled, so a peer that comes back after draining starts
+    // over; one that stays busy keeps its slot. With every slot busy new peers go untracked.
+    if(!Result && Free && Key.String.Size < sizeof(Free->Name))
+    {
+        Result = Free;
+        *Result = (consumer){};
+        Result->Hash = Key.Hash;
+        snprintf(Result->Name, sizeof(Result->Name), "%s", Name);
+    }
+    
+    return Result;
+}
+
+function b32
+ConsumerIsBackedUp(trayge_state *State, consumer *Consumer)
+{
+    b32 Result = (Consumer && Consumer->QueuedBytes > State->ConsumerQueueLimit);
+    return Result;
+}
+
+global char *BackpressurePolicyNames[Backpressure_Count] = {"skip", "lowres", "pause"};
+
+function b32
+ParseBackpressurePolicy(string Name, backpressure_policy *Policy)
+{
+    b32 Result = false;
+    
+    for(u32 Candidate = 0;
+        Candidate < Backpressure_Count;
+        ++Candidate)
+    {
+        if(StringsAreEqual(Name, Str(BackpressurePolicyNames[Candidate]), 0))
         {
-            Result = "AttentionIconName";
-        } break;
+            *Policy = (backpressure_policy)Candidate;
+            Result = true;
+            break;
+        }
+    }
+    
+    return Result;
+}
+
+// NOTE(trayge): The sender of a pixmap fetch when it is over its queue limit, counted as
+// throttled; 0 when the fetch can be answered normally.
+function consumer *
+FindThrottledConsumer(trayge_state *State, DBusMessage *Message)
+{
+    consumer *Result = FindConsumer(State, dbus_message_get_sender(Message));
+    if(ConsumerIsBackedUp(State, Result))
+    {
+        ++Result->ThrottledCount;
+        AtomicAddU64(&State->Stats->Counters[StatsCounter_ThrottledReplies], 1);
+    }
+    else
+    {
+        Result = 0;
+    }
+    
+    return Result;
+}
+
+function void
+DeferFetch(consumer *Consumer, DBusMessage *Message, tray_item *Item, b32 GetAll)
+{
+    deferred_fetch *Fetch = Consumer->Deferred + Consumer->DeferredCount++;
+    Fetch->Message = dbus_message_ref(Message);
+    Fetch->Item = Item;
+    Fetch->GetAll = GetAll;
+}
+
+function void
+FreeReplyRecord(void *Memory)
+{
+    reply_record *Record = Memory;
+    Record->Consumer->QueuedBytes -= Record->Size;
+    PoolFree(&Record->State->ReplyRecordPool, Record);
+}
+
+// NOTE(trayge): Replies carry a record in a data slot; libdbus drops its reference once the
+// bytes are written, the slot's free function runs, and the bytes leave the consumer's queue.
+function void
+TrackReply(trayge_state *State, DBusMessage *Message, u64 Size)
+{
+    const char *Destination = dbus_message_get_destination(Message);
+    consumer *Consumer = Destination ? FindConsumer(State, Destination) : 0;
+    if(Consumer)
+    {
+        reply_record *Record = PoolAllocate(&State->ReplyRecordPool);
+        Record->State = State;
+        Record->Consumer = Consumer;
+        Record->Size = Size;
         
-        case DBusTrayProperty_AttentionIconPixmap:
+        Consumer->QueuedBytes += Size;
+        if(Consumer->PeakQueuedBytes < Consumer->QueuedBytes)
         {
-            Result = "AttentionIconPixmap";
-        } break;
+            Consumer->PeakQueuedBytes = Consumer->QueuedBytes;
+        }
         
-        case DBusTrayProperty_Unhandled:
-        case DBusTrayProperty_Count:
-        {
-        } break;
+        dbus_message_set_data(Message, State->ReplySlot, Record, FreeReplyRecord);
     }
+}
+
+// NOTE(trayge): Only one send in MessageSizeSampleInterval of each type is marshalled to be
+// measured; the rest are charged the running size. Messages without a template are signals and
+// small replies whose sizes barely move, and the counters they feed do not need to be exact.
+function u64
+EstimateMessageSize(trayge_state *State, DBusMessage *Message)
+{
+    s32 MessageType = dbus_message_get_type(Message);
+    message_size_estimate *Estimate = State->SizeEstimates + MessageType;
     
+    if(!Estimate->Size || ++Estimate->SendsSinceSample >= MessageSizeSampleInterval)
+    {
+        u64 Measured = MarshalledMessageSize(State, Message);
+        Estimate->Size = Estimate->Size ? (Estimate->Size*7 + Measured) / 8 : Measured;
+        Estimate->SendsSinceSample = 0;
+    }
+    
+    u64 Result = Estimate->Size;
     return Result;
 }
 
+// NOTE(trayge): Size is the template size for copies of cached replies, or 0 to estimate it.
 function void
-AppendTrayPropertyVariant(trayge_state *State, dbus_tray_property_type Type, DBusMessageIter *Parent)
+SendMessage(trayge_state *State, DBusMessage *Message, u64 Size)
 {
-    DBusMessageIter Variant = {};
+    trayge_stats *Stats = State->Stats;
     
-    switch(Type)
+    if(!Size)
     {
-        case DBusTrayProperty_Category:
-        {
-            DeferLoop(dbus_message_iter_open_container(Parent, DBUS_TYPE_VARIANT, "s", &Variant),
-                      dbus_message_iter_close_container(Parent, &Variant))
-            {
-                char *Value = "ApplicationStatus";
-                dbus_message_iter_append_basic(&Variant, DBUS_TYPE_STRING, &Value);
-            }
-        } break;
-        
-        case DBusTrayProperty_Id:
-        {
-            DeferLoop(dbus_message_iter_open_container(Parent, DBUS_TYPE_VARIANT, "s", &Variant),
-                      dbus_message_iter_close_container(Parent, &Variant))
-            {
-                char *Value = "trayge_example";
-                dbus_message_iter_append_basic(&Variant, DBUS_TYPE_STRING, &Value);
-            }
-        } break;
-        
-        case DBusTrayProperty_Title:
-        {
-            DeferLoop(dbus_message_iter_open_container(Parent, DBUS_TYPE_VARIANT, "s", &Variant),
-                      dbus_message_iter_close_container(Parent, &Variant))
-            {
-                char *Value = "Trayge Example";
-                dbus_message_iter_append_basic(&Variant, DBUS_TYPE_STRING, &Value);
-            }
-        } break;
-        
-        case DBusTrayProperty_Status:
-        {
-            DeferLoop(dbus_message_iter_open_container(Parent, DBUS_TYPE_VARIANT, "s", &Variant),
-                      dbus_message_iter_close_container(Parent, &Variant))
-            {
-                char *Value = "Active";
-                dbus_message_iter_append_basic(&Variant, DBUS_TYPE_STRING, &Value);
-            }
-        } break;
-        
-        case DBusTrayProperty_IconThemePath:
-        {
-            DeferLoop(dbus_message_iter_open_container(Parent, DBUS_TYPE_VARIANT, "s", &Variant),
-                      dbus_message_iter_close_container(Parent, &Variant))
-            {
-                char *Value = "";
-                dbus_message_iter_append_basic(&Variant, DBUS_TYPE_STRING, &Value);
-            }
-        } break;
-        
-        case DBusTrayProperty_Menu:
-        {
-            DeferLoop(dbus_message_iter_open_container(Parent, DBUS_TYPE_VARIANT, "o", &Variant),
-                      dbus_message_iter_close_container(Parent, &Variant))
-            {
-                //char *Value = "/MenuBar";
-                char *Value = "/";
-                dbus_message_iter_append_basic(&Variant, DBUS_TYPE_OBJECT_PATH, &Value);
-            }
-        } break;
-        
-        case DBusTrayProperty_ItemIsMenu:
-        {
-            DeferLoop(dbus_message_iter_open_container(Parent, DBUS_TYPE_VARIANT, "b", &Variant),
-                      dbus_message_iter_close_container(Parent, &Variant))
-            {
-                b32 Value = false;
-                dbus_message_iter_append_basic(&Variant, DBUS_TYPE_BOOLEAN, &Value);
-            }
-        } break;
-        
-        case DBusTrayProperty_IconName:
+        Size = EstimateMessageSize(State, Message);
+    }
+    AtomicAddU64(&Stats->Counters[StatsCounter_BytesSent], Size);
+    
+    s32 MessageType = dbus_message_get_type(Message);
+    if(MessageType == DBUS_MESSAGE_TYPE_SIGNAL)
+    {
+        AtomicAddU64(&Stats->Counters[StatsCounter_SignalsEmitted], 1);
+    }
+    else if(MessageType == DBUS_MESSAGE_TYPE_METHOD_RETURN || MessageType == DBUS_MESSAGE_TYPE_ERROR)
+    {
+        AtomicAddU64(&Stats->Counters[StatsCounter_RepliesSent], 1);
+        TrackReply(State, Message, Size);
+    }
+    
+    dbus_connection_send(State->Connection, Message, 0);
+}
+
+function void
+AppendIconCacheSizes(icon_cache *Icon, u32 SizeMask, DBusMessageIter *Parent)
+{
+    DBusMessageIter IconsArray = {};
+    DeferLoop(dbus_message_iter_open_container(Parent, DBUS_TYPE_ARRAY, "(iiay)", &IconsArray),
+              dbus_message_iter_close_container(Parent, &IconsArray))
+    {
+        for(u32 SizeIndex = 0;
+            Icon && SizeIndex < IconSize_Count;
+            ++SizeIndex)
         {
-            DeferLoop(dbus_message_iter_open_container(Parent, DBUS_TYPE_VARIANT, "s", &Variant),
-                      dbus_message_iter_close_container(Parent, &Variant))
+            icon_image *Image = Icon->Images + SizeIndex;
+            if(Image->Bytes && (SizeMask & (1u << SizeIndex)))
             {
-                char *Value = "";
-                dbus_message_iter_append_basic(&Variant, DBUS_TYPE_STRING, &Value);
+                DBusMessageIter IconsEntry = {};
+                DeferLoop(dbus_message_iter_open_container(&IconsArray, DBUS_TYPE_STRUCT, 0, &IconsEntry),
+                          dbus_message_iter_close_container(&IconsArray, &IconsEntry))
+                {
+                    dbus_message_iter_append_basic(&IconsEntry, DBUS_TYPE_INT32, &Image->Width);
+                    dbus_message_iter_append_basic(&IconsEntry, DBUS_TYPE_INT32, &Image->Height);
+                    
+                    DBusMessageIter IconsEntryBytes = {};
+                    DeferLoop(dbus_message_iter_open_container(&IconsEntry, DBUS_TYPE_ARRAY, "y", &IconsEntryBytes),
+                              dbus_message_iter_close_container(&IconsEntry, &IconsEntryBytes))
+                    {
+                        dbus_message_iter_append_fixed_array(&IconsEntryBytes, DBUS_TYPE_BYTE, &Image->Bytes, Image->Width*Image->Height*4);
+                    }
+                }
             }
-        } break;
+        }
+    }
+}
+
+function void
+AppendIconCache(icon_cache *Icon, DBusMessageIter *Parent)
+{
+    AppendIconCacheSizes(Icon, IconSizeAll, Parent);
+}
+
+function void
+AppendTrayPropertyCategory(tray_item *Item, DBusMessageIter *Variant)
+{
+    AppendString(Variant, "ApplicationStatus");
+}
+
+function void
+AppendTrayPropertyId(tray_item *Item, DBusMessageIter *Variant)
+{
+    AppendString(Variant, Item->Id);
+}
+
+function void
+AppendTrayPropertyTitle(tray_item *Item, DBusMessageIter *Variant)
+{
+    AppendString(Variant, Item->Title);
+}
+
+function void
+AppendTrayPropertyStatus(tray_item *Item, DBusMessageIter *Variant)
+{
+    AppendString(Variant, Item->Status);
+}
+
+function void
+AppendTrayPropertyWindowId(tray_item *Item, DBusMessageIter *Variant)
+{
+    s32 Value = 0;
+    dbus_message_iter_append_basic(Variant, DBUS_TYPE_INT32, &Value);
+}
+
+function void
+AppendTrayPropertyIconThemePath(tray_item *Item, DBusMessageIter *Variant)
+{
+    AppendString(Variant, Item->IconThemePath);
+}
+
+function void
+AppendTrayPropertyMenu(tray_item *Item, DBusMessageIter *Variant)
+{
+    char *Value = Item->MenuPath;
+    dbus_message_iter_append_basic(Variant, DBUS_TYPE_OBJECT_PATH, &Value);
+}
+
+function void
+AppendTrayPropertyItemIsMenu(tray_item *Item, DBusMessageIter *Variant)
+{
+    b32 Value = false;
+    dbus_message_iter_append_basic(Variant, DBUS_TYPE_BOOLEAN, &Value);
+}
+
+function void
+AppendTrayPropertyIconName(tray_item *Item, DBusMessageIter *Variant)
+{
+    AppendString(Variant, Item->IconName);
+}
+
+function void
+AppendTrayPropertyIconPixmap(tray_item *Item, DBusMessageIter *Variant)
+{
+    AppendIconCache(&Item->Icon, Variant);
+}
+
+function void
+AppendTrayPropertyOverlayIconName(tray_item *Item, DBusMessageIter *Variant)
+{
+    AppendString(Variant, "");
+}
+
+function void
+AppendTrayPropertyOverlayIconPixmap(tray_item *Item, DBusMessageIter *Variant)
+{
+    AppendIconCache(0, Variant);
+}
+
+function void
+AppendTrayPropertyAttentionIconName(tray_item *Item, DBusMessageIter *Variant)
+{
+    AppendString(Variant, "");
+}
+
+function void
+AppendTrayPropertyAttentionIconPixmap(tray_item *Item, DBusMessageIter *Variant)
+{
+    AppendIconCache(0, Variant);
+}
+
+function void
+AppendTrayPropertyAttentionMovieName(tray_item *Item, DBusMessageIter *Variant)
+{
+    AppendString(Variant, "");
+}
+
+function void
+AppendTrayPropertyToolTip(tray_item *Item, DBusMessageIter *Variant)
+{
+    DBusMessageIter ToolTip = {};
+    DeferLoop(dbus_message_iter_open_container(Variant, DBUS_TYPE_STRUCT, 0, &ToolTip),
+              dbus_message_iter_close_container(Variant, &ToolTip))
+    {
+        AppendString(&ToolTip, "");
+        AppendIconCache(0, &ToolTip);
+        AppendString(&ToolTip, Item->ToolTipTitle);
+        AppendString(&ToolTip, Item->ToolTipDescription);
+    }
+}
+
+typedef void tray_property_getter(tray_item *Item, DBusMessageIter *Variant);
+
+typedef struct tray_property_info
+{
+    char *Name;
+    char *Signature;
+    tray_signal_type Signal;
+    tray_property_getter *Getter;
+} tray_property_info;
+
+global tray_property_info TrayProperties[DBusTrayProperty_Count] =
+{
+    {},
+#define X(Name, Signature, Signal) {#Name, Signature, TraySignal_##Signal, AppendTrayProperty##Name},
+    TrayPropertyList(X)
+#undef X
+};
+
+global char *TraySignalNames[TraySignal_Count] =
+{
+    0,
+#define X(Name) #Name,
+    TraySignalList(X)
+#undef X
+};
+
+typedef struct dbus_method_info
+{
+    char *Interface;
+    char *Member;
+} dbus_method_info;
+
+global dbus_method_info DBusMethods[DBusMethod_Count] =
+{
+    {},
+#define X(Name, Interface, Member) {Interface, Member},
+    DBusMethodList(X)
+#undef X
+};
+
+function void
+AppendDBusMenuPropertyVersion(tray_item *Item, DBusMessageIter *Variant)
+{
+    u32 Value = 3;
+    dbus_message_iter_append_basic(Variant, DBUS_TYPE_UINT32, &Value);
+}
+
+function void
+AppendDBusMenuPropertyTextDirection(tray_item *Item, DBusMessageIter *Variant)
+{
+    AppendString(Variant, "ltr");
+}
+
+function void
+AppendDBusMenuPropertyStatus(tray_item *Item, DBusMessageIter *Variant)
+{
+    AppendString(Variant, "normal");
+}
+
+function void
+AppendDBusMenuPropertyIconThemePath(tray_item *Item, DBusMessageIter *Variant)
+{
+    DBusMessageIter Paths = {};
+    DeferLoop(dbus_message_iter_open_container(Variant, DBUS_TYPE_ARRAY, "s", &Paths),
+              dbus_message_iter_close_container(Variant, &Paths))
+    {
+    }
+}
+
+typedef struct dbus_menu_property_info
+{
+    char *Name;
+    char *Signature;
+    tray_property_getter *Getter;
+} dbus_menu_property_info;
+
+global dbus_menu_property_info DBusMenuProperties[DBusMenuProperty_Count] =
+{
+    {},
+#define X(Name, Signature) {#Name, Signature, AppendDBusMenuProperty##Name},
+    DBusMenuPropertyList(X)
+#undef X
+};
+
+typedef struct menu_property_info
+{
+    char *Key;
+    char *Signature;
+} menu_property_info;
+
+global menu_property_info MenuProperties[MenuProperty_Count] =
+{
+#define X(Name, Key, Signature) {Key, Signature},
+    MenuPropertyList(X)
+#undef X
+};
+
+global name_table DBusMethodTable;
+global name_table TrayPropertyTable;
+global name_table DBusMenuPropertyTable;
+global name_table MenuPropertyTable;
+
+function void
+InitDispatchTables(void)
+{
+    for(u32 MethodIndex = DBusMethod_Unhandled + 1;
+        MethodIndex < DBusMethod_Count;
+        ++MethodIndex)
+    {
+        dbus_method_info *Info = DBusMethods + MethodIndex;
+        InsertName(&DBusMethodTable, StrHashed(Info->Interface), StrHashed(Info->Member), MethodIndex);
+    }
+    
+    for(u32 PropertyIndex = DBusTrayProperty_Unhandled + 1;
+        PropertyIndex < DBusTrayProperty_Count;
+        ++PropertyIndex)
+    {
+        tray_property_info *Info = TrayProperties + PropertyIndex;
+        InsertName(&TrayPropertyTable, StrHashed("org.kde.StatusNotifierItem"), StrHashed(Info->Name), PropertyIndex);
+    }
+    
+    for(u32 PropertyIndex = DBusMenuProperty_Unhandled + 1;
+        PropertyIndex < DBusMenuProperty_Count;
+        ++PropertyIndex)
+    {
+        dbus_menu_property_info *Info = DBusMenuProperties + PropertyIndex;
+        InsertName(&DBusMenuPropertyTable, StrHashed("com.canonical.dbusmenu"), StrHashed(Info->Name), PropertyIndex);
+    }
+    
+    for(u32 PropertyIndex = 0;
+        PropertyIndex < MenuProperty_Count;
+        ++PropertyIndex)
+    {
+        InsertName(&MenuPropertyTable, StrHashed(""), StrHashed(MenuProperties[PropertyIndex].Key), PropertyIndex + 1);
+    }
+}
+
+function void
+AppendTrayPropertyVariant(tray_item *Item, dbus_tray_property_type Type, DBusMessageIter *Parent)
+{
+    tray_property_info *Info = TrayProperties + Type;
+    
+    DBusMessageIter Variant = {};
+    DeferLoop(dbus_message_iter_open_container(Parent, DBUS_TYPE_VARIANT, Info->Signature, &Variant),
+              dbus_message_iter_close_container(Parent, &Variant))
+    {
+        Info->Getter(Item, &Variant);
+    }
+}
+
+// NOTE(trayge): IconPixmap restricted to some of the cached sizes, for consumers that are
+// backed up under the lowres policy.
+function void
+AppendIconPixmapVariant(tray_item *Item, u32 SizeMask, DBusMessageIter *Parent)
+{
+    DBusMessageIter Variant = {};
+    DeferLoop(dbus_message_iter_open_container(Parent, DBUS_TYPE_VARIANT, TrayProperties[DBusTrayProperty_IconPixmap].Signature, &Variant),
+              dbus_message_iter_close_container(Parent, &Variant))
+    {
+        AppendIconCacheSizes(&Item->Icon, SizeMask, &Variant);
+    }
+}
+
+function void
+AppendDBusMenuPropertyVariant(tray_item *Item, dbus_menu_property_type Type, DBusMessageIter *Parent)
+{
+    dbus_menu_property_info *Info = DBusMenuProperties + Type;
+    
+    DBusMessageIter Variant = {};
+    DeferLoop(dbus_message_iter_open_container(Parent, DBUS_TYPE_VARIANT, Info->Signature, &Variant),
+              dbus_message_iter_close_container(Parent, &Variant))
+    {
+        Info->Getter(Item, &Variant);
+    }
+}
+
+function void
+AppendMenuPropertyVariant(menu_tree *Tree, s32 Id, menu_property_type Property, DBusMessageIter *Parent)
+{
+    menu_node *Node = Tree->Nodes + Id;
+    
+    DBusMessageIter Variant = {};
+    DeferLoop(dbus_message_iter_open_container(Parent, DBUS_TYPE_VARIANT, MenuProperties[Property].Signature, &Variant),
+              dbus_message_iter_close_container(Parent, &Variant))
+    {
+        switch(Property)
+        {
+            case MenuProperty_Type:
+            {
+                AppendString(&Variant, (Node->Type == MenuItem_Separator) ? "separator" : "standard");
+            } break;
+            
+            case MenuProperty_Label:
+            {
+                AppendString(&Variant, Node->Label);
+            } break;
+            
+            case MenuProperty_Enabled:
+            {
+                dbus_message_iter_append_basic(&Variant, DBUS_TYPE_BOOLEAN, &Node->Enabled);
+            } break;
+            
+            case MenuProperty_Visible:
+            {
+                dbus_message_iter_append_basic(&Variant, DBUS_TYPE_BOOLEAN, &Node->Visible);
+            } break;
+            
+            case MenuProperty_IconName:
+            {
+                AppendString(&Variant, Node->IconName ? Node->IconName : "");
+            } break;
+            
+            case MenuProperty_ToggleType:
+            {
+                char *Value = "";
+                if(Node->ToggleType == MenuToggle_Checkmark)
+                {
+                    Value = "checkmark";
+                }
+                else if(Node->ToggleType == MenuToggle_Radio)
+                {
+                    Value = "radio";
+                }
+                
+                AppendString(&Variant, Value);
+            } break;
+            
+            case MenuProperty_ToggleState:
+            {
+                dbus_message_iter_append_basic(&Variant, DBUS_TYPE_INT32, &Node->ToggleState);
+            } break;
+            
+            case MenuProperty_ChildrenDisplay:
+            {
+                AppendString(&Variant, (Node->FirstChild >= 0) ? "submenu" : "");
+            } break;
+            
+            case MenuProperty_Count:
+            {
+            } break;
+        }
+    }
+}
+
+function void
+AppendMenuProperties(menu_tree *Tree, s32 Id, u32 PropertyMask, DBusMessageIter *Parent)
+{
+    DBusMessageIter PropertiesArray = {};
+    DeferLoop(dbus_message_iter_open_container(Parent, DBUS_TYPE_ARRAY, "{sv}", &PropertiesArray),
+              dbus_message_iter_close_container(Parent, &PropertiesArray))
+    {
+        for(u32 PropertyIndex = 0;
+            PropertyIndex < MenuProperty_Count;
+            ++PropertyIndex)
+        {
+            if((PropertyMask & (1u << PropertyIndex)) && !MenuPropertyIsDefault(Tree, Id, PropertyIndex))
+            {
+                DBusMessageIter PropertyEntry = {};
+                DeferLoop(dbus_message_iter_open_container(&PropertiesArray, DBUS_TYPE_DICT_ENTRY, 0, &PropertyEntry),
+                          dbus_message_iter_close_container(&PropertiesArray, &PropertyEntry))
+                {
+                    AppendString(&PropertyEntry, MenuProperties[PropertyIndex].Key);
+                    AppendMenuPropertyVariant(Tree, Id, PropertyIndex, &PropertyEntry);
+                }
+            }
+        }
+    }
+}
+
+function void
+AppendMenuLayout(menu_tree *Tree, s32 Id, s32 Depth, u32 PropertyMask, DBusMessageIter *Parent)
+{
+    DBusMessageIter Layout = {};
+    DeferLoop(dbus_message_iter_open_container(Parent, DBUS_TYPE_STRUCT, 0, &Layout),
+              dbus_message_iter_close_container(Parent, &Layout))
+    {
+        dbus_message_iter_append_basic(&Layout, DBUS_TYPE_INT32, &Id);
+        AppendMenuProperties(Tree, Id, PropertyMask, &Layout);
+        
+        DBusMessageIter Children = {};
+        DeferLoop(dbus_message_iter_open_container(&Layout, DBUS_TYPE_ARRAY, "v", &Children),
+                  dbus_message_iter_close_container(&Layout, &Children))
+        {
+            if(Depth != 0)
+            {
+                for(s32 Child = Tree->Nodes[Id].FirstChild;
+                    Child >= 0;
+                    Child = Tree->Nodes[Child].NextSibling)
+                {
+                    DBusMessageIter ChildVariant = {};
+                    DeferLoop(dbus_message_iter_open_container(&Children, DBUS_TYPE_VARIANT, "(ia{sv}av)", &ChildVariant),
+                              dbus_message_iter_close_container(&Children, &ChildVariant))
+                    {
+                        AppendMenuLayout(Tree, Child, (Depth > 0) ? Depth - 1 : Depth, PropertyMask, &ChildVariant);
+                    }
+                }
+            }
+        }
+    }
+}
+
+function u32
+ReadMenuPropertyMask(DBusMessageIter *Args)
+{
+    u32 Result = MenuPropertyAll;
+    
+    if(dbus_message_iter_get_arg_type(Args) == DBUS_TYPE_ARRAY)
+    {
+        DBusMessageIter Names = {};
+        dbus_message_iter_recurse(Args, &Names);
+        
+        if(dbus_message_iter_get_arg_type(&Names) == DBUS_TYPE_STRING)
+        {
+            Result = 0;
+            
+            while(dbus_message_iter_get_arg_type(&Names) == DBUS_TYPE_STRING)
+            {
+                char *Name = 0;
+                dbus_message_iter_get_basic(&Names, &Name);
+                
+                u32 Property = LookupName(&MenuPropertyTable, StrHashed(""), StrHashed(Name));
+                if(Property)
+                {
+                    Result |= (1u << (Property - 1));
+                }
+                
+                dbus_message_iter_next(&Names);
+            }
+        }
+        
+        dbus_message_iter_next(Args);
+    }
+    
+    return Result;
+}
+
+function s32
+ReadInt32Argument(DBusMessageIter *Args, s32 Default)
+{
+    s32 Result = Default;
+    
+    if(dbus_message_iter_get_arg_type(Args) == DBUS_TYPE_INT32)
+    {
+        dbus_message_iter_get_basic(Args, &Result);
+        dbus_message_iter_next(Args);
+    }
+    
+    return Result;
+}
+
+function u32
+ReadInt32ArrayArgument(DBusMessageIter *Args, s32 **Values)
+{
+    s32 Result = 0;
+    *Values = 0;
+    
+    if(dbus_message_iter_get_arg_type(Args) == DBUS_TYPE_ARRAY &&
+       dbus_message_iter_get_element_type(Args) == DBUS_TYPE_INT32)
+    {
+        DBusMessageIter Array = {};
+        dbus_message_iter_recurse(Args, &Array);
+        dbus_message_iter_get_fixed_array(&Array, Values, &Result);
+        dbus_message_iter_next(Args);
+    }
+    
+    return (u32)Result;
+}
+
+function void
+MarkTrayPropertyChanged(tray_item *Item, dbus_tray_property_type Type)
+{
+    ++Item->PropertyVersions[Type];
+}
+
+function void
+SetTrayString(tray_item *Item, dbus_tray_property_type Type, char **Field, char *Value)
+{
+    if(!StringsAreEqual(Str(*Field), Str(Value), 0))
+    {
+        *Field = Value;
+        MarkTrayPropertyChanged(Item, Type);
+    }
+}
+
+function void
+ApplyTrayString(tray_item *Item, tray_string_type String, char *Value)
+{
+    char **Field = 0;
+    dbus_tray_property_type Type = DBusTrayProperty_Unhandled;
+    
+    switch(String)
+    {
+        case TrayString_Title:
+        {
+            Field = &Item->Title;
+            Type = DBusTrayProperty_Title;
+        } break;
+        
+        case TrayString_Status:
+        {
+            Field = &Item->Status;
+            Type = DBusTrayProperty_Status;
+        } break;
+        
+        case TrayString_ToolTipTitle:
+        {
+            Field = &Item->ToolTipTitle;
+            Type = DBusTrayProperty_ToolTip;
+        } break;
+        
+        case TrayString_ToolTipDescription:
+        {
+            Field = &Item->ToolTipDescription;
+            Type = DBusTrayProperty_ToolTip;
+        } break;
+        
+        InvalidDefaultCase;
+    }
+    
+    if(Field && !StringsAreEqual(Str(*Field), Str(Value), 0))
+    {
+        char *Storage = Item->StringStorage[String];
+        snprintf(Storage, TrayStringMax, "%s", Value);
+        
+        *Field = Storage;
+        MarkTrayPropertyChanged(Item, Type);
+    }
+}
+
+function void
+NoteFrameFetched(frame_scheduler *Scheduler)
+{
+    if(Scheduler->AwaitingFetch)
+    {
+        u64 Latency = GetMonotonicTime() - Scheduler->EmitTime;
+        Scheduler->FetchLatency = (Scheduler->FetchLatency*7 + Latency) / 8;
+        Scheduler->AwaitingFetch = false;
+        
+        u64 FrameInterval = Billion / Scheduler->FramesPerSecond;
+        if(Scheduler->FetchLatency < FrameInterval / 2 &&
+           Scheduler->FramesPerSecond < Scheduler->MaxFramesPerSecond)
+        {
+            Scheduler->FramesPerSecond += Scheduler->FramesPerSecond / 8 + 1;
+            if(Scheduler->FramesPerSecond > Scheduler->MaxFramesPerSecond)
+            {
+                Scheduler->FramesPerSecond = Scheduler->MaxFramesPerSecond;
+            }
+        }
+    }
+}
+
+// NOTE(trayge): Pixmaps are never sent inline. A multi-size IconPixmap is a few hundred
+// kilobytes, a signal is delivered to every listener whether it wants the pixels or not, and
+// it would be marshalled afresh each frame. Hosts fetch it with Get instead, which is served
+// from the per-version reply template, and themed IconName hosts never fetch it at all.
+function b32
+PropertyIsInvalidatedOnly(dbus_tray_property_type Type)
+{
+    b32 Result = (Type == DBusTrayProperty_IconPixmap ||
+                  Type == DBusTrayProperty_OverlayIconPixmap ||
+                  Type == DBusTrayProperty_AttentionIconPixmap);
+    return Result;
+}
+
+function void
+EmitTrayChangeSignals(trayge_state *State, tray_item *Item)
+{
+    b32 SignalPending[TraySignal_Count] = {};
+    b32 PropertyChanged[DBusTrayProperty_Count] = {};
+    u32 InlineCount = 0;
+    
+    for(u32 PropertyIndex = DBusTrayProperty_Unhandled + 1;
+        PropertyIndex < DBusTrayProperty_Count;
+        ++PropertyIndex)
+    {
+        if(Item->PropertyVersions[PropertyIndex] != Item->SignalledVersions[PropertyIndex])
+        {
+            SignalPending[TrayProperties[PropertyIndex].Signal] = true;
+            PropertyChanged[PropertyIndex] = true;
+            InlineCount += !PropertyIsInvalidatedOnly(PropertyIndex);
+            
+            Item->SignalledVersions[PropertyIndex] = Item->PropertyVersions[PropertyIndex];
+        }
+    }
+    
+    // NOTE(trayge): A frame that only changed pixels is announced by NewIcon alone; a
+    // PropertiesChanged naming nothing but invalidated pixmaps would tell hosts nothing NewIcon
+    // does not, and cost a second signal per frame.
+    if(InlineCount)
+    {
+        DBusMessage *Message = dbus_message_new_signal(Item->ObjectPath, "org.freedesktop.DBus.Properties", "PropertiesChanged");
+        
+        DBusMessageIter MessageArgs = {};
+        dbus_message_iter_init_append(Message, &MessageArgs);
+        AppendString(&MessageArgs, "org.kde.StatusNotifierItem");
+        
+        DBusMessageIter PropertiesArray = {};
+        DeferLoop(dbus_message_iter_open_container(&MessageArgs, DBUS_TYPE_ARRAY, "{sv}", &PropertiesArray),
+                  dbus_message_iter_close_container(&MessageArgs, &PropertiesArray))
+        {
+            for(u32 PropertyIndex = DBusTrayProperty_Unhandled + 1;
+                PropertyIndex < DBusTrayProperty_Count;
+                ++PropertyIndex)
+            {
+                if(PropertyChanged[PropertyIndex] && !PropertyIsInvalidatedOnly(PropertyIndex))
+                {
+                    DBusMessageIter PropertyEntry = {};
+                    DeferLoop(dbus_message_iter_open_container(&PropertiesArray, DBUS_TYPE_DICT_ENTRY, 0, &PropertyEntry),
+                              dbus_message_iter_close_container(&PropertiesArray, &PropertyEntry))
+                    {
+                        AppendString(&PropertyEntry, TrayProperties[PropertyIndex].Name);
+                        AppendTrayPropertyVariant(Item, PropertyIndex, &PropertyEntry);
+                    }
+                }
+            }
+        }
+        
+        DBusMessageIter InvalidatedArray = {};
+        DeferLoop(dbus_message_iter_open_container(&MessageArgs, DBUS_TYPE_ARRAY, "s", &InvalidatedArray),
+                  dbus_message_iter_close_container(&MessageArgs, &InvalidatedArray))
+        {
+            for(u32 PropertyIndex = DBusTrayProperty_Unhandled + 1;
+                PropertyIndex < DBusTrayProperty_Count;
+                ++PropertyIndex)
+            {
+                if(PropertyChanged[PropertyIndex] && PropertyIsInvalidatedOnly(PropertyIndex))
+                {
+                    AppendString(&InvalidatedArray, TrayProperties[PropertyIndex].Name);
+                }
+            }
+        }
+        
+        SendMessage(State, Message, 0);
+        dbus_message_unref(Message);
+        
+        // NOTE(trayge): In icon-name mode the frame is the IconName carried inline above, and
+        // hosts that follow PropertiesChanged never call Get for it. Handing it to the bus is
+        // as close to a fetch as the pacer will see; a host that falls behind still holds
+        // flushes back through the outgoing queue limit.
+        if(State->IconNameMode && PropertyChanged[DBusTrayProperty_IconName])
+        {
+            NoteFrameFetched(&State->Scheduler);
+        }
+    }
+    
+    for(u32 SignalIndex = TraySignal_None + 1;
+        SignalIndex < TraySignal_Count;
+        ++SignalIndex)
+    {
+        if(SignalPending[SignalIndex])
+        {
+            DBusMessage *Message = dbus_message_new_signal(Item->ObjectPath, "org.kde.StatusNotifierItem", TraySignalNames[SignalIndex]);
+            
+            if(SignalIndex == TraySignal_NewStatus)
+            {
+                dbus_message_append_args(Message, DBUS_TYPE_STRING, &Item->Status, DBUS_TYPE_INVALID);
+            }
+            
+            SendMessage(State, Message, 0);
+            dbus_message_unref(Message);
+        }
+    }
+}
+
+// NOTE(trayge): LayoutUpdated goes first. Items added since the previous one reach hosts
+// through the GetLayout it triggers, with their current values, so the delta leaves them out
+// rather than naming ids hosts do not have yet.
+function void
+EmitMenuSignals(trayge_state *State, tray_item *Item)
+{
+    menu_tree *Menu = &Item->Menu;
+    u32 KnownRevision = Menu->SignalledRevision;
+    
+    if(Menu->LayoutDirty)
+    {
+        DBusMessage *Message = dbus_message_new_signal(Item->MenuPath, "com.canonical.dbusmenu", "LayoutUpdated");
+        dbus_message_append_args(Message,
+                                 DBUS_TYPE_UINT32, &Menu->Revision,
+                                 DBUS_TYPE_INT32, &Menu->LayoutDirtyParent,
+                                 DBUS_TYPE_INVALID);
+        
+        SendMessage(State, Message, 0);
+        dbus_message_unref(Message);
+        
+        Menu->LayoutDirty = false;
+        Menu->SignalledRevision = Menu->Revision;
+    }
+    
+    b32 HaveAnnounced = false;
+    for(s32 Id = Menu->FirstDirty;
+        Id >= 0 && !HaveAnnounced;
+        Id = Menu->Nodes[Id].NextDirty)
+    {
+        HaveAnnounced = MenuItemIsAnnounced(Menu, Id, KnownRevision);
+    }
+    
+    if(HaveAnnounced)
+    {
+        DBusMessage *Message = dbus_message_new_signal(Item->MenuPath, "com.canonical.dbusmenu", "ItemsPropertiesUpdated");
+        
+        DBusMessageIter MessageArgs = {};
+        dbus_message_iter_init_append(Message, &MessageArgs);
+        
+        DBusMessageIter UpdatedArray = {};
+        DeferLoop(dbus_message_iter_open_container(&MessageArgs, DBUS_TYPE_ARRAY, "(ia{sv})", &UpdatedArray),
+                  dbus_message_iter_close_container(&MessageArgs, &UpdatedArray))
+        {
+            for(s32 Id = Menu->FirstDirty;
+                Id >= 0;
+                Id = Menu->Nodes[Id].NextDirty)
+            {
+                if(MenuItemIsAnnounced(Menu, Id, KnownRevision))
+                {
+                    DBusMessageIter UpdatedEntry = {};
+                    DeferLoop(dbus_message_iter_open_container(&UpdatedArray, DBUS_TYPE_STRUCT, 0, &UpdatedEntry),
+                              dbus_message_iter_close_container(&UpdatedArray, &UpdatedEntry))
+                    {
+                        dbus_message_iter_append_basic(&UpdatedEntry, DBUS_TYPE_INT32, &Id);
+                        AppendMenuProperties(Menu, Id, Menu->Nodes[Id].DirtyProperties, &UpdatedEntry);
+                    }
+                }
+            }
+        }
+        
+        DBusMessageIter RemovedArray = {};
+        DeferLoop(dbus_message_iter_open_container(&MessageArgs, DBUS_TYPE_ARRAY, "(ias)", &RemovedArray),
+                  dbus_message_iter_close_container(&MessageArgs, &RemovedArray))
+        {
+            for(s32 Id = Menu->FirstDirty;
+                Id >= 0;
+                Id = Menu->Nodes[Id].NextDirty)
+            {
+                u32 RemovedMask = 0;
+                for(u32 PropertyIndex = 0;
+                    MenuItemIsAnnounced(Menu, Id, KnownRevision) && PropertyIndex < MenuProperty_Count;
+                    ++PropertyIndex)
+                {
+                    if((Menu->Nodes[Id].DirtyProperties & (1u << PropertyIndex)) &&
+                       MenuPropertyIsDefault(Menu, Id, PropertyIndex))
+                    {
+                        RemovedMask |= (1u << PropertyIndex);
+                    }
+                }
+                
+                if(RemovedMask)
+                {
+                    DBusMessageIter RemovedEntry = {};
+                    DeferLoop(dbus_message_iter_open_container(&RemovedArray, DBUS_TYPE_STRUCT, 0, &RemovedEntry),
+                              dbus_message_iter_close_container(&RemovedArray, &RemovedEntry))
+                    {
+                        dbus_message_iter_append_basic(&RemovedEntry, DBUS_TYPE_INT32, &Id);
+                        
+                        DBusMessageIter RemovedNames = {};
+                        DeferLoop(dbus_message_iter_open_container(&RemovedEntry, DBUS_TYPE_ARRAY, "s", &RemovedNames),
+                                  dbus_message_iter_close_container(&RemovedEntry, &RemovedNames))
+                        {
+                            for(u32 PropertyIndex = 0;
+                                PropertyIndex < MenuProperty_Count;
+                                ++PropertyIndex)
+                            {
+                                if(RemovedMask & (1u << PropertyIndex))
+                                {
+                                    AppendString(&RemovedNames, MenuProperties[PropertyIndex].Key);
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+        
+        SendMessage(State, Message, 0);
+        dbus_message_unref(Message);
+    }
+    
+    for(s32 Id = Menu->FirstDirty;
+        Id >= 0;
+        Id = Menu->Nodes[Id].NextDirty)
+    {
+        Menu->Nodes[Id].DirtyProperties = 0;
+    }
+    Menu->FirstDirty = -1;
+}
+
+function u32
+LowResIconSizeMask(u32 SizeMask)
+{
+    u32 Result = 0;
+    for(u32 SizeIndex = 0;
+        SizeIndex < IconSize_Count;
+        ++SizeIndex)
+    {
+        if(IconSizes[SizeIndex] <= LowResIconSizeMax)
+        {
+            Result |= (1u << SizeIndex);
+        }
+    }
+    
+    Result &= SizeMask;
+    if(!Result)
+    {
+        Result = SizeMask & (~SizeMask + 1);
+    }
+    
+    return Result;
+}
+
+// NOTE(trayge): Pending property changes and dirty menu nodes already merge everything that
+// happened since the last emission, so holding off while the socket is backed up coalesces
+// signals for free: frames rendered in the meantime collapse into one NewIcon carrying the
+// newest pixmap instead of a backlog of superseded ones. Writing is left to the watch, which
+// libdbus arms for EPOLLOUT while its queue is non-empty, and the iteration that drains it
+// emits whatever is still pending.
+function void
+FlushChangeSignals(trayge_state *State)
+{
+    u64 OutgoingSize = (u64)dbus_connection_get_outgoing_size(State->Connection);
+    AtomicMaxU64(&State->Stats->Counters[StatsCounter_PeakOutgoingBytes], OutgoingSize);
+    
+    // NOTE(trayge): Signals are broadcast by the bus, so they cannot be held back for one
+    // peer; the pause policy holds them for everyone while any consumer is backed up.
+    b32 Paused = false;
+    for(u32 ConsumerIndex = 0;
+        State->BackpressurePolicy == Backpressure_Pause && !Paused && ConsumerIndex < MaxConsumers;
+        ++ConsumerIndex)
+    {
+        Paused = ConsumerIsBackedUp(State, State->Consumers + ConsumerIndex);
+    }
+    
+    if(State->HostPresent && !Paused && OutgoingSize <= OutboundSignalQueueLimit)
+    {
+        for(u32 ItemIndex = 0;
+            ItemIndex < State->ItemCount;
+            ++ItemIndex)
+        {
+            EmitTrayChangeSignals(State, State->Items + ItemIndex);
+            EmitMenuSignals(State, State->Items + ItemIndex);
+        }
+    }
+    else
+    {
+        AtomicAddU64(&State->Stats->Counters[StatsCounter_SignalFlushesDeferred], 1);
+    }
+}
+
+function u64
+EffectiveFramesPerSecond(frame_scheduler *Scheduler)
+{
+    u64 Result = Scheduler->FramesPerSecond;
+    
+    if(Scheduler->Session == Session_Locked)
+    {
+        Result = 0;
+    }
+    else if(Scheduler->Session == Session_Idle && Result > Scheduler->IdleFramesPerSecond)
+    {
+        Result = Scheduler->IdleFramesPerSecond;
+    }
+    
+    return Result;
+}
+
+function void
+ArmFrameTimer(trayge_state *State)
+{
+    frame_scheduler *Scheduler = &State->Scheduler;
+    
+    u64 FramesPerSecond = EffectiveFramesPerSecond(Scheduler);
+    
+    b32 ShouldArm = Scheduler->Animated && FramesPerSecond;
+    if(ShouldArm)
+    {
+        u64 Interval = Billion / FramesPerSecond;
+        if(!TimerIsScheduled(&Scheduler->Timer) || Scheduler->Timer.Interval != Interval)
+        {
+            Scheduler->Timer.Interval = Interval;
+            ScheduleTimer(&State->Timers, &Scheduler->Timer, GetMonotonicTime() + Interval);
+        }
+    }
+    else
+    {
+        UnscheduleTimer(&State->Timers, &Scheduler->Timer);
+    }
+    
+    ArmTimerSource(State);
+}
+
+function void
+InitFrameScheduler(trayge_state *State, u64 MaxFramesPerSecond, u64 IdleFramesPerSecond, b32 Animated)
+{
+    frame_scheduler *Scheduler = &State->Scheduler;
+    
+    Scheduler->Timer.Type = Timer_Frame;
+    Scheduler->Animated = Animated;
+    Scheduler->StartTime = GetMonotonicTime();
+    Scheduler->MaxFramesPerSecond = MaxFramesPerSecond;
+    Scheduler->MinFramesPerSecond = (MaxFramesPerSecond < 4) ? MaxFramesPerSecond : 4;
+    Scheduler->IdleFramesPerSecond = IdleFramesPerSecond;
+    Scheduler->FramesPerSecond = MaxFramesPerSecond;
+    
+    ArmFrameTimer(State);
+}
+
+function b32
+AdvanceFrame(trayge_state *State)
+{
+    frame_scheduler *Scheduler = &State->Scheduler;
+    
+    b32 Result = false;
+    
+    if(Scheduler->AwaitingFetch)
+    {
+        ++Scheduler->LaggedFrames;
+        Scheduler->AwaitingFetch = false;
+        
+        Scheduler->FramesPerSecond /= 2;
+        if(Scheduler->FramesPerSecond < Scheduler->MinFramesPerSecond)
+        {
+            Scheduler->FramesPerSecond = Scheduler->MinFramesPerSecond;
+        }
+    }
+    else
+    {
+        u64 Now = GetMonotonicTime();
+        u64 AnimationStep = (Now - Scheduler->StartTime)*AnimationStepsPerSecond / Billion;
+        
+        if(AnimationStep != Scheduler->AnimationStep)
+        {
+            Scheduler->AnimationStep = AnimationStep;
+            Scheduler->AwaitingFetch = true;
+            Scheduler->EmitTime = Now;
+            
+            State->XOffset = (s32)AnimationStep;
+            State->YOffset = (s32)(AnimationStep*2);
+            
+            Result = true;
+        }
+    }
+    
+    ArmFrameTimer(State);
+    
+    return Result;
+}
+
+function void
+UpdateFrameSchedulerAnimation(trayge_state *State)
+{
+    b32 Animated = false;
+    for(u32 ItemIndex = 0;
+        ItemIndex < State->ItemCount;
+        ++ItemIndex)
+    {
+        Animated |= State->Items[ItemIndex].Animated;
+    }
+    
+    State->Scheduler.Animated = Animated && State->HostPresent;
+    ArmFrameTimer(State);
+}
+
+function b32
+WriteWholeFile(char *Path, u8 *Bytes, u64 Size)
+{
+    b32 Result = false;
+    
+    s32 FileHandle = open(Path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if(FileHandle >= 0)
+    {
+        Result = true;
+        while(Result && Size)
+        {
+            ssize_t Written = write(FileHandle, Bytes, Size);
+            if(Written > 0)
+            {
+                Bytes += Written;
+                Size -= (u64)Written;
+            }
+            else if(Written < 0 && errno != EINTR)
+            {
+                Result = false;
+            }
+        }
+        
+        close(FileHandle);
+    }
+    
+    return Result;
+}
+
+function void
+FormatIconThemeFile(trayge_state *State, char *Buffer, u64 BufferSize, s32 Size, char *Id, u64 Version)
+{
+    if(Size)
+    {
+        snprintf(Buffer, BufferSize, "%s/hicolor/%dx%d/apps/%s-%lu.png", State->IconThemePath, Size, Size, Id, Version);
+    }
+    else
+    {
+        snprintf(Buffer, BufferSize, "%s/%s-%lu.png", State->IconThemePath, Id, Version);
+    }
+}
+
+function void
+RemoveIconThemeFrame(trayge_state *State, tray_item *Item, u64 Version)
+{
+    char Path[512];
+    
+    FormatIconThemeFile(State, Path, sizeof(Path), 0, Item->Id, Version);
+    unlink(Path);
+    
+    for(u32 SizeIndex = 0;
+        SizeIndex < IconSize_Count;
+        ++SizeIndex)
+    {
+        if(State->IconThemeSizeMask & (1u << SizeIndex))
+        {
+            FormatIconThemeFile(State, Path, sizeof(Path), IconSizes[SizeIndex], Item->Id, Version);
+            unlink(Path);
+        }
+    }
+}
+
+// NOTE(trayge): Every frame gets a fresh name so hosts that cache icons by name cannot show a
+// stale one. The previous frame is kept on disk until the next publish, since hosts load the
+// file asynchronously after NewIcon. Only the IconThemeSizeMask sizes are written; this runs on
+// the loop thread every frame, and a 256x256 PNG costs more than all the panel sizes together.
+function void
+PublishIconThemeFrame(trayge_state *State, tray_item *Item)
+{
+    u64 Version = Item->Icon.Version;
+    
+    char Path[512];
+    char LargestPath[512] = {};
+    b32 Written = true;
+    
+    for(u32 SizeIndex = 0;
+        SizeIndex < IconSize_Count;
+        ++SizeIndex)
+    {
+        icon_image *Image = Item->Icon.Images + SizeIndex;
+        if(Image->Bytes && (State->IconThemeSizeMask & (1u << SizeIndex)))
+        {
+            FormatIconThemeFile(State, Path, sizeof(Path), Image->Width, Item->Id, Version);
+            
+            // NOTE(trayge): Dirty is relative to the previous frame, which is only the published
+            // one while every publish has succeeded; after a failure each size is encoded again
+            // until one does.
+            b32 Reused = false;
+            if(Item->IconThemeLinkable && IconRectIsEmpty(Image->Dirty))
+            {
+                char PreviousPath[512];
+                FormatIconThemeFile(State, PreviousPath, sizeof(PreviousPath), Image->Width, Item->Id, Item->PublishedIconVersion);
+                Reused = (link(PreviousPath, Path) == 0);
+            }
+            
+            if(!Reused)
+            {
+                u8 *Encoded = PushSize(&State->TransientArena, PNGEncodedSize(Image->Width, Image->Height));
+                u64 Size = EncodePNG(Encoded, Image->Bytes, Image->Width, Image->Height);
+                Written &= WriteWholeFile(Path, Encoded, Size);
+            }
+            
+            snprintf(LargestPath, sizeof(LargestPath), "%s", Path);
+        }
+    }
+    
+    if(Written && LargestPath[0])
+    {
+        // NOTE(trayge): Some hosts only look for <name>.png directly in IconThemePath.
+        FormatIconThemeFile(State, Path, sizeof(Path), 0, Item->Id, Version);
+        Written = (link(LargestPath, Path) == 0);
+    }
+    
+    if(Written)
+    {
+        if(Item->PreviousIconVersion)
+        {
+            RemoveIconThemeFrame(State, Item, Item->PreviousIconVersion);
+        }
+        Item->PreviousIconVersion = Item->PublishedIconVersion;
+        Item->PublishedIconVersion = Version;
+        Item->IconThemeLinkable = true;
+        
+        snprintf(Item->IconName, sizeof(Item->IconName), "%s-%lu", Item->Id, Version);
+        MarkTrayPropertyChanged(Item, DBusTrayProperty_IconName);
+    }
+    else
+    {
+        RemoveIconThemeFrame(State, Item, Version);
+        Item->IconThemeLinkable = false;
+    }
+}
+
+function b32
+InitIconTheme(trayge_state *State)
+{
+    char *RuntimeDirectory = getenv("XDG_RUNTIME_DIR");
+    if(!RuntimeDirectory || !RuntimeDirectory[0])
+    {
+        RuntimeDirectory = "/tmp";
+    }
+    
+    snprintf(State->IconThemePath, sizeof(State->IconThemePath), "%s/trayge-XXXXXX", RuntimeDirectory);
+    b32 Result = (mkdtemp(State->IconThemePath) != 0);
+    
+    char Path[512];
+    char Index[2048];
+    u64 IndexSize = 0;
+    
+    if(Result)
+    {
+        snprintf(Path, sizeof(Path), "%s/hicolor", State->IconThemePath);
+        Result = (mkdir(Path, 0700) == 0);
+    }
+    
+    u64 SizesAt = 0;
+    if(Result)
+    {
+        IndexSize += (u64)snprintf(Index + IndexSize, sizeof(Index) - IndexSize, "[Icon Theme]\nName=Hicolor\nDirectories=");
+        SizesAt = IndexSize;
+    }
+    
+    for(u32 SizeIndex = 0;
+        Result && SizeIndex < IconSize_Count;
+        ++SizeIndex)
+    {
+        if(State->IconThemeSizeMask & (1u << SizeIndex))
+        {
+            s32 Size = IconSizes[SizeIndex];
+            
+            snprintf(Path, sizeof(Path), "%s/hicolor/%dx%d", State->IconThemePath, Size, Size);
+            Result = (mkdir(Path, 0700) == 0);
+            
+            snprintf(Path, sizeof(Path), "%s/hicolor/%dx%d/apps", State->IconThemePath, Size, Size);
+            Result = Result && (mkdir(Path, 0700) == 0);
+            
+            IndexSize += (u64)snprintf(Index + IndexSize, sizeof(Index) - IndexSize, "%s%dx%d/apps",
+                                       (IndexSize == SizesAt) ? "" : ",", Size, Size);
+        }
+    }
+    
+    if(Result)
+    {
+        IndexSize += (u64)snprintf(Index + IndexSize, sizeof(Index) - IndexSize, "\n");
+        for(u32 SizeIndex = 0;
+            SizeIndex < IconSize_Count;
+            ++SizeIndex)
+        {
+            if(State->IconThemeSizeMask & (1u << SizeIndex))
+            {
+                s32 Size = IconSizes[SizeIndex];
+                IndexSize += (u64)snprintf(Index + IndexSize, sizeof(Index) - IndexSize,
+                                           "\n[%dx%d/apps]\nSize=%d\nType=Fixed\n", Size, Size, Size);
+            }
+        }
+        
+        snprintf(Path, sizeof(Path), "%s/hicolor/index.theme", State->IconThemePath);
+        Result = WriteWholeFile(Path, (u8 *)Index, IndexSize);
+    }
+    
+    return Result;
+}
+
+function void
+RemoveIconTheme(trayge_state *State)
+{
+    char Path[512];
+    
+    for(u32 ItemIndex = 0;
+        ItemIndex < State->ItemCount;
+        ++ItemIndex)
+    {
+        tray_item *Item = State->Items + ItemIndex;
+        RemoveIconThemeFrame(State, Item, Item->PreviousIconVersion);
+        RemoveIconThemeFrame(State, Item, Item->PublishedIconVersion);
+    }
+    
+    for(u32 SizeIndex = 0;
+        SizeIndex < IconSize_Count;
+        ++SizeIndex)
+    {
+        if(State->IconThemeSizeMask & (1u << SizeIndex))
+        {
+            s32 Size = IconSizes[SizeIndex];
+            
+            snprintf(Path, sizeof(Path), "%s/hicolor/%dx%d/apps", State->IconThemePath, Size, Size);
+            rmdir(Path);
+            snprintf(Path, sizeof(Path), "%s/hicolor/%dx%d", State->IconThemePath, Size, Size);
+            rmdir(Path);
+        }
+    }
+    
+    snprintf(Path, sizeof(Path), "%s/hicolor/index.theme", State->IconThemePath);
+    unlink(Path);
+    snprintf(Path, sizeof(Path), "%s/hicolor", State->IconThemePath);
+    rmdir(Path);
+    rmdir(State->IconThemePath);
+}
+
+function void
+NoteTrayItemFrameChanged(trayge_state *State, tray_item *Item)
+{
+    MarkTrayPropertyChanged(Item, DBusTrayProperty_IconPixmap);
+    AtomicAddU64(&State->Stats->Counters[StatsCounter_FramesRendered], 1);
+    
+    if(State->IconNameMode)
+    {
+        PublishIconThemeFrame(State, Item);
+    }
+}
+
+function void
+RenderTrayItemFrames(trayge_state *State)
+{
+    u64 StartTime = GetMonotonicTime();
+    
+    for(u32 ItemIndex = 0;
+        ItemIndex < State->ItemCount;
+        ++ItemIndex)
+    {
+        tray_item *Item = State->Items + ItemIndex;
+        if(Item->Animated)
+        {
+            if(RenderIconCache(&Item->Icon, State->XOffset + (s32)Item->Index*32, State->YOffset))
+            {
+                NoteTrayItemFrameChanged(State, Item);
+            }
+        }
+    }
+    
+    // NOTE(trayge): Inline renders start at the deadline, so they miss when they hold the loop
+    // past the next one.
+    u64 RenderTime = GetMonotonicTime() - StartTime;
+    RecordHistogramValue(&State->Stats->FrameRenderTime, RenderTime);
+    
+    u64 FramesPerSecond = EffectiveFramesPerSecond(&State->Scheduler);
+    if(FramesPerSecond && RenderTime > Billion / FramesPerSecond)
+    {
+        AtomicAddU64(&State->Stats->Counters[StatsCounter_RenderDeadlineMisses], 1);
+    }
+}
+
+//
+// NOTE(trayge): With render threads, the frame for the next tick is rendered while the loop
+// waits for it. Each tick commits the batch started at the previous one and starts the next,
+// so a worker has a whole frame interval to finish. A batch still running at its tick is a
+// deadline miss; it is marked Due and committed the moment its last image is done. Nothing
+// is rendered ahead while the animation is stopped, so the first tick after a start renders
+// its own frame and commits it late.
+//
+
+function void *
+RunRenderWorker(void *Parameter)
+{
+    render_worker *Worker = Parameter;
+    render_pool *Pool = Worker->Pool;
+    
+    u64 Generation = 0;
+    for(;;)
+    {
+        pthread_mutex_lock(&Pool->Mutex);
+        while(Pool->Generation == Generation && !Pool->Quit)
+        {
+            pthread_cond_wait(&Pool->BatchStarted, &Pool->Mutex);
+        }
+        Generation = Pool->Generation;
+        b32 Quit = Pool->Quit;
+        pthread_mutex_unlock(&Pool->Mutex);
+        
+        if(Quit)
+        {
+            break;
+        }
+        
+        u64 StolenCount = 0;
+        for(u32 Offset = 0;
+            Offset < Pool->WorkerCount;
+            ++Offset)
+        {
+            render_queue *Queue = Pool->Queues + (Worker->Index + Offset) % Pool->WorkerCount;
+            
+            u32 JobIndex;
+            while((JobIndex = __atomic_fetch_add(&Queue->Next, 1, __ATOMIC_RELAXED)) < Queue->End)
+            {
+                render_job *Job = Queue->Jobs + JobIndex;
+                RenderIconImage(&Job->Image, Job->XOffset, Job->YOffset);
+                
+                StolenCount += (Offset != 0);
+            }
+        }
+        
+        if(StolenCount)
+        {
+            AtomicAddU64(&Pool->Stats->Counters[StatsCounter_RenderJobsStolen], StolenCount);
+        }
+        
+        AtomicMaxU64(&Pool->EndTime, GetMonotonicTime());
+        if(__atomic_sub_fetch(&Pool->BusyWorkers, 1, __ATOMIC_ACQ_REL) == 0)
+        {
+            u64 One = 1;
+            ssize_t Written = write(Pool->Source.FileHandle, &One, sizeof(One));
+            (void)Written;
+        }
+    }
+    
+    return 0;
+}
+
+function b32
+RenderBatchIsDone(render_pool *Pool)
+{
+    b32 Result = (__atomic_load_n(&Pool->BusyWorkers, __ATOMIC_ACQUIRE) == 0);
+    return Result;
+}
+
+function void
+StartRenderBatch(trayge_state *State, u64 AnimationStep)
+{
+    render_pool *Pool = State->RenderPool;
+    Assert(!Pool->InFlight);
+    
+    s32 XOffset = (s32)AnimationStep;
+    s32 YOffset = (s32)(AnimationStep*2);
+    
+    for(u32 QueueIndex = 0;
+        QueueIndex < Pool->WorkerCount;
+        ++QueueIndex)
+    {
+        Pool->Queues[QueueIndex].End = 0;
+    }
+    
+    for(u32 ItemIndex = 0;
+        ItemIndex < State->ItemCount;
+        ++ItemIndex)
+    {
+        tray_item *Item = State->Items + ItemIndex;
+        Pool->Frames[ItemIndex] = Item->Animated ? AcquireIconFrame(&State->FramePool) : 0;
+    }
+    
+    // NOTE(trayge): Largest sizes go out first and round robin, so the expensive images are
+    // spread over the workers before stealing has to even anything out.
+    u32 JobCount = 0;
+    for(s32 SizeIndex = IconSize_Count - 1;
+        SizeIndex >= 0;
+        --SizeIndex)
+    {
+        if(State->IconSizeMask & (1u << SizeIndex))
+        {
+            for(u32 ItemIndex = 0;
+                ItemIndex < State->ItemCount;
+                ++ItemIndex)
+            {
+                icon_frame *Frame = Pool->Frames[ItemIndex];
+                if(Frame)
+                {
+                    render_queue *Queue = Pool->Queues + JobCount++ % Pool->WorkerCount;
+                    Assert(Queue->End < Pool->QueueCapacity);
+                    
+                    render_job *Job = Queue->Jobs + Queue->End++;
+                    Job->Image = (icon_image){};
+                    Job->Image.Width = IconSizes[SizeIndex];
+                    Job->Image.Height = IconSizes[SizeIndex];
+                    Job->Image.Bytes = Frame->Bytes + IconImageOffset(State->IconSizeMask, (u32)SizeIndex);
+                    Job->XOffset = XOffset + (s32)ItemIndex*32;
+                    Job->YOffset = YOffset;
+                }
+            }
+        }
+    }
+    
+    Pool->InFlight = true;
+    Pool->Due = false;
+    Pool->AnimationStep = AnimationStep;
+    Pool->StartTime = GetMonotonicTime();
+    Pool->EndTime = Pool->StartTime;
+    
+    pthread_mutex_lock(&Pool->Mutex);
+    for(u32 QueueIndex = 0;
+        QueueIndex < Pool->WorkerCount;
+        ++QueueIndex)
+    {
+        __atomic_store_n(&Pool->Queues[QueueIndex].Next, 0, __ATOMIC_RELAXED);
+    }
+    Pool->BusyWorkers = Pool->WorkerCount;
+    ++Pool->Generation;
+    pthread_cond_broadcast(&Pool->BatchStarted);
+    pthread_mutex_unlock(&Pool->Mutex);
+}
+
+function void
+StartNextRenderBatch(trayge_state *State)
+{
+    frame_scheduler *Scheduler = &State->Scheduler;
+    if(Scheduler->Animated && TimerIsScheduled(&Scheduler->Timer))
+    {
+        u64 Deadline = Scheduler->Timer.Deadline;
+        StartRenderBatch(State, (Deadline - Scheduler->StartTime)*AnimationStepsPerSecond / Billion);
+    }
+}
+
+function void
+CommitRenderBatch(trayge_state *State)
+{
+    render_pool *Pool = State->RenderPool;
+    Assert(Pool->InFlight && RenderBatchIsDone(Pool));
+    
+    for(u32 ItemIndex = 0;
+        ItemIndex < State->ItemCount;
+        ++ItemIndex)
+    {
+        tray_item *Item = State->Items + ItemIndex;
+        icon_frame *Frame = Pool->Frames[ItemIndex];
+        
+        if(Frame && Item->Animated)
+        {
+            if(CommitIconFrame(&Item->Icon, Frame))
+            {
+                NoteTrayItemFrameChanged(State, Item);
+            }
+        }
+        else
+        {
+            ReleaseIconFrame(&State->FramePool, Frame);
+        }
+        
+        Pool->Frames[ItemIndex] = 0;
+    }
+    
+    State->XOffset = (s32)Pool->AnimationStep;
+    State->YOffset = (s32)(Pool->AnimationStep*2);
+    
+    RecordHistogramValue(&State->Stats->FrameRenderTime, AtomicLoadU64(&Pool->EndTime) - Pool->StartTime);
+    
+    Pool->InFlight = false;
+    Pool->Due = false;
+    
+    StartNextRenderBatch(State);
+}
+
+function void
+ReleaseRenderBatchFrames(trayge_state *State)
+{
+    render_pool *Pool = State->RenderPool;
+    
+    for(u32 ItemIndex = 0;
+        ItemIndex < State->ItemCount;
+        ++ItemIndex)
+    {
+        ReleaseIconFrame(&State->FramePool, Pool->Frames[ItemIndex]);
+        Pool->Frames[ItemIndex] = 0;
+    }
+}
+
+// NOTE(trayge): A batch rendered ahead is for the step the frame timer was going to reach. A
+// lock, a host coming back or a rate change moves the timer after the batch went out, and then
+// the step it holds is not the one being shown: its frames go back and the current step is
+// rendered instead.
+function void
+FinishRenderBatch(trayge_state *State)
+{
+    render_pool *Pool = State->RenderPool;
+    u64 AnimationStep = State->Scheduler.AnimationStep;
+    
+    if(Pool->AnimationStep == AnimationStep)
+    {
+        CommitRenderBatch(State);
+    }
+    else
+    {
+        ReleaseRenderBatchFrames(State);
+        Pool->InFlight = false;
+        
+        StartRenderBatch(State, AnimationStep);
+        Pool->Due = true;
+    }
+}
+
+// NOTE(trayge): Called at a frame tick that produced a new animation step.
+function void
+TickRenderPool(trayge_state *State)
+{
+    render_pool *Pool = State->RenderPool;
+    
+    if(!Pool->InFlight)
+    {
+        StartRenderBatch(State, State->Scheduler.AnimationStep);
+        Pool->Due = true;
+    }
+    else if(RenderBatchIsDone(Pool))
+    {
+        FinishRenderBatch(State);
+    }
+    else
+    {
+        AtomicAddU64(&State->Stats->Counters[StatsCounter_RenderDeadlineMisses], 1);
+        Pool->Due = true;
+    }
+}
+
+function void
+HandleRenderDone(trayge_state *State)
+{
+    render_pool *Pool = State->RenderPool;
+    
+    if(Pool->InFlight && Pool->Due && RenderBatchIsDone(Pool))
+    {
+        FinishRenderBatch(State);
+    }
+}
+
+function b32
+InitRenderPool(trayge_state *State, u32 WorkerCount)
+{
+    render_pool *Pool = PushStructAligned(&State->PermanentArena, render_pool);
+    Pool->Stats = State->Stats;
+    Pool->WorkerCount = (WorkerCount < RenderWorkerMax) ? WorkerCount : RenderWorkerMax;
+    Pool->Frames = PushArray(&State->PermanentArena, icon_frame *, State->ItemCount);
+    
+    u32 JobCount = State->ItemCount*IconSize_Count;
+    Pool->QueueCapacity = (JobCount + Pool->WorkerCount - 1) / Pool->WorkerCount;
+    for(u32 QueueIndex = 0;
+        QueueIndex < Pool->WorkerCount;
+        ++QueueIndex)
+    {
+        Pool->Queues[QueueIndex].Jobs = PushArray(&State->PermanentArena, render_job, Pool->QueueCapacity);
+    }
+    
+    Pool->Source.Type = EventSource_RenderDone;
+    Pool->Source.FileHandle = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    RegisterEventSource(State, &Pool->Source, EPOLLIN);
+    
+    pthread_mutex_init(&Pool->Mutex, 0);
+    pthread_cond_init(&Pool->BatchStarted, 0);
+    
+    State->RenderPool = Pool;
+    
+    b32 Result = true;
+    for(u32 WorkerIndex = 0;
+        WorkerIndex < Pool->WorkerCount;
+        ++WorkerIndex)
+    {
+        render_worker *Worker = Pool->Workers + WorkerIndex;
+        Worker->Pool = Pool;
+        Worker->Index = WorkerIndex;
+        
+        if(pthread_create(&Worker->Thread, 0, RunRenderWorker, Worker) != 0)
+        {
+            Pool->WorkerCount = WorkerIndex;
+            Result = false;
+            break;
+        }
+    }
+    
+    return Result;
+}
+
+// NOTE(trayge): A few items render inline faster than the pool hands them out, and workers
+// without a core of their own only add switches, so the pool is opt-in below that.
+function u32
+DefaultRenderThreadCount(u32 ItemCount)
+{
+    u32 Result = 0;
+    
+    s64 CoreCount = sysconf(_SC_NPROCESSORS_ONLN);
+    if(ItemCount >= RenderPoolMinItems && CoreCount > 1)
+    {
+        Result = (CoreCount - 1 < RenderWorkerMax) ? (u32)(CoreCount - 1) : RenderWorkerMax;
+    }
+    
+    return Result;
+}
+
+// NOTE(trayge): Waits for the batch in flight, if any, and gives its frames back.
+function void
+StopRenderPool(trayge_state *State)
+{
+    render_pool *Pool = State->RenderPool;
+    
+    pthread_mutex_lock(&Pool->Mutex);
+    Pool->Quit = true;
+    pthread_cond_broadcast(&Pool->BatchStarted);
+    pthread_mutex_unlock(&Pool->Mutex);
+    
+    for(u32 WorkerIndex = 0;
+        WorkerIndex < Pool->WorkerCount;
+        ++WorkerIndex)
+    {
+        pthread_join(Pool->Workers[WorkerIndex].Thread, 0);
+    }
+    
+    ReleaseRenderBatchFrames(State);
+    
+    close(Pool->Source.FileHandle);
+    pthread_cond_destroy(&Pool->BatchStarted);
+    pthread_mutex_destroy(&Pool->Mutex);
+    
+    State->RenderPool = 0;
+}
+
+//
+// NOTE(trayge): Embedded instances get their frames and strings from the application through
+// State->Submissions; the library checks item indices before anything is queued. Frames come
+// from our own pool: the loop lends empty ones out ahead of time, the application fills every
+// size and hands them back, and committing one is the same diff-and-swap a built-in render
+// does, without copying the pixels again.
+//
+
+function void
+PublishFrameDemand(trayge_state *State)
+{
+    if(State->Submissions)
+    {
+        b32 WantsFrames = (State->HostPresent && State->Scheduler.Session != Session_Locked);
+        __atomic_store_n(&State->Submissions->WantsFrames, WantsFrames, __ATOMIC_RELAXED);
+    }
+}
+
+function void
+LendFreeFrames(trayge_state *State)
+{
+    submission_queue *Queue = State->Submissions;
+    
+    while(Queue->LentFrameCount < LentFrameBudget)
+    {
+        icon_frame *Frame = AcquireIconFrame(&State->FramePool);
+        if(!Frame)
+        {
+            break;
+        }
+        
+        RingPush(&Queue->FreeFrames, &Frame, 0);
+        ++Queue->LentFrameCount;
+    }
+}
+
+function void
+ProcessSubmissions(trayge_state *State)
+{
+    submission_queue *Queue = State->Submissions;
+    
+    submission Submission;
+    while(RingPop(&Queue->Submissions, &Submission))
+    {
+        tray_item *Item = State->Items + Submission.ItemIndex;
+        
+        switch(Submission.Type)
+        {
+            case Submission_Frame:
+            {
+                --Queue->LentFrameCount;
+                
+                if(CommitIconFrame(&Item->Icon, Submission.Frame))
+                {
+                    NoteTrayItemFrameChanged(State, Item);
+                }
+            } break;
+            
+            case Submission_String:
+            {
+                ApplyTrayString(Item, Submission.String, Submission.Value);
+            } break;
+            
+            case Submission_Quit:
+            {
+                State->Running = false;
+            } break;
+            
+            InvalidDefaultCase;
+        }
+    }
+    
+    LendFreeFrames(State);
+}
+
+// NOTE(trayge): Embedded items have no demo entries, but the frames, status and lifetime belong
+// to the application there, so nothing arriving from the bus may change them either way.
+function void
+ActivateTrayMenuItem(trayge_state *State, tray_item *Item, s32 Id)
+{
+    menu_tree *Menu = &Item->Menu;
+    menu_node *Node = Menu->Nodes + Id;
+    
+    u32 Action = State->Embedded ? TrayMenuAction_None : Node->Action;
+    switch(Action)
+    {
+        case TrayMenuAction_Animate:
+        {
+            Item->Animated = !Item->Animated;
+            UpdateFrameSchedulerAnimation(State);
+            
+            SetMenuToggle(Menu, Id, MenuToggle_Checkmark, Item->Animated ? 1 : 0);
+        } break;
+        
+        case TrayMenuAction_Attention:
+        {
+            b32 NeedsAttention = (Node->ToggleState != 1);
+            SetTrayString(Item, DBusTrayProperty_Status, &Item->Status, NeedsAttention ? "NeedsAttention" : "Active");
+            
+            SetMenuToggle(Menu, Id, MenuToggle_Checkmark, NeedsAttention ? 1 : 0);
+        } break;
+        
+        case TrayMenuAction_Quit:
+        {
+            State->Running = false;
+        } break;
+    }
+}
+
+// NOTE(trayge): The demo entries drive trayge's own renderer and its loop, so an embedded item
+// publishes an empty menu instead.
+function void
+InitTrayMenu(tray_item *Item, trayge_options *Options)
+{
+    menu_tree *Menu = &Item->Menu;
+    InitMenuTree(Menu);
+    
+    if(!Options->Embedded)
+    {
+        Item->AnimateMenuItem = AddMenuItem(Menu, 0, MenuItem_Standard, "Animate", TrayMenuAction_Animate);
+        SetMenuToggle(Menu, Item->AnimateMenuItem, MenuToggle_Checkmark, Item->Animated ? 1 : 0);
+        
+        Item->AttentionMenuItem = AddMenuItem(Menu, 0, MenuItem_Standard, "Needs Attention", TrayMenuAction_Attention);
+        SetMenuToggle(Menu, Item->AttentionMenuItem, MenuToggle_Checkmark, 0);
+        
+        if(Options->MenuChurnCount)
+        {
+            Item->RecentMenuItem = AddMenuItem(Menu, 0, MenuItem_Standard, "Recent", TrayMenuAction_None);
+        }
+        
+        AddMenuItem(Menu, 0, MenuItem_Separator, 0, TrayMenuAction_None);
+        AddMenuItem(Menu, 0, MenuItem_Standard, "Quit", TrayMenuAction_Quit);
+    }
+    
+    Menu->LayoutDirty = false;
+    Menu->SignalledRevision = Menu->Revision;
+    Menu->FirstDirty = -1;
+    for(u32 Id = 0;
+        Id < Menu->Count;
+        ++Id)
+    {
+        Menu->Nodes[Id].DirtyProperties = 0;
+    }
+}
+
+// NOTE(trayge): Stands in for menus with many dynamic entries. Each frame the Recent submenu
+// gains an entry and, once full, loses its oldest along with anything below it; every fourth
+// entry has a child of its own and every other one starts disabled. The submenu is relabelled
+// and the oldest entries flip enabled and visible, so hosts see layout revisions and property
+// deltas together every frame.
+function void
+ChurnTrayMenu(trayge_state *State, tray_item *Item)
+{
+    menu_tree *Menu = &Item->Menu;
+    s32 Recent = Item->RecentMenuItem;
+    u64 Step = Item->MenuChurnStep++;
+    
+    u32 EntryCount = 0;
+    for(s32 Child = Menu->Nodes[Recent].FirstChild;
+        Child >= 0;
+        Child = Menu->Nodes[Child].NextSibling)
+    {
+        ++EntryCount;
+    }
+    
+    if(EntryCount >= State->MenuChurnCount)
+    {
+        RemoveMenuItem(Menu, Menu->Nodes[Recent].FirstChild);
+    }
+    
+    char Label[64];
+    snprintf(Label, sizeof(Label), "Entry %lu", Step);
+    s32 Entry = AddMenuItem(Menu, Recent, MenuItem_Standard, Label, TrayMenuAction_None);
+    if(Entry >= 0 && Step % 4 == 0)
+    {
+        snprintf(Label, sizeof(Label), "Details for %lu", Step);
+        AddMenuItem(Menu, Entry, MenuItem_Standard, Label, TrayMenuAction_None);
+    }
+    SetMenuEnabled(Menu, Entry, (Step & 1) == 0);
+    
+    snprintf(Label, sizeof(Label), "Recent (%lu)", Step + 1);
+    SetMenuLabel(Menu, Recent, Label);
+    
+    s32 Oldest = Menu->Nodes[Recent].FirstChild;
+    SetMenuEnabled(Menu, Oldest, (Step & 1) == 0);
+    if(Oldest >= 0)
+    {
+        SetMenuVisible(Menu, Menu->Nodes[Oldest].NextSibling, (Step & 2) == 0);
+    }
+}
+
+function hashed_string
+ReadStringArgument(DBusMessageIter *Args)
+{
+    char *Value = 0;
+    
+    if(dbus_message_iter_get_arg_type(Args) == DBUS_TYPE_STRING)
+    {
+        dbus_message_iter_get_basic(Args, &Value);
+        dbus_message_iter_next(Args);
+    }
+    
+    hashed_string Result = StrHashed(Value);
+    return Result;
+}
+
+// NOTE(trayge): PixmapSizeMask limits the IconPixmap sizes; IconSizeAll sends every cached one.
+function void
+AppendTrayProperties(tray_item *Item, u32 PixmapSizeMask, DBusMessageIter *Parent)
+{
+    DBusMessageIter PropertiesArray = {};
+    DeferLoop(dbus_message_iter_open_container(Parent, DBUS_TYPE_ARRAY, "{sv}", &PropertiesArray),
+              dbus_message_iter_close_container(Parent, &PropertiesArray))
+    {
+        DBusMessageIter PropertyEntry = {};
+        
+        for(u32 PropertyIndex = DBusTrayProperty_Unhandled + 1;
+            PropertyIndex < DBusTrayProperty_Count;
+            ++PropertyIndex)
+        {
+            DeferLoop(dbus_message_iter_open_container(&PropertiesArray, DBUS_TYPE_DICT_ENTRY, 0, &PropertyEntry),
+                      dbus_message_iter_close_container(&PropertiesArray, &PropertyEntry))
+            {
+                AppendString(&PropertyEntry, TrayProperties[PropertyIndex].Name);
+                if(PropertyIndex == DBusTrayProperty_IconPixmap && PixmapSizeMask != IconSizeAll)
+                {
+                    AppendIconPixmapVariant(Item, PixmapSizeMask, &PropertyEntry);
+                }
+                else
+                {
+                    AppendTrayPropertyVariant(Item, PropertyIndex, &PropertyEntry);
+                }
+            }
+        }
+    }
+}
+
+function DBusMessage *
+GetCachedGetAllReply(trayge_state *State, tray_item *Item)
+{
+    reply_cache *Cache = &Item->GetAllReply;
+    
+    b32 IsValid = (Cache->Template != 0);
+    for(u32 PropertyIndex = 0;
+        IsValid && PropertyIndex < DBusTrayProperty_Count;
+        ++PropertyIndex)
+    {
+        IsValid = (Cache->Versions[PropertyIndex] == Item->PropertyVersions[PropertyIndex]);
+    }
+    
+    if(!IsValid)
+    {
+        if(Cache->Template)
+        {
+            dbus_message_unref(Cache->Template);
+        }
+        
+        Cache->Template = dbus_message_new(DBUS_MESSAGE_TYPE_METHOD_RETURN);
+        
+        DBusMessageIter TemplateArgs = {};
+        dbus_message_iter_init_append(Cache->Template, &TemplateArgs);
+        AppendTrayProperties(Item, IconSizeAll, &TemplateArgs);
+        Cache->Size = MarshalledMessageSize(State, Cache->Template);
+        
+        for(u32 PropertyIndex = 0;
+            PropertyIndex < DBusTrayProperty_Count;
+            ++PropertyIndex)
+        {
+            Cache->Versions[PropertyIndex] = Item->PropertyVersions[PropertyIndex];
+        }
+    }
+    
+    return Cache->Template;
+}
+
+function DBusMessage *
+GetCachedPropertyReply(trayge_state *State, tray_item *Item, dbus_tray_property_type Type)
+{
+    property_reply_cache *Cache = Item->PropertyReplies + Type;
+    
+    if(!Cache->Template || Cache->Version != Item->PropertyVersions[Type])
+    {
+        if(Cache->Template)
+        {
+            dbus_message_unref(Cache->Template);
+        }
+        
+        // NOTE(trayge): The template pins the frame it was marshalled from, so the pixels a
+        // reply describes stay identifiable until the next version replaces it.
+        ReleaseIconFrame(Item->Icon.Pool, Cache->Frame);
+        Cache->Frame = 0;
+        if(Type == DBusTrayProperty_IconPixmap)
+        {
+            Cache->Frame = RetainIconFrame(Item->Icon.Frame);
+        }
+        
+        Cache->Template = dbus_message_new(DBUS_MESSAGE_TYPE_METHOD_RETURN);
+        
+        DBusMessageIter TemplateArgs = {};
+        dbus_message_iter_init_append(Cache->Template, &TemplateArgs);
+        AppendTrayPropertyVariant(Item, Type, &TemplateArgs);
+        Cache->Size = MarshalledMessageSize(State, Cache->Template);
+        
+        Cache->Version = Item->PropertyVersions[Type];
+    }
+    
+    return Cache->Template;
+}
+
+function DBusMessage *
+CopyReply(DBusMessage *Template, DBusMessage *Message)
+{
+    DBusMessage *Result = dbus_message_copy(Template);
+    
+    dbus_message_set_reply_serial(Result, dbus_message_get_serial(Message));
+    
+    const char *Sender = dbus_message_get_sender(Message);
+    if(Sender)
+    {
+        dbus_message_set_destination(Result, Sender);
+    }
+    
+    return Result;
+}
+
+// NOTE(trayge): Fetches deferred by the skip policy are answered with the newest frame as the
+// consumer's queue drains, and only as many as fit under its limit, so the frames in between
+// are never sent to it.
+function void
+ResumeDeferredFetches(trayge_state *State)
+{
+    for(u32 ConsumerIndex = 0;
+        ConsumerIndex < MaxConsumers;
+        ++ConsumerIndex)
+    {
+        consumer *Consumer = State->Consumers + ConsumerIndex;
+        
+        u32 AnsweredCount = 0;
+        while(AnsweredCount < Consumer->DeferredCount && !ConsumerIsBackedUp(State, Consumer))
+        {
+            deferred_fetch *Fetch = Consumer->Deferred + AnsweredCount++;
+            
+            DBusMessage *Response = 0;
+            u64 ResponseSize = 0;
+            if(Fetch->GetAll)
+            {
+                Response = CopyReply(GetCachedGetAllReply(State, Fetch->Item), Fetch->Message);
+                ResponseSize = Fetch->Item->GetAllReply.Size;
+            }
+            else
+            {
+                Response = CopyReply(GetCachedPropertyReply(State, Fetch->Item, DBusTrayProperty_IconPixmap), Fetch->Message);
+                ResponseSize = Fetch->Item->PropertyReplies[DBusTrayProperty_IconPixmap].Size;
+            }
+            
+            SendMessage(State, Response, ResponseSize);
+            dbus_message_unref(Response);
+            dbus_message_unref(Fetch->Message);
+        }
+        
+        if(AnsweredCount)
+        {
+            Consumer->DeferredCount -= AnsweredCount;
+            for(u32 FetchIndex = 0;
+                FetchIndex < Consumer->DeferredCount;
+                ++FetchIndex)
+            {
+                Consumer->Deferred[FetchIndex] = Consumer->Deferred[FetchIndex + AnsweredCount];
+            }
+        }
+    }
+}
+
+function tray_item *
+LookupTrayItem(trayge_state *State, const char *PathRaw)
+{
+    tray_item *Result = 0;
+    
+    string Path = Str(PathRaw);
+    string Suffix = {};
+    
+    b32 Matched = false;
+    if(StringHasPrefix(Path, StrLit("/StatusNotifierItem")))
+    {
+        Suffix = StringSkip(Path, sizeof("/StatusNotifierItem") - 1);
+        Matched = true;
+    }
+    else if(StringHasPrefix(Path, StrLit("/MenuBar")))
+    {
+        Suffix = StringSkip(Path, sizeof("/MenuBar") - 1);
+        Matched = true;
+    }
+    
+    u64 Index = 0;
+    if(Matched && (Suffix.Size == 0 || (Suffix.Data[0] == '/' && ParseU64(StringSkip(Suffix, 1), &Index))))
+    {
+        if(Index < State->ItemCount)
+        {
+            Result = State->Items + Index;
+        }
+    }
+    
+    return Result;
+}
+
+global char *StatsCounterKeys[StatsCounter_Count] =
+{
+#define X(Name, Key) Key,
+    StatsCounterList(X)
+#undef X
+};
+
+function void
+UpdateWakeupRate(trayge_stats *Stats, u64 Now)
+{
+    u64 Elapsed = Now - Stats->RateTime;
+    if(Elapsed >= Billion)
+    {
+        u64 Wakeups = AtomicLoadU64(&Stats->Counters[StatsCounter_Wakeups]);
+        Stats->WakeupsPerSecond = (f64)(Wakeups - Stats->RateWakeups)*Billion / (f64)Elapsed;
+        Stats->RateWakeups = Wakeups;
+        Stats->RateTime = Now;
+    }
+}
+
+function void
+DumpStats(trayge_state *State, FILE *File)
+{
+    trayge_stats *Stats = State->Stats;
+    
+    fprintf(File, "uptime %.3fs, %.1f wakeups/s\n",
+            (f64)(GetMonotonicTime() - Stats->StartTime) / Billion, Stats->WakeupsPerSecond);
+    
+    for(u32 CounterIndex = 0;
+        CounterIndex < StatsCounter_Count;
+        ++CounterIndex)
+    {
+        fprintf(File, "  %-20s %lu\n", StatsCounterKeys[CounterIndex], AtomicLoadU64(&Stats->Counters[CounterIndex]));
+    }
+    
+    fprintf(File, "%-48s %8s %10s %10s %10s %10s\n", "method", "calls", "p50 us", "p90 us", "p99 us", "max us");
+    for(u32 MethodIndex = 0;
+        MethodIndex < DBusMethod_Count;
+        ++MethodIndex)
+    {
+        stats_histogram *Histogram = Stats->MethodLatency + MethodIndex;
+        u64 Count = AtomicLoadU64(&Histogram->Count);
+        if(Count)
+        {
+            char Name[128];
+            if(MethodIndex == DBusMethod_Unhandled)
+            {
+                snprintf(Name, sizeof(Name), "(unhandled)");
+            }
+            else
+            {
+                snprintf(Name, sizeof(Name), "%s.%s", DBusMethods[MethodIndex].Interface, DBusMethods[MethodIndex].Member);
+            }
+            
+            fprintf(File, "%-48s %8lu %10.1f %10.1f %10.1f %10.1f\n", Name, Count,
+                    (f64)HistogramPercentile(Histogram, 0.5) / 1000.0,
+                    (f64)HistogramPercentile(Histogram, 0.9) / 1000.0,
+                    (f64)HistogramPercentile(Histogram, 0.99) / 1000.0,
+                    (f64)AtomicLoadU64(&Histogram->Max) / 1000.0);
+        }
+    }
+    
+    stats_histogram *RenderTime = &Stats->FrameRenderTime;
+    if(AtomicLoadU64(&RenderTime->Count))
+    {
+        fprintf(File, "%-48s %8lu %10.1f %10.1f %10.1f %10.1f\n", "(frame render)", AtomicLoadU64(&RenderTime->Count),
+                (f64)HistogramPercentile(RenderTime, 0.5) / 1000.0,
+                (f64)HistogramPercentile(RenderTime, 0.9) / 1000.0,
+                (f64)HistogramPercentile(RenderTime, 0.99) / 1000.0,
+                (f64)AtomicLoadU64(&RenderTime->Max) / 1000.0);
+    }
+    
+    for(u32 ItemIndex = 0;
+        ItemIndex < State->ItemCount;
+        ++ItemIndex)
+    {
+        icon_cache *Icon = &State->Items[ItemIndex].Icon;
+        fprintf(File, "%s: %lu frames, %lu unchanged, dirty ratio %.3f\n", State->Items[ItemIndex].Id,
+                Icon->FrameCount, Icon->UnchangedFrameCount, IconCacheDirtyRatio(Icon));
+    }
+    
+    for(u32 ConsumerIndex = 0;
+        ConsumerIndex < MaxConsumers;
+        ++ConsumerIndex)
+    {
+        consumer *Consumer = State->Consumers + ConsumerIndex;
+        if(Consumer->Name[0])
+        {
+            fprintf(File, "%s: %lu bytes queued, peak %lu, %lu throttled, %u deferred\n", Consumer->Name,
+                    Consumer->QueuedBytes, Consumer->PeakQueuedBytes, Consumer->ThrottledCount, Consumer->DeferredCount);
+        }
+    }
+    
+    fprintf(File, "permanent arena %lu bytes, transient arena peak %lu bytes, %u icon frames\n",
+            State->PermanentArena.UsedSize, State->TransientArena.PeakUsedSize, State->FramePool.AllocatedCount);
+    fflush(File);
+}
+
+function void
+AppendStatsEntry(DBusMessageIter *Array, char *Key, s32 Type, char *Signature, void *Value)
+{
+    DBusMessageIter Entry = {};
+    DeferLoop(dbus_message_iter_open_container(Array, DBUS_TYPE_DICT_ENTRY, 0, &Entry),
+              dbus_message_iter_close_container(Array, &Entry))
+    {
+        AppendString(&Entry, Key);
+        
+        DBusMessageIter Variant = {};
+        DeferLoop(dbus_message_iter_open_container(&Entry, DBUS_TYPE_VARIANT, Signature, &Variant),
+                  dbus_message_iter_close_container(&Entry, &Variant))
+        {
+            dbus_message_iter_append_basic(&Variant, Type, Value);
+        }
+    }
+}
+
+function void
+AppendStats(trayge_state *State, DBusMessageIter *Parent)
+{
+    trayge_stats *Stats = State->Stats;
+    
+    DBusMessageIter StatsArray = {};
+    DeferLoop(dbus_message_iter_open_container(Parent, DBUS_TYPE_ARRAY, "{sv}", &StatsArray),
+              dbus_message_iter_close_container(Parent, &StatsArray))
+    {
+        for(u32 CounterIndex = 0;
+            CounterIndex < StatsCounter_Count;
+            ++CounterIndex)
+        {
+            u64 Value = AtomicLoadU64(&Stats->Counters[CounterIndex]);
+            AppendStatsEntry(&StatsArray, StatsCounterKeys[CounterIndex], DBUS_TYPE_UINT64, "t", &Value);
+        }
+        
+        f64 Uptime = (f64)(GetMonotonicTime() - Stats->StartTime) / Billion;
+        AppendStatsEntry(&StatsArray, "uptime_seconds", DBUS_TYPE_DOUBLE, "d", &Uptime);
+        AppendStatsEntry(&StatsArray, "wakeups_per_second", DBUS_TYPE_DOUBLE, "d", &Stats->WakeupsPerSecond);
+        AppendStatsEntry(&StatsArray, "permanent_arena_bytes", DBUS_TYPE_UINT64, "t", &State->PermanentArena.UsedSize);
+        AppendStatsEntry(&StatsArray, "transient_arena_peak_bytes", DBUS_TYPE_UINT64, "t", &State->TransientArena.PeakUsedSize);
+        
+        u64 FrameCount = State->FramePool.AllocatedCount;
+        AppendStatsEntry(&StatsArray, "icon_frames", DBUS_TYPE_UINT64, "t", &FrameCount);
+        
+        stats_histogram *RenderTime = &Stats->FrameRenderTime;
+        u64 RenderP50 = HistogramPercentile(RenderTime, 0.5);
+        u64 RenderP99 = HistogramPercentile(RenderTime, 0.99);
+        u64 RenderMax = AtomicLoadU64(&RenderTime->Max);
+        AppendStatsEntry(&StatsArray, "frame_render_p50_ns", DBUS_TYPE_UINT64, "t", &RenderP50);
+        AppendStatsEntry(&StatsArray, "frame_render_p99_ns", DBUS_TYPE_UINT64, "t", &RenderP99);
+        AppendStatsEntry(&StatsArray, "frame_render_max_ns", DBUS_TYPE_UINT64, "t", &RenderMax);
+        
+        u64 RenderThreadCount = State->RenderPool ? State->RenderPool->WorkerCount : 0;
+        AppendStatsEntry(&StatsArray, "render_threads", DBUS_TYPE_UINT64, "t", &RenderThreadCount);
+        
+        // NOTE(trayge): One (id, frames, unchanged_frames, dirty_ratio) struct per item.
+        DBusMessageIter ItemsEntry = {};
+        DeferLoop(dbus_message_iter_open_container(&StatsArray, DBUS_TYPE_DICT_ENTRY, 0, &ItemsEntry),
+                  dbus_message_iter_close_container(&StatsArray, &ItemsEntry))
+        {
+            AppendString(&ItemsEntry, "items");
+            
+            DBusMessageIter Variant = {};
+            DeferLoop(dbus_message_iter_open_container(&ItemsEntry, DBUS_TYPE_VARIANT, "a(sttd)", &Variant),
+                      dbus_message_iter_close_container(&ItemsEntry, &Variant))
+            {
+                DBusMessageIter ItemsArray = {};
+                DeferLoop(dbus_message_iter_open_container(&Variant, DBUS_TYPE_ARRAY, "(sttd)", &ItemsArray),
+                          dbus_message_iter_close_container(&Variant, &ItemsArray))
+                {
+                    for(u32 ItemIndex = 0;
+                        ItemIndex < State->ItemCount;
+                        ++ItemIndex)
+                    {
+                        tray_item *Item = State->Items + ItemIndex;
+                        icon_cache *Icon = &Item->Icon;
+                        f64 DirtyRatio = IconCacheDirtyRatio(Icon);
+                        
+                        DBusMessageIter ItemStruct = {};
+                        DeferLoop(dbus_message_iter_open_container(&ItemsArray, DBUS_TYPE_STRUCT, 0, &ItemStruct),
+                                  dbus_message_iter_close_container(&ItemsArray, &ItemStruct))
+                        {
+                            AppendString(&ItemStruct, Item->Id);
+                            dbus_message_iter_append_basic(&ItemStruct, DBUS_TYPE_UINT64, &Icon->FrameCount);
+                            dbus_message_iter_append_basic(&ItemStruct, DBUS_TYPE_UINT64, &Icon->UnchangedFrameCount);
+                            dbus_message_iter_append_basic(&ItemStruct, DBUS_TYPE_DOUBLE, &DirtyRatio);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+function void
+AppendMethodStats(trayge_stats *Stats, DBusMessageIter *Parent)
+{
+    DBusMessageIter MethodsArray = {};
+    DeferLoop(dbus_message_iter_open_container(Parent, DBUS_TYPE_ARRAY, "(ssttttt)", &MethodsArray),
+              dbus_message_iter_close_container(Parent, &MethodsArray))
+    {
+        for(u32 MethodIndex = 0;
+            MethodIndex < DBusMethod_Count;
+            ++MethodIndex)
+        {
+            stats_histogram *Histogram = Stats->MethodLatency + MethodIndex;
+            
+            u64 Values[5] =
+            {
+                AtomicLoadU64(&Histogram->Count),
+                HistogramPercentile(Histogram, 0.5),
+                HistogramPercentile(Histogram, 0.9),
+                HistogramPercentile(Histogram, 0.99),
+                AtomicLoadU64(&Histogram->Max),
+            };
+            
+            if(Values[0])
+            {
+                DBusMessageIter MethodEntry = {};
+                DeferLoop(dbus_message_iter_open_container(&MethodsArray, DBUS_TYPE_STRUCT, 0, &MethodEntry),
+                          dbus_message_iter_close_container(&MethodsArray, &MethodEntry))
+                {
+                    AppendString(&MethodEntry, DBusMethods[MethodIndex].Interface ? DBusMethods[MethodIndex].Interface : "");
+                    AppendString(&MethodEntry, DBusMethods[MethodIndex].Member ? DBusMethods[MethodIndex].Member : "");
+                    for(u32 ValueIndex = 0;
+                        ValueIndex < ArrayCount(Values);
+                        ++ValueIndex)
+                    {
+                        dbus_message_iter_append_basic(&MethodEntry, DBUS_TYPE_UINT64, Values + ValueIndex);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// NOTE(trayge): Recording marshals every inbound message a second time, so it is only worth
+// its cost while a trace is being taken. The reply size is whatever the handler sent, and the
+// handler time stops before that marshal so recording does not inflate it.
+function void
+RecordTraceMessage(trayge_state *State, DBusMessage *Message, u64 StartTime, u64 ReplySize)
+{
+    u64 EndTime = GetMonotonicTime();
+    
+    char *Bytes = 0;
+    s32 Count = 0;
+    if(dbus_message_marshal(Message, &Bytes, &Count))
+    {
+        trace_record_header Record = {};
+        Record.Time = StartTime - State->TraceStartTime;
+        Record.HandlerTime = EndTime - StartTime;
+        Record.ReplySize = (u32)ReplySize;
+        Record.MessageSize = (u32)Count;
+        
+        WriteTraceRecord(State->TraceFile, &Record, Bytes);
+        dbus_free(Bytes);
+    }
+}
+
+function DBusHandlerResult
+HandleDBusMessage(DBusConnection *Connection, DBusMessage *Message, void *UserData)
+{
+    trayge_state *State = UserData;
+    trayge_stats *Stats = State->Stats;
+    
+    u64 StartTime = GetMonotonicTime();
+    u64 StartBytesSent = Stats->Counters[StatsCounter_BytesSent];
+    AtomicAddU64(&Stats->Counters[StatsCounter_MessagesReceived], 1);
+    
+    const char *PathRaw = dbus_message_get_path(Message);
+    tray_item *Item = LookupTrayItem(State, PathRaw);
+    b32 IsDebugObject = StringsAreEqual(Str(PathRaw), StrLit(DebugObjectPath), 0);
+    
+    DBusHandlerResult Result = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    
+    DBusMessageIter MessageArgs = {};
+    dbus_message_iter_init(Message, &MessageArgs);
+    
+    const char *InterfaceRaw = dbus_message_get_interface(Message);
+    hashed_string Interface = StrHashed(InterfaceRaw);
+    
+    const char *NameRaw = dbus_message_get_member(Message);
+    hashed_string Name = StrHashed(NameRaw);
+    
+    DBusMessage *Response = 0;
+    DBusMessageIter ResponseArgs = {};
+    u64 ResponseSize = 0;
+    
+    LogLine(&State->Log, "%.6f %s %s.%s",
+            (f64)(StartTime - Stats->StartTime) / Billion, PathRaw ? PathRaw : "",
+            InterfaceRaw ? InterfaceRaw : "", NameRaw ? NameRaw : "");
+    
+    s32 MessageType = dbus_message_get_type(Message);
+    if(MessageType == DBUS_MESSAGE_TYPE_METHOD_CALL)
+    {
+        dbus_method_type Method = LookupName(&DBusMethodTable, Interface, Name);
+        
+        // NOTE(trayge): Item methods only resolve on item paths and Debug methods only on the
+        // Debug object, so neither interface leaks onto the other's paths.
+        b32 IsDebugMethod = StringsAreEqual(Interface.String, StrLit("org.trayge.Debug"), 0);
+        if(IsDebugMethod ? !IsDebugObject : !Item)
+        {
+            Method = DBusMethod_Unhandled;
+        }
         
-        case DBusTrayProperty_IconPixmap:
+        switch(Method)
         {
-            DeferLoop(dbus_message_iter_open_container(Parent, DBUS_TYPE_VARIANT, "a(iiay)", &Variant),
-                      dbus_message_iter_close_container(Parent, &Variant))
+            case DBusMethod_PropertiesGet:
+            {
+                hashed_string RequestedInterface = ReadStringArgument(&MessageArgs);
+                hashed_string RequestedProperty = ReadStringArgument(&MessageArgs);
+                
+                dbus_tray_property_type PropertyType = LookupName(&TrayPropertyTable, RequestedInterface, RequestedProperty);
+                if(PropertyType == DBusTrayProperty_IconPixmap ||
+                   (State->IconNameMode && PropertyType == DBusTrayProperty_IconName))
+                {
+                    NoteFrameFetched(&State->Scheduler);
+                }
+                
+                consumer *Consumer = 0;
+                if(PropertyType == DBusTrayProperty_IconPixmap)
+                {
+                    Consumer = FindThrottledConsumer(State, Message);
+                }
+                
+                if(Consumer && State->BackpressurePolicy == Backpressure_Skip &&
+                   Consumer->DeferredCount < MaxDeferredFetches)
+                {
+                    DeferFetch(Consumer, Message, Item, false);
+                    Result = DBUS_HANDLER_RESULT_HANDLED;
+                }
+                else if(Consumer && State->BackpressurePolicy != Backpressure_Pause)
+                {
+                    // NOTE(trayge): The lowres policy, and skip once a consumer has too many
+                    // fetches parked, answer with the small sizes only. The reply is charged
+                    // its pixel bytes, which is nearly all of it, so the consumer's queue stays
+                    // honest without measuring it.
+                    u32 LowResMask = LowResIconSizeMask(State->IconSizeMask);
+                    Response = dbus_message_new_method_return(Message);
+                    dbus_message_iter_init_append(Response, &ResponseArgs);
+                    AppendIconPixmapVariant(Item, LowResMask, &ResponseArgs);
+                    ResponseSize = IconCacheStorageSize(LowResMask);
+                }
+                else if(PropertyType != DBusTrayProperty_Unhandled)
+                {
+                    Response = CopyReply(GetCachedPropertyReply(State, Item, PropertyType), Message);
+                    ResponseSize = Item->PropertyReplies[PropertyType].Size;
+                }
+                else
+                {
+                    dbus_menu_property_type MenuPropertyType = LookupName(&DBusMenuPropertyTable, RequestedInterface, RequestedProperty);
+                    if(MenuPropertyType != DBusMenuProperty_Unhandled)
+                    {
+                        Response = dbus_message_new_method_return(Message);
+                        dbus_message_iter_init_append(Response, &ResponseArgs);
+                        AppendDBusMenuPropertyVariant(Item, MenuPropertyType, &ResponseArgs);
+                    }
+                }
+            } break;
+            
+            case DBusMethod_PropertiesGetAll:
+            {
+                hashed_string RequestedInterface = ReadStringArgument(&MessageArgs);
+                
+                b32 IsItemInterface = StringsAreEqual(RequestedInterface.String, StrLit("org.kde.StatusNotifierItem"), 0);
+                consumer *Consumer = 0;
+                if(IsItemInterface)
+                {
+                    NoteFrameFetched(&State->Scheduler);
+                    Consumer = FindThrottledConsumer(State, Message);
+                }
+                
+                // NOTE(trayge): GetAll carries the same pixmap as Get IconPixmap, so hosts that
+                // poll with it are held to the same policy.
+                if(Consumer && State->BackpressurePolicy == Backpressure_Skip &&
+                   Consumer->DeferredCount < MaxDeferredFetches)
+                {
+                    DeferFetch(Consumer, Message, Item, true);
+                    Result = DBUS_HANDLER_RESULT_HANDLED;
+                }
+                else if(Consumer && State->BackpressurePolicy != Backpressure_Pause)
+                {
+                    u32 LowResMask = LowResIconSizeMask(State->IconSizeMask);
+                    Response = dbus_message_new_method_return(Message);
+                    dbus_message_iter_init_append(Response, &ResponseArgs);
+                    AppendTrayProperties(Item, LowResMask, &ResponseArgs);
+                    ResponseSize = IconCacheStorageSize(LowResMask);
+                }
+                else if(IsItemInterface)
+                {
+                    Response = CopyReply(GetCachedGetAllReply(State, Item), Message);
+                    ResponseSize = Item->GetAllReply.Size;
+                }
+                else if(StringsAreEqual(RequestedInterface.String, StrLit("com.canonical.dbusmenu"), 0))
+                {
+                    Response = dbus_message_new_method_return(Message);
+                    dbus_message_iter_init_append(Response, &ResponseArgs);
+                    
+                    DBusMessageIter PropertiesArray = {};
+                    DeferLoop(dbus_message_iter_open_container(&ResponseArgs, DBUS_TYPE_ARRAY, "{sv}", &PropertiesArray),
+                              dbus_message_iter_close_container(&ResponseArgs, &PropertiesArray))
+                    {
+                        for(u32 PropertyIndex = DBusMenuProperty_Unhandled + 1;
+                            PropertyIndex < DBusMenuProperty_Count;
+                            ++PropertyIndex)
+                        {
+                            DBusMessageIter PropertyEntry = {};
+                            DeferLoop(dbus_message_iter_open_container(&PropertiesArray, DBUS_TYPE_DICT_ENTRY, 0, &PropertyEntry),
+                                      dbus_message_iter_close_container(&PropertiesArray, &PropertyEntry))
+                            {
+                                AppendString(&PropertyEntry, DBusMenuProperties[PropertyIndex].Name);
+                                AppendDBusMenuPropertyVariant(Item, PropertyIndex, &PropertyEntry);
+                            }
+                        }
+                    }
+                }
+            } break;
+            
+            case DBusMethod_ItemProvideXdgActivationToken:
+            case DBusMethod_ItemContextMenu:
+            case DBusMethod_ItemActivate:
+            case DBusMethod_ItemSecondaryActivate:
+            case DBusMethod_ItemScroll:
+            {
+                Response = dbus_message_new_method_return(Message);
+            } break;
+            
+            case DBusMethod_MenuGetLayout:
+            {
+                s32 ParentId = ReadInt32Argument(&MessageArgs, 0);
+                s32 Depth = ReadInt32Argument(&MessageArgs, -1);
+                u32 PropertyMask = ReadMenuPropertyMask(&MessageArgs);
+                
+                if(IsValidMenuId(&Item->Menu, ParentId))
+                {
+                    Response = dbus_message_new_method_return(Message);
+                    dbus_message_iter_init_append(Response, &ResponseArgs);
+                    
+                    dbus_message_iter_append_basic(&ResponseArgs, DBUS_TYPE_UINT32, &Item->Menu.Revision);
+                    AppendMenuLayout(&Item->Menu, ParentId, Depth, PropertyMask, &ResponseArgs);
+                }
+                else
+                {
+                    Response = dbus_message_new_error(Message, DBUS_ERROR_INVALID_ARGS, "Unknown menu item");
+                }
+            } break;
+            
+            case DBusMethod_MenuGetGroupProperties:
+            {
+                s32 *Ids = 0;
+                u32 IdCount = ReadInt32ArrayArgument(&MessageArgs, &Ids);
+                u32 PropertyMask = ReadMenuPropertyMask(&MessageArgs);
+                
+                Response = dbus_message_new_method_return(Message);
+                dbus_message_iter_init_append(Response, &ResponseArgs);
+                
+                DBusMessageIter ItemsArray = {};
+                DeferLoop(dbus_message_iter_open_container(&ResponseArgs, DBUS_TYPE_ARRAY, "(ia{sv})", &ItemsArray),
+                          dbus_message_iter_close_container(&ResponseArgs, &ItemsArray))
+                {
+                    for(u32 IdIndex = 0;
+                        IdIndex < IdCount;
+                        ++IdIndex)
+                    {
+                        if(IsValidMenuId(&Item->Menu, Ids[IdIndex]))
+                        {
+                            DBusMessageIter ItemEntry = {};
+                            DeferLoop(dbus_message_iter_open_container(&ItemsArray, DBUS_TYPE_STRUCT, 0, &ItemEntry),
+                                      dbus_message_iter_close_container(&ItemsArray, &ItemEntry))
+                            {
+                                dbus_message_iter_append_basic(&ItemEntry, DBUS_TYPE_INT32, Ids + IdIndex);
+                                AppendMenuProperties(&Item->Menu, Ids[IdIndex], PropertyMask, &ItemEntry);
+                            }
+                        }
+                    }
+                }
+            } break;
+            
+            case DBusMethod_MenuGetProperty:
+            {
+                s32 Id = ReadInt32Argument(&MessageArgs, -1);
+                hashed_string RequestedProperty = ReadStringArgument(&MessageArgs);
+                
+                u32 Property = LookupName(&MenuPropertyTable, StrHashed(""), RequestedProperty);
+                if(Property && IsValidMenuId(&Item->Menu, Id))
+                {
+                    Response = dbus_message_new_method_return(Message);
+                    dbus_message_iter_init_append(Response, &ResponseArgs);
+                    AppendMenuPropertyVariant(&Item->Menu, Id, Property - 1, &ResponseArgs);
+                }
+                else
+                {
+                    Response = dbus_message_new_error(Message, DBUS_ERROR_INVALID_ARGS, "Unknown menu item or property");
+                }
+            } break;
+            
+            case DBusMethod_MenuEvent:
             {
-                s32 Width = 256;
-                s32 Height = 256;
-                u32 Pixels[256*256];
+                s32 Id = ReadInt32Argument(&MessageArgs, -1);
+                hashed_string EventId = ReadStringArgument(&MessageArgs);
                 
-                u8 *Row = (u8 *)Pixels;
-                for(s32 Y = 0;
-                    Y < Height;
-                    ++Y)
-                {
-                    u32 *Pixel = (u32 *)Row;
-                    for(s32 X = 0;
-                        X < Width;
-                        ++X)
+                if(IsValidMenuId(&Item->Menu, Id))
+                {
+                    if(StringsAreEqual(EventId.String, StrLit("clicked"), 0))
                     {
-                        *Pixel++ = (u32)0xFF | (u32)(u8)(Y + State->YOffset) << 16 | (u32)(u8)(X + State->XOffset) << 24;
+                        ActivateTrayMenuItem(State, Item, Id);
                     }
                     
-                    Row += Width*4;
+                    Response = dbus_message_new_method_return(Message);
+                }
+                else
+                {
+                    Response = dbus_message_new_error(Message, DBUS_ERROR_INVALID_ARGS, "Unknown menu item");
                 }
+            } break;
+            
+            case DBusMethod_MenuEventGroup:
+            {
+                Response = dbus_message_new_method_return(Message);
+                dbus_message_iter_init_append(Response, &ResponseArgs);
                 
-                DBusMessageIter IconsArray = {};
-                DeferLoop(dbus_message_iter_open_container(&Variant, DBUS_TYPE_ARRAY, "(iiay)", &IconsArray),
-                          dbus_message_iter_close_container(&Variant, &IconsArray))
+                DBusMessageIter ErrorsArray = {};
+                DeferLoop(dbus_message_iter_open_container(&ResponseArgs, DBUS_TYPE_ARRAY, "i", &ErrorsArray),
+                          dbus_message_iter_close_container(&ResponseArgs, &ErrorsArray))
                 {
-                    DBusMessageIter IconsEntry = {};
-                    DeferLoop(dbus_message_iter_open_container(&IconsArray, DBUS_TYPE_STRUCT, 0, &IconsEntry),
-                              dbus_message_iter_close_container(&IconsArray, &IconsEntry))
+                    if(dbus_message_iter_get_arg_type(&MessageArgs) == DBUS_TYPE_ARRAY)
                     {
-                        dbus_message_iter_append_basic(&IconsEntry, DBUS_TYPE_INT32, &Width);
-                        dbus_message_iter_append_basic(&IconsEntry, DBUS_TYPE_INT32, &Height);
+                        DBusMessageIter Events = {};
+                        dbus_message_iter_recurse(&MessageArgs, &Events);
                         
-                        DBusMessageIter IconsEntryBytes = {};
-                        DeferLoop(dbus_message_iter_open_container(&IconsEntry, DBUS_TYPE_ARRAY, "y", &IconsEntryBytes),
-                                  dbus_message_iter_close_container(&IconsEntry, &IconsEntryBytes))
+                        while(dbus_message_iter_get_arg_type(&Events) == DBUS_TYPE_STRUCT)
                         {
-                            u8 *Bytes = (u8 *)Pixels;
-                            dbus_message_iter_append_fixed_array(&IconsEntryBytes, DBUS_TYPE_BYTE, &Bytes, Width*Height*4);
+                            DBusMessageIter Event = {};
+                            dbus_message_iter_recurse(&Events, &Event);
+                            
+                            s32 Id = ReadInt32Argument(&Event, -1);
+                            hashed_string EventId = ReadStringArgument(&Event);
+                            
+                            if(!IsValidMenuId(&Item->Menu, Id))
+                            {
+                                dbus_message_iter_append_basic(&ErrorsArray, DBUS_TYPE_INT32, &Id);
+                            }
+                            else if(StringsAreEqual(EventId.String, StrLit("clicked"), 0))
+                            {
+                                ActivateTrayMenuItem(State, Item, Id);
+                            }
+                            
+                            dbus_message_iter_next(&Events);
                         }
                     }
                 }
-            }
+            } break;
             
-            ++State->XOffset;
-            State->YOffset += 2;
-        } break;
+            case DBusMethod_MenuAboutToShow:
+            {
+                b32 NeedUpdate = false;
+                
+                Response = dbus_message_new_method_return(Message);
+                dbus_message_append_args(Response, DBUS_TYPE_BOOLEAN, &NeedUpdate, DBUS_TYPE_INVALID);
+            } break;
+            
+            case DBusMethod_MenuAboutToShowGroup:
+            {
+                s32 *Ids = 0;
+                u32 IdCount = ReadInt32ArrayArgument(&MessageArgs, &Ids);
+                
+                Response = dbus_message_new_method_return(Message);
+                dbus_message_iter_init_append(Response, &ResponseArgs);
+                
+                DBusMessageIter UpdatesArray = {};
+                DeferLoop(dbus_message_iter_open_container(&ResponseArgs, DBUS_TYPE_ARRAY, "i", &UpdatesArray),
+                          dbus_message_iter_close_container(&ResponseArgs, &UpdatesArray))
+                {
+                }
+                
+                DBusMessageIter ErrorsArray = {};
+                DeferLoop(dbus_message_iter_open_container(&ResponseArgs, DBUS_TYPE_ARRAY, "i", &ErrorsArray),
+                          dbus_message_iter_close_container(&ResponseArgs, &ErrorsArray))
+                {
+                    for(u32 IdIndex = 0;
+                        IdIndex < IdCount;
+                        ++IdIndex)
+                    {
+                        if(!IsValidMenuId(&Item->Menu, Ids[IdIndex]))
+                        {
+                            dbus_message_iter_append_basic(&ErrorsArray, DBUS_TYPE_INT32, Ids + IdIndex);
+                        }
+                    }
+                }
+            } break;
+            
+            case DBusMethod_DebugGetStats:
+            {
+                UpdateWakeupRate(Stats, StartTime);
+                
+                Response = dbus_message_new_method_return(Message);
+                dbus_message_iter_init_append(Response, &ResponseArgs);
+                AppendStats(State, &ResponseArgs);
+            } break;
+            
+            case DBusMethod_DebugGetMethodStats:
+            {
+                Response = dbus_message_new_method_return(Message);
+                dbus_message_iter_init_append(Response, &ResponseArgs);
+                AppendMethodStats(Stats, &ResponseArgs);
+            } break;
+            
+            case DBusMethod_DebugGetLog:
+            {
+                u8 *Bytes = PushSize(&State->TransientArena, State->Log.Size + 1);
+                u64 Count = CopyLogRing(&State->Log, Bytes);
+                Bytes[Count] = 0;
+                
+                // NOTE(trayge): The oldest line is usually cut by the ring wrapping; drop it.
+                char *Text = (char *)Bytes;
+                if(LogRingOldestPosition(&State->Log))
+                {
+                    for(; *Text && *Text != '\n'; ++Text);
+                    if(*Text)
+                    {
+                        ++Text;
+                    }
+                }
+                
+                Response = dbus_message_new_method_return(Message);
+                dbus_message_append_args(Response, DBUS_TYPE_STRING, &Text, DBUS_TYPE_INVALID);
+            } break;
+            
+            case DBusMethod_DebugSetLogging:
+            {
+                if(dbus_message_iter_get_arg_type(&MessageArgs) == DBUS_TYPE_BOOLEAN)
+                {
+                    dbus_bool_t Enabled = false;
+                    dbus_message_iter_get_basic(&MessageArgs, &Enabled);
+                    State->Log.Enabled = (Enabled != 0);
+                    
+                    Response = dbus_message_new_method_return(Message);
+                }
+                else
+                {
+                    Response = dbus_message_new_error(Message, DBUS_ERROR_INVALID_ARGS, "Expected a boolean");
+                }
+            } break;
+            
+            case DBusMethod_Unhandled:
+            case DBusMethod_Count:
+            {
+            } break;
+        }
+        
+        AtomicAddU64(&Stats->Counters[StatsCounter_MethodCalls], 1);
+        RecordHistogramValue(Stats->MethodLatency + Method, GetMonotonicTime() - StartTime);
+    }
+    
+    if(Response)
+    {
+        SendMessage(State, Response, ResponseSize);
+        dbus_message_unref(Response);
+        
+        Result = DBUS_HANDLER_RESULT_HANDLED;
+    }
+    
+    if(State->TraceFile)
+    {
+        RecordTraceMessage(State, Message, StartTime, Stats->Counters[StatsCounter_BytesSent] - StartBytesSent);
+    }
+    
+    return Result;
+}
+
+// NOTE(trayge): With no host there is nobody to draw the items, so the frame timer is
+// disarmed and change signals wait in the version vectors; the loop then only wakes for bus
+// traffic. Whatever changed meanwhile goes out as one batch once a host shows up.
+function void
+SetHostPresent(trayge_state *State, b32 HostPresent)
+{
+    if(State->HostPresent != HostPresent)
+    {
+        State->HostPresent = HostPresent;
+        LogLine(&State->Log, "%s", HostPresent ? "host registered, resuming" : "no host registered, suspending");
         
-        case DBusTrayProperty_AttentionIconName:
+        State->Scheduler.AwaitingFetch = false;
+        UpdateFrameSchedulerAnimation(State);
+        PublishFrameDemand(State);
+    }
+}
+
+// NOTE(trayge): The queries below go out asynchronously; a service that is not running simply
+// answers with an error, which leaves the corresponding state at its default.
+function void
+CallWithReply(trayge_state *State, DBusMessage *Request, DBusPendingCallNotifyFunction Notify)
+{
+    DBusPendingCall *Pending = 0;
+    if(dbus_connection_send_with_reply(State->Connection, Request, &Pending, DBUS_TIMEOUT_USE_DEFAULT) && Pending)
+    {
+        dbus_pending_call_set_notify(Pending, Notify, State, 0);
+    }
+    dbus_message_unref(Request);
+}
+
+function DBusMessage *
+NewPropertyGet(char *Service, char *ObjectPath, char *Interface, char *Property)
+{
+    DBusMessage *Result = dbus_message_new_method_call(Service, ObjectPath, "org.freedesktop.DBus.Properties", "Get");
+    dbus_message_append_args(Result, DBUS_TYPE_STRING, &Interface, DBUS_TYPE_STRING, &Property, DBUS_TYPE_INVALID);
+    return Result;
+}
+
+// NOTE(trayge): Takes the reply out of Pending and releases it. Value receives the first
+// argument, looking through a variant, when it has the basic Type.
+function b32
+StealBasicReply(DBusPendingCall *Pending, s32 Type, void *Value)
+{
+    b32 Result = false;
+    
+    DBusMessage *Reply = dbus_pending_call_steal_reply(Pending);
+    if(Reply)
+    {
+        DBusMessageIter ReplyArgs = {};
+        if(dbus_message_get_type(Reply) == DBUS_MESSAGE_TYPE_METHOD_RETURN &&
+           dbus_message_iter_init(Reply, &ReplyArgs))
         {
-            DeferLoop(dbus_message_iter_open_container(Parent, DBUS_TYPE_VARIANT, "s", &Variant),
-                      dbus_message_iter_close_container(Parent, &Variant))
+            DBusMessageIter Variant = {};
+            DBusMessageIter *Argument = &ReplyArgs;
+            if(dbus_message_iter_get_arg_type(&ReplyArgs) == DBUS_TYPE_VARIANT)
             {
-                char *Value = "";
-                dbus_message_iter_append_basic(&Variant, DBUS_TYPE_STRING, &Value);
+                dbus_message_iter_recurse(&ReplyArgs, &Variant);
+                Argument = &Variant;
             }
-        } break;
-        
-        case DBusTrayProperty_AttentionIconPixmap:
-        {
-            DeferLoop(dbus_message_iter_open_container(Parent, DBUS_TYPE_VARIANT, "a(iiay)", &Variant),
-                      dbus_message_iter_close_container(Parent, &Variant))
+            
+            if(dbus_message_iter_get_arg_type(Argument) == Type)
             {
-                DBusMessageIter IconsArray = {};
-                DeferLoop(dbus_message_iter_open_container(&Variant, DBUS_TYPE_ARRAY, "(iiay)", &IconsArray),
-                          dbus_message_iter_close_container(&Variant, &IconsArray))
-                {
-                }
+                dbus_message_iter_get_basic(Argument, Value);
+                Result = true;
             }
-        } break;
+        }
         
-        InvalidDefaultCase;
+        dbus_message_unref(Reply);
     }
+    dbus_pending_call_unref(Pending);
+    
+    return Result;
 }
 
-function DBusHandlerResult
-HandleDBusMessage(DBusConnection *Connection, DBusMessage *Message, void *UserData)
+// NOTE(trayge): The first item registers under the connection's unique name at the spec's
+// /StatusNotifierItem path. The rest register by object path alone, which KDE's watcher and
+// the Ayatana and libappindicator hosts resolve against the sender; a watcher that only takes
+// bus names refuses them, and says so in its reply. Giving each item a well-known name would
+// not help: they would all still share one sender and one path for their signals.
+function void
+HandleRegisterItemReply(DBusPendingCall *Pending, void *UserData)
+{
+    DBusMessage *Reply = dbus_pending_call_steal_reply(Pending);
+    if(Reply)
+    {
+        const char *ErrorName = dbus_message_get_error_name(Reply);
+        if(ErrorName && !dbus_message_is_error(Reply, DBUS_ERROR_SERVICE_UNKNOWN))
+        {
+            char *ErrorText = "";
+            dbus_message_get_args(Reply, 0, DBUS_TYPE_STRING, &ErrorText, DBUS_TYPE_INVALID);
+            fprintf(stderr, "StatusNotifierWatcher refused an item: %s: %s\n", ErrorName, ErrorText);
+        }
+        
+        dbus_message_unref(Reply);
+    }
+    dbus_pending_call_unref(Pending);
+}
+
+function void
+RegisterTrayItems(trayge_state *State)
+{
+    for(u32 ItemIndex = 0;
+        ItemIndex < State->ItemCount;
+        ++ItemIndex)
+    {
+        tray_item *Item = State->Items + ItemIndex;
+        const char *Service = (ItemIndex == 0) ? State->UniqueName : Item->ObjectPath;
+        
+        DBusMessage *Request = dbus_message_new_method_call("org.kde.StatusNotifierWatcher",
+                                                            "/StatusNotifierWatcher",
+                                                            "org.kde.StatusNotifierWatcher",
+                                                            "RegisterStatusNotifierItem");
+        DBusMessageIter RequestParams = {};
+        dbus_message_iter_init_append(Request, &RequestParams);
+        dbus_message_iter_append_basic(&RequestParams, DBUS_TYPE_STRING, &Service);
+        
+        CallWithReply(State, Request, HandleRegisterItemReply);
+    }
+}
+
+function void
+HandleHostQueryReply(DBusPendingCall *Pending, void *UserData)
 {
     trayge_state *State = UserData;
     
-    DBusHandlerResult Result = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    dbus_bool_t Value = false;
+    State->WatcherPresent = StealBasicReply(Pending, DBUS_TYPE_BOOLEAN, &Value);
     
-    DBusMessageIter MessageArgs = {};
-    dbus_message_iter_init(Message, &MessageArgs);
+    SetHostPresent(State, (Value != 0));
+}
+
+function void
+QueryHostRegistered(trayge_state *State)
+{
+    CallWithReply(State, NewPropertyGet("org.kde.StatusNotifierWatcher", "/StatusNotifierWatcher",
+                                        "org.kde.StatusNotifierWatcher", "IsStatusNotifierHostRegistered"),
+                  HandleHostQueryReply);
+}
+
+// NOTE(trayge): The lock state comes from the org.freedesktop.ScreenSaver service that every
+// major desktop provides on the session bus, idleness from GNOME's session presence
+// (status 3 is idle). Coming back from a lock fires one frame straight away; AdvanceFrame
+// derives the animation step from the clock, so that single frame catches up completely.
+#define PresenceStatusIdle 3
+
+function void
+UpdateSessionState(trayge_state *State)
+{
+    frame_scheduler *Scheduler = &State->Scheduler;
     
-    const char *InterfaceRaw = dbus_message_get_interface(Message);
-    string Interface = Str(InterfaceRaw);
+    session_state Session = (State->ScreenSaverActive ? Session_Locked :
+                             State->PresenceIdle ? Session_Idle :
+                             Session_Active);
     
-    const char *NameRaw = dbus_message_get_member(Message);
-    string Name = Str(NameRaw);
+    if(Scheduler->Session != Session)
+    {
+        static char *SessionNames[] = {"active", "idle", "locked"};
+        LogLine(&State->Log, "session %s", SessionNames[Session]);
+        
+        b32 Unlocked = (Scheduler->Session == Session_Locked);
+        Scheduler->Session = Session;
+        Scheduler->AwaitingFetch = false;
+        
+        u64 FramesPerSecond = EffectiveFramesPerSecond(Scheduler);
+        if(Unlocked && Scheduler->Animated && FramesPerSecond)
+        {
+            Scheduler->Timer.Interval = Billion / FramesPerSecond;
+            ScheduleTimer(&State->Timers, &Scheduler->Timer, GetMonotonicTime());
+        }
+        
+        ArmFrameTimer(State);
+        PublishFrameDemand(State);
+    }
+}
+
+function void
+HandleScreenSaverReply(DBusPendingCall *Pending, void *UserData)
+{
+    trayge_state *State = UserData;
     
-    DBusMessage *Response = dbus_message_new_method_return(Message);
+    dbus_bool_t Active = false;
+    StealBasicReply(Pending, DBUS_TYPE_BOOLEAN, &Active);
+    
+    State->ScreenSaverActive = (Active != 0);
+    UpdateSessionState(State);
+}
+
+function void
+HandlePresenceReply(DBusPendingCall *Pending, void *UserData)
+{
+    trayge_state *State = UserData;
     
-    DBusMessageIter ResponseArgs = {};
-    dbus_message_iter_init_append(Response, &ResponseArgs);
+    u32 Status = 0;
+    StealBasicReply(Pending, DBUS_TYPE_UINT32, &Status);
     
-    printf("%s %s\n", InterfaceRaw, NameRaw);
+    State->PresenceIdle = (Status == PresenceStatusIdle);
+    UpdateSessionState(State);
+}
+
+function void
+QuerySessionState(trayge_state *State)
+{
+    CallWithReply(State, dbus_message_new_method_call("org.freedesktop.ScreenSaver", "/org/freedesktop/ScreenSaver",
+                                                      "org.freedesktop.ScreenSaver", "GetActive"),
+                  HandleScreenSaverReply);
+    CallWithReply(State, NewPropertyGet("org.gnome.SessionManager", "/org/gnome/SessionManager/Presence",
+                                        "org.gnome.SessionManager.Presence", "status"),
+                  HandlePresenceReply);
+}
+
+// NOTE(trayge): Bus signals are not addressed to our object paths, so they come in through a
+// connection filter instead of HandleDBusMessage. The filter never consumes anything.
+function DBusHandlerResult
+HandleBusSignal(DBusConnection *Connection, DBusMessage *Message, void *UserData)
+{
+    trayge_state *State = UserData;
     
-    s32 MessageType = dbus_message_get_type(Message);
-    if(MessageType == DBUS_MESSAGE_TYPE_METHOD_CALL)
+    if(dbus_message_is_signal(Message, DBUS_INTERFACE_DBUS, "NameOwnerChanged"))
     {
-        if(StringsAreEqual(Interface, StrLit("org.freedesktop.DBus.Properties"), 0))
+        char *Name = 0;
+        char *OldOwner = 0;
+        char *NewOwner = 0;
+        b32 Parsed = (dbus_message_get_args(Message, 0,
+                                            DBUS_TYPE_STRING, &Name,
+                                            DBUS_TYPE_STRING, &OldOwner,
+                                            DBUS_TYPE_STRING, &NewOwner,
+                                            DBUS_TYPE_INVALID) != 0);
+        
+        if(Parsed && StringsAreEqual(Str(Name), StrLit("org.kde.StatusNotifierWatcher"), 0))
         {
-            if(StringsAreEqual(Name, StrLit("Get"), 0))
+            State->WatcherPresent = (NewOwner[0] != 0);
+            LogLine(&State->Log, "watcher %s", State->WatcherPresent ? NewOwner : "gone");
+            
+            if(State->WatcherPresent)
             {
-                char *RequestedInterfaceRaw = 0;
-                dbus_message_iter_get_basic(&MessageArgs, &RequestedInterfaceRaw);
-                string RequestedInterface = Str(RequestedInterfaceRaw);
-                dbus_message_iter_next(&MessageArgs);
-                
-                char *RequestedPropertyRaw = 0;
-                dbus_message_iter_get_basic(&MessageArgs, &RequestedPropertyRaw);
-                string RequestedProperty = Str(RequestedPropertyRaw);
-                dbus_message_iter_next(&MessageArgs);
-                
-                if(StringsAreEqual(RequestedInterface, StrLit("org.kde.StatusNotifierItem"), 0))
-                {
-                    dbus_tray_property_type PropertyType = DBusTrayProperty_Unhandled;
-                    if(StringsAreEqual(RequestedProperty, StrLit("Category"), 0))
-                    {
-                        PropertyType = DBusTrayProperty_Category;
-                    }
-                    else if(StringsAreEqual(RequestedProperty, StrLit("Id"), 0))
-                    {
-                        PropertyType = DBusTrayProperty_Id;
-                    }
-                    else if(StringsAreEqual(RequestedProperty, StrLit("Title"), 0))
-                    {
-                        PropertyType = DBusTrayProperty_Title;
-                    }
-                    else if(StringsAreEqual(RequestedProperty, StrLit("Status"), 0))
-                    {
-                        PropertyType = DBusTrayProperty_Status;
-                    }
-                    else if(StringsAreEqual(RequestedProperty, StrLit("IconThemePath"), 0))
-                    {
-                        PropertyType = DBusTrayProperty_IconThemePath;
-                    }
-                    else if(StringsAreEqual(RequestedProperty, StrLit("Menu"), 0))
-                    {
-                        PropertyType = DBusTrayProperty_Menu;
-                    }
-                    else if(StringsAreEqual(RequestedProperty, StrLit("ItemIsMenu"), 0))
-                    {
-                        PropertyType = DBusTrayProperty_ItemIsMenu;
-                    }
-                    else if(StringsAreEqual(RequestedProperty, StrLit("IconName"), 0))
-                    {
-                        PropertyType = DBusTrayProperty_IconName;
-                    }
-                    else if(StringsAreEqual(RequestedProperty, StrLit("IconPixmap"), 0))
-                    {
-                        PropertyType = DBusTrayProperty_IconPixmap;
-                    }
-                    else if(StringsAreEqual(RequestedProperty, StrLit("AttentionIconName"), 0))
-                    {
-                        PropertyType = DBusTrayProperty_AttentionIconName;
-                    }
-                    else if(StringsAreEqual(RequestedProperty, StrLit("AttentionIconPixmap"), 0))
-                    {
-                        PropertyType = DBusTrayProperty_AttentionIconPixmap;
-                    }
-                    
-                    if(PropertyType != DBusTrayProperty_Unhandled)
-                    {
-                        AppendTrayPropertyVariant(State, PropertyType, &ResponseArgs);
-                        Result = DBUS_HANDLER_RESULT_HANDLED;
-                    }
-                }
+                // NOTE(trayge): A restarted watcher has forgotten every item.
+                RegisterTrayItems(State);
+                QueryHostRegistered(State);
             }
-            else if(StringsAreEqual(Name, StrLit("GetAll"), 0))
+            else
             {
-                char *RequestedInterfaceRaw = 0;
-                dbus_message_iter_get_basic(&MessageArgs, &RequestedInterfaceRaw);
-                string RequestedInterface = Str(RequestedInterfaceRaw);
-                dbus_message_iter_next(&MessageArgs);
-                
-                if(StringsAreEqual(RequestedInterface, StrLit("org.kde.StatusNotifierItem"), 0))
-                {
-                    DBusMessageIter PropertiesArray = {};
-                    DeferLoop(dbus_message_iter_open_container(&ResponseArgs, DBUS_TYPE_ARRAY, "{sv}", &PropertiesArray),
-                              dbus_message_iter_close_container(&ResponseArgs, &PropertiesArray))
-                    {
-                        DBusMessageIter PropertyEntry = {};
-                        
-                        for(u32 PropertyIndex = DBusTrayProperty_Unhandled + 1;
-                            PropertyIndex < DBusTrayProperty_Count;
-                            ++PropertyIndex)
-                        {
-                            DeferLoop(dbus_message_iter_open_container(&PropertiesArray, DBUS_TYPE_DICT_ENTRY, 0, &PropertyEntry),
-                                      dbus_message_iter_close_container(&PropertiesArray, &PropertyEntry))
-                            {
-                                char *TypeString = TrayPropertyTypeToName(PropertyIndex);
-                                dbus_message_iter_append_basic(&PropertyEntry, DBUS_TYPE_STRING, &TypeString);
-                                
-                                AppendTrayPropertyVariant(State, PropertyIndex, &PropertyEntry);
-                            }
-                        }
-                    }
-                    
-                    Result = DBUS_HANDLER_RESULT_HANDLED;
-                }
+                SetHostPresent(State, false);
             }
         }
-        else if(StringsAreEqual(Interface, StrLit("org.kde.StatusNotifierItem"), 0))
+        else if(Parsed &&
+                (StringsAreEqual(Str(Name), StrLit("org.freedesktop.ScreenSaver"), 0) ||
+                 StringsAreEqual(Str(Name), StrLit("org.gnome.SessionManager"), 0)))
+        {
+            // NOTE(trayge): A screen saver that crashed while locked must not freeze us for good.
+            QuerySessionState(State);
+        }
+    }
+    else if(dbus_message_is_signal(Message, "org.freedesktop.ScreenSaver", "ActiveChanged"))
+    {
+        dbus_bool_t Active = false;
+        if(dbus_message_get_args(Message, 0, DBUS_TYPE_BOOLEAN, &Active, DBUS_TYPE_INVALID))
+        {
+            State->ScreenSaverActive = (Active != 0);
+            UpdateSessionState(State);
+        }
+    }
+    else if(dbus_message_is_signal(Message, "org.gnome.SessionManager.Presence", "StatusChanged"))
+    {
+        u32 Status = 0;
+        if(dbus_message_get_args(Message, 0, DBUS_TYPE_UINT32, &Status, DBUS_TYPE_INVALID))
         {
-            Result = DBUS_HANDLER_RESULT_HANDLED;
+            State->PresenceIdle = (Status == PresenceStatusIdle);
+            UpdateSessionState(State);
         }
     }
-    else if(MessageType == DBUS_MESSAGE_TYPE_SIGNAL)
+    else if(dbus_message_is_signal(Message, "org.kde.StatusNotifierWatcher", "StatusNotifierHostRegistered"))
     {
+        SetHostPresent(State, true);
     }
-    
-    if(Result == DBUS_HANDLER_RESULT_HANDLED)
+    else if(dbus_message_is_signal(Message, "org.kde.StatusNotifierWatcher", "StatusNotifierHostUnregistered"))
     {
-        dbus_connection_send(Connection, Response, 0);
+        // NOTE(trayge): Other hosts may still be around; only the watcher knows.
+        QueryHostRegistered(State);
     }
     
-    dbus_message_unref(Response);
-    
-    return Result;
+    return DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
 }
 
-int
-main(int ArgumentCount, char **Arguments)
+function b32
+InitTrayge(trayge_state *State, trayge_options *Options)
 {
-    trayge_state State = {};
+    u32 IconSizeMask = Options->IconSizeMask ? Options->IconSizeMask : IconSizeAll;
     
-    State.WatchSentinel.Next = State.WatchSentinel.Prev = &State.WatchSentinel;
-    State.TimeoutSentinel.Next = State.TimeoutSentinel.Prev = &State.TimeoutSentinel;
+    InitDispatchTables();
     
-    State.Connection = dbus_bus_get(DBUS_BUS_SESSION, 0);
-    State.UniqueName = dbus_bus_get_unique_name(State.Connection);
+    InitArena(&State->PermanentArena, 4*1024*1024);
+    InitArena(&State->TransientArena, 1024*1024);
+    InitPool(&State->WatchPool, &State->PermanentArena, sizeof(dbus_watch_entry));
+    InitPool(&State->TimerPool, &State->PermanentArena, sizeof(timer_entry));
+    InitPool(&State->ReplyRecordPool, &State->PermanentArena, sizeof(reply_record));
+    State->Consumers = PushArray(&State->PermanentArena, consumer, MaxConsumers);
+    State->ReplySlot = -1;
+    dbus_message_allocate_data_slot(&State->ReplySlot);
+    InitPixelKernels(Options->MaxPixelKernelLevel);
     
-    dbus_connection_set_watch_functions(State.Connection, HandleDBusAddWatch, HandleDBusRemoveWatch, HandleDBusToggleWatch, &State, 0);
-    dbus_connection_set_timeout_functions(State.Connection, HandleDBusAddTimeout, HandleDBusRemoveTimeout, HandleDBusToggleTimeout, &State, 0);
-    
-    State.Callbacks.message_function = HandleDBusMessage;
-    dbus_connection_register_object_path(State.Connection, "/StatusNotifierItem", &State.Callbacks, &State);
-    dbus_connection_register_object_path(State.Connection, "/MenuBar", &State.Callbacks, &State);
+    State->Stats = PushStruct(&State->PermanentArena, trayge_stats);
+    State->Stats->StartTime = GetMonotonicTime();
+    State->Stats->RateTime = State->Stats->StartTime;
+    InitLogRing(&State->Log, PushSize(&State->PermanentArena, LogRingSize), LogRingSize);
+    State->Log.Enabled = Options->LogEnabled;
     
+    if(Options->TracePath)
     {
-        DBusMessage *Request = dbus_message_new_method_call("org.kde.StatusNotifierWatcher",
-                                                            "/StatusNotifierWatcher",
-                                                            "org.kde.StatusNotifierWatcher",
-                                                            "RegisterStatusNotifierItem");
-        DBusMessageIter RequestParams = {};
-        dbus_message_iter_init_append(Request, &RequestParams);
-        dbus_message_iter_append_basic(&RequestParams, DBUS_TYPE_STRING, &State.UniqueName);
-        
-        dbus_connection_send(State.Connection, Request, 0);
-        dbus_message_unref(Request);
-        dbus_connection_flush(State.Connection);
+        State->TraceFile = fopen(Options->TracePath, "wb");
+        if(!State->TraceFile || !WriteTraceHeader(State->TraceFile))
+        {
+            fprintf(stderr, "Could not open trace file %s\n", Options->TracePath);
+            return false;
+        }
+        State->TraceStartTime = GetMonotonicTime();
     }
     
-    s32 TimerHandle = timerfd_create(CLOCK_MONOTONIC, 0);
+    char *Id = Options->Id ? Options->Id : "trayge_example";
+    char *Title = Options->Title ? Options->Title : "Trayge Example";
     
-    s64 Nanoseconds = Billion / 120;
+    State->ItemCount = Options->ItemCount ? Options->ItemCount : 1;
+    State->MenuChurnCount = Options->Embedded ? 0 : Options->MenuChurnCount;
+    State->Items = PushArray(&State->PermanentArena, tray_item, State->ItemCount);
     
-    struct itimerspec TimerArgs = {};
-    TimerArgs.it_value.tv_sec = Nanoseconds / Billion;
-    TimerArgs.it_value.tv_nsec = Nanoseconds % Billion;
-    TimerArgs.it_interval = TimerArgs.it_value;
+    InitIconFramePool(&State->FramePool, &State->PermanentArena, IconCacheStorageSize(IconSizeMask));
+    State->IconSizeMask = IconSizeMask;
+    
+    // NOTE(trayge): Panels draw tray icons at 64 pixels or less, so by default the 256 size is
+    // kept for pixmap hosts only. A mask naming no rendered size falls back to all of them.
+    u32 IconThemeSizeMask = Options->IconThemeSizeMask ? Options->IconThemeSizeMask : DefaultIconThemeSizeMask;
+    State->IconThemeSizeMask = IconSizeMask & IconThemeSizeMask;
+    if(!State->IconThemeSizeMask)
+    {
+        State->IconThemeSizeMask = IconSizeMask;
+    }
     
-    s32 x = timerfd_settime(TimerHandle, 0, &TimerArgs, 0);
+    if(State->IconNameMode && !InitIconTheme(State))
+    {
+        fprintf(stderr, "Could not create icon theme directory %s, serving pixmaps only\n", State->IconThemePath);
+        State->IconNameMode = false;
+        State->IconThemePath[0] = 0;
+    }
     
-    while(true)
+    for(u32 ItemIndex = 0;
+        ItemIndex < State->ItemCount;
+        ++ItemIndex)
     {
-        u32 PollHandleCount = 0;
-        struct pollfd PollHandles[32] = {};
-        
-        PollHandles[PollHandleCount++] = (struct pollfd){TimerHandle, POLLIN, 0};
+        tray_item *Item = State->Items + ItemIndex;
+        Item->Index = ItemIndex;
+        Item->Animated = Options->Animated;
         
-        for(dbus_watch_entry *WatchEntry = State.WatchSentinel.Next;
-            WatchEntry != &State.WatchSentinel;
-            WatchEntry = WatchEntry->Next)
+        // NOTE(trayge): Item 0 keeps the well-known paths so single-item hosts see no change;
+        // the rest live under them as /StatusNotifierItem/<n> and /MenuBar/<n>.
+        if(ItemIndex == 0)
         {
-            PollHandles[PollHandleCount++] = (struct pollfd){WatchEntry->FileHandle, (s16)WatchEntry->PollFlags, 0};
+            snprintf(Item->ObjectPath, sizeof(Item->ObjectPath), "/StatusNotifierItem");
+            snprintf(Item->MenuPath, sizeof(Item->MenuPath), "/MenuBar");
+            snprintf(Item->Id, sizeof(Item->Id), "%s", Id);
+            snprintf(Item->DefaultTitle, sizeof(Item->DefaultTitle), "%s", Title);
+        }
+        else
+        {
+            snprintf(Item->ObjectPath, sizeof(Item->ObjectPath), "/StatusNotifierItem/%u", ItemIndex);
+            snprintf(Item->MenuPath, sizeof(Item->MenuPath), "/MenuBar/%u", ItemIndex);
+            snprintf(Item->Id, sizeof(Item->Id), "%s_%u", Id, ItemIndex);
+            snprintf(Item->DefaultTitle, sizeof(Item->DefaultTitle), "%s %u", Title, ItemIndex);
         }
         
-        for(dbus_timeout_entry *TimeoutEntry = State.TimeoutSentinel.Next;
-            TimeoutEntry != &State.TimeoutSentinel;
-            TimeoutEntry = TimeoutEntry->Next)
+        InitIconCache(&Item->Icon, IconSizeMask, &State->FramePool);
+        RenderIconCache(&Item->Icon, State->XOffset + (s32)ItemIndex*32, State->YOffset);
+        
+        Item->IconThemePath = State->IconThemePath;
+        if(State->IconNameMode)
         {
-            PollHandles[PollHandleCount++] = (struct pollfd){TimeoutEntry->FileHandle, POLLIN, 0};
+            PublishIconThemeFrame(State, Item);
         }
         
-        poll(PollHandles, PollHandleCount, -1);
+        Item->Title = Item->DefaultTitle;
+        Item->Status = "Active";
+        Item->ToolTipTitle = Item->DefaultTitle;
+        Item->ToolTipDescription = "";
+        
+        InitTrayMenu(Item, Options);
+    }
+    
+    State->EpollHandle = epoll_create1(EPOLL_CLOEXEC);
+    
+    State->TimerSource.Type = EventSource_Timer;
+    State->TimerSource.FileHandle = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    RegisterEventSource(State, &State->TimerSource, EPOLLIN);
+    
+    State->Embedded = Options->Embedded;
+    if(State->Embedded)
+    {
+        submission_queue *Queue = PushStructAligned(&State->PermanentArena, submission_queue);
+        InitRing(&Queue->Submissions, PushArray(&State->PermanentArena, submission, SubmissionRingCapacity),
+                 sizeof(submission), SubmissionRingCapacity);
+        InitRing(&Queue->FreeFrames, PushArray(&State->PermanentArena, icon_frame *, LentFrameBudget),
+                 sizeof(icon_frame *), LentFrameBudget);
+        
+        Queue->Source.Type = EventSource_Submission;
+        Queue->Source.FileHandle = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        RegisterEventSource(State, &Queue->Source, EPOLLIN);
+        
+        State->Submissions = Queue;
+        LendFreeFrames(State);
+    }
+    else
+    {
+        // NOTE(trayge): SIGUSR1 dumps stats to stderr, SIGTERM and SIGINT end the loop so the
+        // icon theme is removed and profiling builds get to write their profiles. They are
+        // blocked and read through a signalfd so all of this happens on the loop, never inside
+        // a handler.
+        sigset_t SignalMask;
+        sigemptyset(&SignalMask);
+        sigaddset(&SignalMask, SIGUSR1);
+        sigaddset(&SignalMask, SIGTERM);
+        sigaddset(&SignalMask, SIGINT);
+        sigprocmask(SIG_BLOCK, &SignalMask, 0);
         
-        if(PollHandles[0].revents & POLLIN)
+        State->SignalSource.Type = EventSource_Signal;
+        State->SignalSource.FileHandle = signalfd(-1, &SignalMask, SFD_NONBLOCK | SFD_CLOEXEC);
+        RegisterEventSource(State, &State->SignalSource, EPOLLIN);
+    }
+    
+    // NOTE(trayge): Workers start after the signal mask is in place so they inherit it and
+    // SIGTERM always lands on the signalfd.
+    if(!State->Embedded && Options->RenderThreadCount)
+    {
+        if(!InitRenderPool(State, Options->RenderThreadCount))
         {
-            u64 Dummy;
-            WrappedRead(TimerHandle, &Dummy, sizeof(Dummy));
-            
-            DBusMessage *Message = dbus_message_new_signal("/StatusNotifierItem", "org.kde.StatusNotifierItem", "NewIcon");
-            dbus_connection_send(State.Connection, Message, 0);
-            dbus_message_unref(Message);
+            fprintf(stderr, "Could not start render threads\n");
+            return false;
         }
+    }
+    
+    // NOTE(trayge): The shared connection would be used by anything else in an embedding
+    // application, so embedded instances keep theirs private.
+    State->Connection = State->Embedded ? dbus_bus_get_private(DBUS_BUS_SESSION, 0) : dbus_bus_get(DBUS_BUS_SESSION, 0);
+    if(!State->Connection)
+    {
+        fprintf(stderr, "Could not connect to the session bus\n");
+        return false;
+    }
+    dbus_connection_set_exit_on_disconnect(State->Connection, !State->Embedded);
+    
+    State->UniqueName = dbus_bus_get_unique_name(State->Connection);
+    
+    dbus_connection_set_watch_functions(State->Connection, HandleDBusAddWatch, HandleDBusRemoveWatch, HandleDBusToggleWatch, State, 0);
+    dbus_connection_set_timeout_functions(State->Connection, HandleDBusAddTimeout, HandleDBusRemoveTimeout, HandleDBusToggleTimeout, State, 0);
+    
+    State->Callbacks.message_function = HandleDBusMessage;
+    dbus_connection_register_fallback(State->Connection, "/StatusNotifierItem", &State->Callbacks, State);
+    dbus_connection_register_fallback(State->Connection, "/MenuBar", &State->Callbacks, State);
+    dbus_connection_register_object_path(State->Connection, DebugObjectPath, &State->Callbacks, State);
+    
+    dbus_connection_add_filter(State->Connection, HandleBusSignal, State, 0);
+    dbus_bus_add_match(State->Connection, "type='signal',sender='org.freedesktop.DBus',interface='org.freedesktop.DBus',"
+                       "member='NameOwnerChanged',arg0='org.kde.StatusNotifierWatcher'", 0);
+    dbus_bus_add_match(State->Connection, "type='signal',interface='org.kde.StatusNotifierWatcher'", 0);
+    dbus_bus_add_match(State->Connection, "type='signal',sender='org.freedesktop.DBus',interface='org.freedesktop.DBus',"
+                       "member='NameOwnerChanged',arg0='org.freedesktop.ScreenSaver'", 0);
+    dbus_bus_add_match(State->Connection, "type='signal',sender='org.freedesktop.DBus',interface='org.freedesktop.DBus',"
+                       "member='NameOwnerChanged',arg0='org.gnome.SessionManager'", 0);
+    dbus_bus_add_match(State->Connection, "type='signal',interface='org.freedesktop.ScreenSaver',member='ActiveChanged'", 0);
+    dbus_bus_add_match(State->Connection, "type='signal',interface='org.gnome.SessionManager.Presence',member='StatusChanged'", 0);
+    
+    RegisterTrayItems(State);
+    QueryHostRegistered(State);
+    QuerySessionState(State);
+    
+    // NOTE(trayge): The scheduler stays idle until the watcher confirms a host is registered.
+    InitFrameScheduler(State, Options->MaxFramesPerSecond, Options->IdleFramesPerSecond, Options->Animated);
+    UpdateFrameSchedulerAnimation(State);
+    
+    PublishFrameDemand(State);
+    
+    return true;
+}
+
+function void
+RunTraygeLoop(trayge_state *State)
+{
+    State->Running = true;
+    while(State->Running)
+    {
+        struct epoll_event Events[64];
+        s32 EventCount = epoll_wait(State->EpollHandle, Events, ArrayCount(Events), -1);
         
-        for(u32 PollIndex = 1;
-            PollIndex < PollHandleCount;
-            ++PollIndex)
+        ResetArena(&State->TransientArena);
+        
+        AtomicAddU64(&State->Stats->Counters[StatsCounter_Wakeups], 1);
+        UpdateWakeupRate(State->Stats, GetMonotonicTime());
+        
+        for(s32 EventIndex = 0;
+            EventIndex < EventCount;
+            ++EventIndex)
         {
-            struct pollfd *PollEntry = PollHandles + PollIndex;
+            struct epoll_event *Event = Events + EventIndex;
+            event_source *Source = Event->data.ptr;
             
-            b32 Found = false;
-            
-            for(dbus_watch_entry *WatchEntry = State.WatchSentinel.Next;
-                !Found && WatchEntry != &State.WatchSentinel;
-                WatchEntry = WatchEntry->Next)
+            if(!Source->Retired)
             {
-                if(PollEntry->fd == WatchEntry->FileHandle)
+                switch(Source->Type)
                 {
-                    Found = true;
-                    
-                    if(PollEntry->revents)
+                    case EventSource_Timer:
                     {
-                        u32 WatchFlags = 0;
+                        u64 Dummy;
+                        WrappedRead(Source->FileHandle, &Dummy, sizeof(Dummy));
                         
-                        if(PollEntry->revents & POLLIN)
-                        {
-                            WatchFlags |= DBUS_WATCH_READABLE;
-                        }
-                        
-                        if(PollEntry->revents & POLLOUT)
-                        {
-                            WatchFlags |= DBUS_WATCH_WRITABLE;
-                        }
+                        u64 Now = GetMonotonicTime();
                         
-                        if(PollEntry->revents & POLLERR)
+                        timer_entry *Timer = 0;
+                        while((Timer = PeekTimer(&State->Timers)) && Timer->Deadline <= Now)
                         {
-                            WatchFlags |= DBUS_WATCH_ERROR;
+                            if(Timer->Interval)
+                            {
+                                u64 Deadline = Timer->Deadline + Timer->Interval;
+                                if(Deadline <= Now)
+                                {
+                                    Deadline = Now + Timer->Interval;
+                                }
+                                
+                                ScheduleTimer(&State->Timers, Timer, Deadline);
+                            }
+                            else
+                            {
+                                UnscheduleTimer(&State->Timers, Timer);
+                            }
+                            
+                            if(Timer->Type == Timer_Frame)
+                            {
+                                if(AdvanceFrame(State))
+                                {
+                                    for(u32 ItemIndex = 0;
+                                        State->MenuChurnCount && ItemIndex < State->ItemCount;
+                                        ++ItemIndex)
+                                    {
+                                        ChurnTrayMenu(State, State->Items + ItemIndex);
+                                    }
+                                    
+                                    if(State->RenderPool)
+                                    {
+                                        TickRenderPool(State);
+                                    }
+                                    else
+                                    {
+                                        RenderTrayItemFrames(State);
+                                    }
+                                }
+                            }
+                            else
+                            {
+                                dbus_timeout_handle(Timer->TimeoutHandle);
+                            }
                         }
                         
-                        if(PollEntry->revents & POLLHUP)
-                        {
-                            WatchFlags |= DBUS_WATCH_HANGUP;
-                        }
+                        State->ArmedDeadline = 0;
+                        ArmTimerSource(State);
+                    } break;
+                    
+                    case EventSource_Watch:
+                    {
+                        dbus_watch_entry *WatchEntry = (dbus_watch_entry *)Source;
+                        dbus_watch_handle(WatchEntry->WatchHandle, WatchFlagsFromEpoll(Event->events));
+                    } break;
+                    
+                    case EventSource_Submission:
+                    {
+                        u64 Dummy;
+                        WrappedRead(Source->FileHandle, &Dummy, sizeof(Dummy));
                         
-                        dbus_watch_handle(WatchEntry->WatchHandle, WatchFlags);
-                    }
+                        ProcessSubmissions(State);
+                    } break;
                     
-                    break;
-                }
-            }
-            
-            for(dbus_timeout_entry *TimeoutEntry = State.TimeoutSentinel.Next;
-                !Found && TimeoutEntry != &State.TimeoutSentinel;
-                TimeoutEntry = TimeoutEntry->Next)
-            {
-                if(PollEntry->fd == TimeoutEntry->FileHandle)
-                {
-                    Found = true;
+                    case EventSource_RenderDone:
+                    {
+                        u64 Dummy;
+                        WrappedRead(Source->FileHandle, &Dummy, sizeof(Dummy));
+                        
+                        HandleRenderDone(State);
+                    } break;
                     
-                    if(PollEntry->revents & POLLIN)
+                    case EventSource_Signal:
                     {
-                        u64 TriggerCount = 0;
-                        if(WrappedRead(TimeoutEntry->FileHandle, &TriggerCount, sizeof(TriggerCount)).Count == sizeof(TriggerCount))
+                        struct signalfd_siginfo SignalInfo;
+                        while(WrappedRead(Source->FileHandle, &SignalInfo, sizeof(SignalInfo)).Count == sizeof(SignalInfo))
                         {
-                            for(u64 TriggerIndex = 0;
-                                TriggerIndex < TriggerCount;
-                                ++TriggerIndex)
+                            if(SignalInfo.ssi_signo == SIGUSR1)
                             {
-                                dbus_timeout_handle(TimeoutEntry->TimeoutHandle);
+                                DumpStats(State, stderr);
+                            }
+                            else
+                            {
+                                State->Running = false;
                             }
                         }
-                    }
+                    } break;
                     
-                    break;
+                    InvalidDefaultCase;
+                }
+            }
+        }
+        
+        FreeRetiredEventSources(State);
+        
+        while(dbus_connection_get_dispatch_status(State->Connection) != DBUS_DISPATCH_COMPLETE)
+        {
+            dbus_connection_dispatch(State->Connection);
+        }
+        
+        ResumeDeferredFetches(State);
+        FlushChangeSignals(State);
+        
+        FlushLogRing(&State->Log, STDERR_FILENO);
+    }
+}
+
+function void
+ShutdownTrayge(trayge_state *State)
+{
+    if(State->RenderPool)
+    {
+        StopRenderPool(State);
+    }
+    
+    if(State->Log.Enabled)
+    {
+        DumpStats(State, stderr);
+    }
+    
+    if(State->TraceFile)
+    {
+        fclose(State->TraceFile);
+    }
+    
+    if(State->IconNameMode)
+    {
+        RemoveIconTheme(State);
+    }
+    
+    // NOTE(trayge): A standalone trayge exits right after this and leaves the rest to the
+    // kernel. An embedded one lives on inside an application, so it gives everything back.
+    if(State->Embedded)
+    {
+        if(State->Connection)
+        {
+            dbus_connection_close(State->Connection);
+            dbus_connection_unref(State->Connection);
+        }
+        
+        for(u32 ItemIndex = 0;
+            ItemIndex < State->ItemCount;
+            ++ItemIndex)
+        {
+            tray_item *Item = State->Items + ItemIndex;
+            
+            if(Item->GetAllReply.Template)
+            {
+                dbus_message_unref(Item->GetAllReply.Template);
+            }
+            for(u32 PropertyIndex = 0;
+                PropertyIndex < DBusTrayProperty_Count;
+                ++PropertyIndex)
+            {
+                if(Item->PropertyReplies[PropertyIndex].Template)
+                {
+                    dbus_message_unref(Item->PropertyReplies[PropertyIndex].Template);
                 }
             }
+            
+            FreeMenuTree(&Item->Menu);
+        }
+        
+        for(u32 ConsumerIndex = 0;
+            State->Consumers && ConsumerIndex < MaxConsumers;
+            ++ConsumerIndex)
+        {
+            consumer *Consumer = State->Consumers + ConsumerIndex;
+            for(u32 FetchIndex = 0;
+                FetchIndex < Consumer->DeferredCount;
+                ++FetchIndex)
+            {
+                dbus_message_unref(Consumer->Deferred[FetchIndex].Message);
+            }
+            Consumer->DeferredCount = 0;
         }
         
-        while(dbus_connection_get_dispatch_status(State.Connection) != DBUS_DISPATCH_COMPLETE)
+        FreeTimerHeap(&State->Timers);
+        
+        if(State->Submissions)
+        {
+            close(State->Submissions->Source.FileHandle);
+        }
+        if(State->TimerSource.FileHandle > 0)
         {
-            dbus_connection_dispatch(State.Connection);
+            close(State->TimerSource.FileHandle);
         }
+        if(State->EpollHandle > 0)
+        {
+            close(State->EpollHandle);
+        }
+        
+        dbus_message_free_data_slot(&State->ReplySlot);
+        FreeArena(&State->TransientArena);
+        FreeArena(&State->PermanentArena);
+    }
+}
+
+#if !TRAYGE_LIBRARY
+int
+main(int ArgumentCount, char **Arguments)
+{
+    // NOTE(trayge): libdbus mallocs every message, and pixmap replies are a few hundred
+    // kilobytes. Above glibc's default threshold each of them would be a fresh mmap that is
+    // faulted in page by page and unmapped again, which costs more than building the reply.
+    mallopt(M_MMAP_THRESHOLD, 4*1024*1024);
+    mallopt(M_TRIM_THRESHOLD, 16*1024*1024);
+    
+    trayge_state State = {};
+    State.ConsumerQueueLimit = 1024*1024;
+    
+    trayge_options Options = {};
+    Options.IconSizeMask = IconSizeAll;
+    Options.MaxFramesPerSecond = 120;
+    Options.IdleFramesPerSecond = 1;
+    Options.Animated = true;
+    Options.MaxPixelKernelLevel = PixelKernel_Count - 1;
+    
+    u64 ItemCount = 1;
+    u64 RenderThreadCount = 0;
+    b32 RenderThreadsGiven = false;
+    u64 MenuChurnCount = 0;
+    
+    for(s32 ArgumentIndex = 1;
+        ArgumentIndex < ArgumentCount;
+        ++ArgumentIndex)
+    {
+        string Argument = Str(Arguments[ArgumentIndex]);
         
-        if(dbus_connection_has_messages_to_send(State.Connection))
+        if(StringsAreEqual(Argument, StrLit("--icon-sizes"), 0) && ArgumentIndex + 1 < ArgumentCount &&
+           ParseIconSizeList(Str(Arguments[ArgumentIndex + 1]), &Options.IconSizeMask))
+        {
+            ++ArgumentIndex;
+        }
+        else if(StringsAreEqual(Argument, StrLit("--icon-name-sizes"), 0) && ArgumentIndex + 1 < ArgumentCount &&
+                ParseIconSizeList(Str(Arguments[ArgumentIndex + 1]), &Options.IconThemeSizeMask))
+        {
+            ++ArgumentIndex;
+        }
+        else if(StringsAreEqual(Argument, StrLit("--max-fps"), 0) && ArgumentIndex + 1 < ArgumentCount &&
+                ParseU64(Str(Arguments[ArgumentIndex + 1]), &Options.MaxFramesPerSecond) && Options.MaxFramesPerSecond)
+        {
+            ++ArgumentIndex;
+        }
+        else if(StringsAreEqual(Argument, StrLit("--idle-fps"), 0) && ArgumentIndex + 1 < ArgumentCount &&
+                ParseU64(Str(Arguments[ArgumentIndex + 1]), &Options.IdleFramesPerSecond))
+        {
+            ++ArgumentIndex;
+        }
+        else if(StringsAreEqual(Argument, StrLit("--items"), 0) && ArgumentIndex + 1 < ArgumentCount &&
+                ParseU64(Str(Arguments[ArgumentIndex + 1]), &ItemCount) && ItemCount && ItemCount <= 1024)
+        {
+            ++ArgumentIndex;
+        }
+        else if(StringsAreEqual(Argument, StrLit("--pixel-kernels"), 0) && ArgumentIndex + 1 < ArgumentCount &&
+                ParsePixelKernelLevel(Str(Arguments[ArgumentIndex + 1]), &Options.MaxPixelKernelLevel))
+        {
+            ++ArgumentIndex;
+        }
+        else if(StringsAreEqual(Argument, StrLit("--icon-name-mode"), 0))
+        {
+            State.IconNameMode = true;
+        }
+        else if(StringsAreEqual(Argument, StrLit("--static"), 0))
+        {
+            Options.Animated = false;
+        }
+        else if(StringsAreEqual(Argument, StrLit("--max-queued-bytes"), 0) && ArgumentIndex + 1 < ArgumentCount &&
+                ParseU64(Str(Arguments[ArgumentIndex + 1]), &State.ConsumerQueueLimit))
+        {
+            ++ArgumentIndex;
+        }
+        else if(StringsAreEqual(Argument, StrLit("--backpressure"), 0) && ArgumentIndex + 1 < ArgumentCount &&
+                ParseBackpressurePolicy(Str(Arguments[ArgumentIndex + 1]), &State.BackpressurePolicy))
+        {
+            ++ArgumentIndex;
+        }
+        else if(StringsAreEqual(Argument, StrLit("--render-threads"), 0) && ArgumentIndex + 1 < ArgumentCount &&
+                ParseU64(Str(Arguments[ArgumentIndex + 1]), &RenderThreadCount) && RenderThreadCount <= RenderWorkerMax)
+        {
+            ++ArgumentIndex;
+            RenderThreadsGiven = true;
+        }
+        else if(StringsAreEqual(Argument, StrLit("--menu-churn"), 0) && ArgumentIndex + 1 < ArgumentCount &&
+                ParseU64(Str(Arguments[ArgumentIndex + 1]), &MenuChurnCount) && MenuChurnCount <= 4096)
+        {
+            ++ArgumentIndex;
+        }
+        else if(StringsAreEqual(Argument, StrLit("--log"), 0))
+        {
+            Options.LogEnabled = true;
+        }
+        else if(StringsAreEqual(Argument, StrLit("--record"), 0) && ArgumentIndex + 1 < ArgumentCount)
+        {
+            Options.TracePath = Arguments[++ArgumentIndex];
+        }
+        else
         {
-            dbus_connection_flush(State.Connection);
+            fprintf(stderr, "Usage: %s [--icon-sizes 16,22,24,32,48,64,256] [--max-fps N] [--idle-fps N] [--items N] [--pixel-kernels scalar|sse2|avx2] [--icon-name-mode] [--icon-name-sizes 16,22,24,32,48,64] [--static] [--max-queued-bytes N] [--backpressure skip|lowres|pause] [--render-threads N] [--menu-churn N] [--log] [--record trace-file]\n", Arguments[0]);
+            return 1;
         }
     }
     
+    Options.ItemCount = (u32)ItemCount;
+    Options.MenuChurnCount = (u32)MenuChurnCount;
+    Options.RenderThreadCount = RenderThreadsGiven ? (u32)RenderThreadCount : DefaultRenderThreadCount((u32)ItemCount);
+    
+    if(!InitTrayge(&State, &Options))
+    {
+        return 1;
+    }
+    
+    RunTraygeLoop(&State);
+    ShutdownTrayge(&State);
+    
     return 0;
 }
+#endif
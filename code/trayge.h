@@ -1,58 +1,523 @@
+typedef enum event_source_type
+{
+    EventSource_Timer,
+    EventSource_Watch,
+    EventSource_Signal,
+    EventSource_Submission,
+    EventSource_RenderDone,
+} event_source_type;
+
+typedef struct event_source
+{
+    event_source_type Type;
+    s32 FileHandle;
+    
+    b32 Retired;
+    struct event_source *NextRetired;
+} event_source;
+
 typedef struct dbus_watch_entry
 {
-    struct dbus_watch_entry *Next;
-    struct dbus_watch_entry *Prev;
+    event_source Source;
     DBusWatch *WatchHandle;
-    s32 FileHandle;
-    s32 PollFlags;
 } dbus_watch_entry;
 
-typedef struct dbus_timeout_entry
+#define TrayPropertyList(X) \
+    X(Category,            "s",            None) \
+    X(Id,                  "s",            None) \
+    X(Title,               "s",            NewTitle) \
+    X(Status,              "s",            NewStatus) \
+    X(WindowId,            "i",            None) \
+    X(IconThemePath,       "s",            NewIcon) \
+    X(Menu,                "o",            NewMenu) \
+    X(ItemIsMenu,          "b",            None) \
+    X(IconName,            "s",            NewIcon) \
+    X(IconPixmap,          "a(iiay)",      NewIcon) \
+    X(OverlayIconName,     "s",            NewOverlayIcon) \
+    X(OverlayIconPixmap,   "a(iiay)",      NewOverlayIcon) \
+    X(AttentionIconName,   "s",            NewAttentionIcon) \
+    X(AttentionIconPixmap, "a(iiay)",      NewAttentionIcon) \
+    X(AttentionMovieName,  "s",            NewAttentionIcon) \
+    X(ToolTip,             "(sa(iiay)ss)", NewToolTip)
+
+#define TraySignalList(X) \
+    X(NewTitle) \
+    X(NewIcon) \
+    X(NewAttentionIcon) \
+    X(NewOverlayIcon) \
+    X(NewMenu) \
+    X(NewToolTip) \
+    X(NewStatus)
+
+#define DBusMethodList(X) \
+    X(PropertiesGet,                 "org.freedesktop.DBus.Properties", "Get") \
+    X(PropertiesGetAll,              "org.freedesktop.DBus.Properties", "GetAll") \
+    X(ItemProvideXdgActivationToken, "org.kde.StatusNotifierItem",      "ProvideXdgActivationToken") \
+    X(ItemContextMenu,               "org.kde.StatusNotifierItem",      "ContextMenu") \
+    X(ItemActivate,                  "org.kde.StatusNotifierItem",      "Activate") \
+    X(ItemSecondaryActivate,         "org.kde.StatusNotifierItem",      "SecondaryActivate") \
+    X(ItemScroll,                    "org.kde.StatusNotifierItem",      "Scroll") \
+    X(MenuGetLayout,                 "com.canonical.dbusmenu",          "GetLayout") \
+    X(MenuGetGroupProperties,        "com.canonical.dbusmenu",          "GetGroupProperties") \
+    X(MenuGetProperty,               "com.canonical.dbusmenu",          "GetProperty") \
+    X(MenuEvent,                     "com.canonical.dbusmenu",          "Event") \
+    X(MenuEventGroup,                "com.canonical.dbusmenu",          "EventGroup") \
+    X(MenuAboutToShow,               "com.canonical.dbusmenu",          "AboutToShow") \
+    X(MenuAboutToShowGroup,          "com.canonical.dbusmenu",          "AboutToShowGroup") \
+    X(DebugGetStats,                 "org.trayge.Debug",                "GetStats") \
+    X(DebugGetMethodStats,           "org.trayge.Debug",                "GetMethodStats") \
+    X(DebugGetLog,                   "org.trayge.Debug",                "GetLog") \
+    X(DebugSetLogging,               "org.trayge.Debug",                "SetLogging")
+
+#define StatsCounterList(X) \
+    X(Wakeups,               "wakeups") \
+    X(MessagesReceived,      "messages_received") \
+    X(MethodCalls,           "method_calls") \
+    X(RepliesSent,           "replies_sent") \
+    X(SignalsEmitted,        "signals_emitted") \
+    X(SignalFlushesDeferred, "signal_flushes_deferred") \
+    X(BytesMarshalled,       "bytes_marshalled") \
+    X(BytesSent,             "bytes_sent") \
+    X(FramesRendered,        "frames_rendered") \
+    X(ThrottledReplies,      "throttled_replies") \
+    X(PeakOutgoingBytes,     "peak_outgoing_bytes") \
+    X(RenderDeadlineMisses,  "render_deadline_misses") \
+    X(RenderJobsStolen,      "render_jobs_stolen")
+
+#define DBusMenuPropertyList(X) \
+    X(Version,       "u") \
+    X(TextDirection, "s") \
+    X(Status,        "s") \
+    X(IconThemePath, "as")
+
+typedef enum dbus_tray_property_type
 {
-    struct dbus_timeout_entry *Next;
-    struct dbus_timeout_entry *Prev;
-    DBusTimeout *TimeoutHandle;
-    s32 FileHandle;
-} dbus_timeout_entry;
+    DBusTrayProperty_Unhandled,
+
+#define X(Name, Signature, Signal) DBusTrayProperty_##Name,
+    TrayPropertyList(X)
+#undef X
+    
+    DBusTrayProperty_Count,
+} dbus_tray_property_type;
+
+typedef enum tray_signal_type
+{
+    TraySignal_None,
+
+#define X(Name) TraySignal_##Name,
+    TraySignalList(X)
+#undef X
+    
+    TraySignal_Count,
+} tray_signal_type;
+
+typedef enum dbus_menu_property_type
+{
+    DBusMenuProperty_Unhandled,
+
+#define X(Name, Signature) DBusMenuProperty_##Name,
+    DBusMenuPropertyList(X)
+#undef X
+    
+    DBusMenuProperty_Count,
+} dbus_menu_property_type;
+
+typedef enum tray_menu_action
+{
+    TrayMenuAction_None,
+    TrayMenuAction_Animate,
+    TrayMenuAction_Attention,
+    TrayMenuAction_Quit,
+} tray_menu_action;
+
+typedef enum dbus_method_type
+{
+    DBusMethod_Unhandled,
+
+#define X(Name, Interface, Member) DBusMethod_##Name,
+    DBusMethodList(X)
+#undef X
+    
+    DBusMethod_Count,
+} dbus_method_type;
+
+typedef enum stats_counter_type
+{
+#define X(Name, Key) StatsCounter_##Name,
+    StatsCounterList(X)
+#undef X
+    
+    StatsCounter_Count,
+} stats_counter_type;
+
+#define DebugObjectPath "/org/trayge/Debug"
+
+// NOTE(trayge): Change signals wait in the items' version vectors and dirty lists until
+// libdbus has less than this much queued for the socket.
+#define OutboundSignalQueueLimit (64*1024)
+#define LogRingSize (64*1024)
+
+typedef struct trayge_stats
+{
+    u64 StartTime;
+    u64 Counters[StatsCounter_Count];
+    
+    // NOTE(trayge): Indexed by dbus_method_type; DBusMethod_Unhandled collects every call that
+    // did not match a known interface and member.
+    stats_histogram MethodLatency[DBusMethod_Count];
+    
+    // NOTE(trayge): Wall time from starting a frame's render to its last image being done,
+    // whether it ran inline or on the render pool.
+    stats_histogram FrameRenderTime;
+    
+    u64 RateTime;
+    u64 RateWakeups;
+    f64 WakeupsPerSecond;
+} trayge_stats;
+
+#define AnimationStepsPerSecond 120
+
+// NOTE(trayge): Idle sessions animate at IdleFramesPerSecond at most, locked sessions not at
+// all. Locked wins when both the screen saver and the session presence report in.
+typedef enum session_state
+{
+    Session_Active,
+    Session_Idle,
+    Session_Locked,
+} session_state;
+
+typedef struct frame_scheduler
+{
+    timer_entry Timer;
+    
+    b32 Animated;
+    session_state Session;
+    
+    u64 StartTime;
+    u64 MaxFramesPerSecond;
+    u64 MinFramesPerSecond;
+    u64 IdleFramesPerSecond;
+    u64 FramesPerSecond;
+    
+    u64 AnimationStep;
+    
+    b32 AwaitingFetch;
+    u64 EmitTime;
+    u64 FetchLatency;
+    u64 LaggedFrames;
+} frame_scheduler;
+
+typedef struct reply_cache
+{
+    DBusMessage *Template;
+    u64 Size;
+    u64 Versions[DBusTrayProperty_Count];
+} reply_cache;
+
+typedef struct property_reply_cache
+{
+    DBusMessage *Template;
+    u64 Size;
+    u64 Version;
+    icon_frame *Frame;
+} property_reply_cache;
+
+#define TrayStringMax 256
+
+typedef enum tray_string_type
+{
+    TrayString_Title,
+    TrayString_Status,
+    TrayString_ToolTipTitle,
+    TrayString_ToolTipDescription,
+    
+    TrayString_Count,
+} tray_string_type;
+
+typedef struct tray_item
+{
+    u32 Index;
+    
+    char ObjectPath[64];
+    char MenuPath[64];
+    char Id[64];
+    char DefaultTitle[64];
+    
+    b32 Animated;
+    icon_cache Icon;
+    
+    char *IconThemePath;
+    char IconName[96];
+    u64 PublishedIconVersion;
+    u64 PreviousIconVersion;
+    b32 IconThemeLinkable;
+    
+    char *Title;
+    char *Status;
+    char *ToolTipTitle;
+    char *ToolTipDescription;
+    
+    // NOTE(trayge): Strings set by an embedding application are copied here; the pointers
+    // above refer to this storage from then on.
+    char StringStorage[TrayString_Count][TrayStringMax];
+    
+    u64 PropertyVersions[DBusTrayProperty_Count];
+    u64 SignalledVersions[DBusTrayProperty_Count];
+    
+    reply_cache GetAllReply;
+    property_reply_cache PropertyReplies[DBusTrayProperty_Count];
+    
+    menu_tree Menu;
+    s32 AnimateMenuItem;
+    s32 AttentionMenuItem;
+    s32 RecentMenuItem;
+    u64 MenuChurnStep;
+} tray_item;
+
+typedef enum backpressure_policy
+{
+    Backpressure_Skip,
+    Backpressure_LowRes,
+    Backpressure_Pause,
+    
+    Backpressure_Count,
+} backpressure_policy;
+
+#define MaxConsumers 64
+#define MaxDeferredFetches 32
+#define LowResIconSizeMax 32
+#define MessageSizeSampleInterval 16
+#define DefaultIconThemeSizeMask (IconSizeAll & ~(1u << IconSize_256))
+
+typedef struct deferred_fetch
+{
+    DBusMessage *Message;
+    tray_item *Item;
+    b32 GetAll;
+} deferred_fetch;
+
+// NOTE(trayge): A consumer is a peer we send replies to, keyed by unique name. QueuedBytes
+// counts reply bytes handed to libdbus that it has not written out yet.
+typedef struct consumer
+{
+    u32 Hash;
+    char Name[64];
+    
+    u64 QueuedBytes;
+    u64 PeakQueuedBytes;
+    u64 ThrottledCount;
+    
+    u32 DeferredCount;
+    deferred_fetch Deferred[MaxDeferredFetches];
+} consumer;
+
+typedef struct reply_record
+{
+    struct trayge_state *State;
+    consumer *Consumer;
+    u64 Size;
+} reply_record;
+
+// NOTE(trayge): Running size of the messages SendMessage has to guess at, one per message type.
+typedef struct message_size_estimate
+{
+    u64 Size;
+    u32 SendsSinceSample;
+} message_size_estimate;
+
+typedef enum submission_type
+{
+    Submission_Frame,
+    Submission_String,
+    Submission_Quit,
+} submission_type;
+
+typedef struct submission
+{
+    submission_type Type;
+    u32 ItemIndex;
+    tray_string_type String;
+    icon_frame *Frame;
+    char Value[TrayStringMax];
+} submission;
+
+#define SubmissionRingCapacity 64
+#define LentFrameBudget 8
+
+// NOTE(trayge): Only present when trayge is embedded as a library. The application thread
+// produces submissions and takes empty frames; the loop thread consumes submissions, wakes on
+// the eventfd in Source, and keeps up to LentFrameBudget empty frames on loan to the
+// application. WantsFrames is false while nobody could see a new frame.
+typedef struct submission_queue
+{
+    event_source Source;
+    spsc_ring Submissions;
+    spsc_ring FreeFrames;
+    u32 LentFrameCount;
+    b32 WantsFrames;
+} submission_queue;
+
+typedef struct render_job
+{
+    icon_image Image;
+    s32 XOffset;
+    s32 YOffset;
+} render_job;
+
+// NOTE(trayge): Each worker owns one queue of the current batch and claims jobs from the front
+// with an atomic cursor. A worker that runs dry claims from the other queues through the same
+// cursor, so stealing needs no extra synchronization and no job is ever handed out twice.
+typedef struct render_queue
+{
+    __attribute__((aligned(64))) u32 Next;
+    u32 End;
+    render_job *Jobs;
+} render_queue;
+
+#define RenderWorkerMax 16
+#define RenderPoolMinItems 8
+
+typedef struct render_worker
+{
+    struct render_pool *Pool;
+    u32 Index;
+    pthread_t Thread;
+} render_worker;
+
+// NOTE(trayge): Renders the next frame for every animated item while the loop waits for its
+// deadline. Only the loop thread touches frames, the pool and the batch bookkeeping; workers
+// only write pixels into frames the loop acquired for them. A batch starts with BusyWorkers at
+// WorkerCount; the worker that takes it to zero knows every queue is empty and every other
+// worker is done, so the whole batch is rendered and it signals Source.
+typedef struct render_pool
+{
+    event_source Source;
+    trayge_stats *Stats;
+    
+    u32 WorkerCount;
+    render_worker Workers[RenderWorkerMax];
+    render_queue Queues[RenderWorkerMax];
+    u32 QueueCapacity;
+    
+    pthread_mutex_t Mutex;
+    pthread_cond_t BatchStarted;
+    u64 Generation;
+    b32 Quit;
+    
+    u32 BusyWorkers;
+    u64 StartTime;
+    u64 EndTime;
+    
+    b32 InFlight;
+    b32 Due;
+    u64 AnimationStep;
+    icon_frame **Frames;
+} render_pool;
+
+typedef struct trayge_options
+{
+    u32 IconSizeMask;
+    u64 MaxFramesPerSecond;
+    u64 IdleFramesPerSecond;
+    b32 Animated;
+    u32 ItemCount;
+    pixel_kernel_level MaxPixelKernelLevel;
+    
+    // NOTE(trayge): Sizes written as PNG files in icon-name mode; zero means the default.
+    u32 IconThemeSizeMask;
+    
+    // NOTE(trayge): Zero renders on the loop thread at each frame tick. Without --render-threads
+    // trayge picks a count from the item count and the cores online.
+    u32 RenderThreadCount;
+    
+    // NOTE(trayge): Entries kept in the demo menu's Recent submenu, which turns over one entry
+    // per frame; zero leaves it out.
+    u32 MenuChurnCount;
+    
+    char *Id;
+    char *Title;
+    
+    b32 LogEnabled;
+    char *TracePath;
+    
+    // NOTE(trayge): An embedded instance runs on its own thread with a private connection and
+    // leaves the process's signals alone.
+    b32 Embedded;
+} trayge_options;
 
 typedef struct trayge_state
 {
+    b32 Running;
+    
+    // NOTE(trayge): TransientArena is reset at the top of every loop iteration, so it backs
+    // scratch memory for both the frame tick and message dispatch of that iteration.
+    memory_arena PermanentArena;
+    memory_arena TransientArena;
+    memory_pool WatchPool;
+    memory_pool TimerPool;
+    memory_pool ReplyRecordPool;
+    
     DBusConnection *Connection;
     const char *UniqueName;
     
     DBusObjectPathVTable Callbacks;
     
-    u32 WatchCount;
-    dbus_watch_entry WatchSentinel;
+    s32 EpollHandle;
+    event_source *RetiredSources;
     
+    u32 WatchCount;
     u32 TimeoutCount;
-    dbus_timeout_entry TimeoutSentinel;
+    
+    event_source TimerSource;
+    event_source SignalSource;
+    timer_heap Timers;
+    u64 ArmedDeadline;
+    
+    frame_scheduler Scheduler;
+    
+    trayge_stats *Stats;
+    log_ring Log;
+    
+    FILE *TraceFile;
+    u64 TraceStartTime;
     
     s32 XOffset;
     s32 YOffset;
+    
+    icon_frame_pool FramePool;
+    u32 IconSizeMask;
+    
+    b32 IconNameMode;
+    u32 IconThemeSizeMask;
+    
+    u32 MenuChurnCount;
+    char IconThemePath[256];
+    
+    u32 ItemCount;
+    tray_item *Items;
+    
+    b32 WatcherPresent;
+    b32 HostPresent;
+    
+    b32 ScreenSaverActive;
+    b32 PresenceIdle;
+    
+    dbus_int32_t ReplySlot;
+    backpressure_policy BackpressurePolicy;
+    u64 ConsumerQueueLimit;
+    consumer *Consumers;
+    
+    message_size_estimate SizeEstimates[DBUS_NUM_MESSAGE_TYPES];
+    
+    b32 Embedded;
+    submission_queue *Submissions;
+    
+    render_pool *RenderPool;
 } trayge_state;
 
 typedef struct read_result
 {
     b32 IsValid;
     u64 Count;
-} read_result;
-
-typedef enum dbus_tray_property_type
-{
-    DBusTrayProperty_Unhandled,
-    
-    DBusTrayProperty_Category,
-    DBusTrayProperty_Id,
-    DBusTrayProperty_Title,
-    DBusTrayProperty_Status,
-    DBusTrayProperty_IconThemePath,
-    DBusTrayProperty_Menu,
-    DBusTrayProperty_ItemIsMenu,
-    DBusTrayProperty_IconName,
-    DBusTrayProperty_IconPixmap,
-    DBusTrayProperty_AttentionIconName,
-    DBusTrayProperty_AttentionIconPixmap,
-    
-    DBusTrayProperty_Count,
-} dbus_tray_property_type;
\ No newline at end of file
+} read_result;
\ No newline at end of file
@@ -0,0 +1,742 @@
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include <dbus/dbus.h>
+
+#include "trayge_types.h"
+#include "trayge_string.h"
+#include "trayge_stats.h"
+#include "trayge_process.h"
+
+#define BenchMaxHosts 64
+#define GreedyFetchCount 16
+#define BenchMaxMenuIds 8192
+
+typedef struct bench_host
+{
+    u32 Index;
+    u32 FetchCount;
+    DBusConnection *Connection;
+    char Name[96];
+} bench_host;
+
+// NOTE(trayge): With --menu the first host follows the first item's dbusmenu the way a panel
+// does: it refetches the layout on LayoutUpdated and applies ItemsPropertiesUpdated to the ids
+// it has. An update naming an id missing from an up-to-date layout is one a real host would
+// drop or apply to the wrong entry.
+typedef struct bench_menu
+{
+    b32 Enabled;
+    b32 HaveLayout;
+    b32 LayoutPending;
+    b32 LayoutStale;
+    
+    u8 KnownIds[BenchMaxMenuIds];
+    u32 EntryCount;
+    
+    u64 LayoutsFetched;
+    u64 LayoutSignals;
+    u64 PropertySignals;
+    u64 UnknownIdUpdates;
+    u32 LargestEntryCount;
+    s32 HighestId;
+} bench_menu;
+
+typedef struct bench_state
+{
+    b32 Measuring;
+    b32 FetchAll;
+    bench_menu Menu;
+    
+    DBusConnection *Watcher;
+    b32 SessionLocked;
+    b32 SessionIdle;
+    b32 HostRegistered;
+    u32 ItemCount;
+    char TraygeName[64];
+    
+    u32 HostCount;
+    bench_host Hosts[BenchMaxHosts];
+    
+    stats_histogram Latency;
+    u64 SignalsReceived;
+    u64 MessagesReceived;
+    u64 BytesReceived;
+    u64 FramesReceived;
+    u64 FetchErrors;
+} bench_state;
+
+typedef struct bench_fetch
+{
+    bench_state *State;
+    u64 SignalTime;
+} bench_fetch;
+
+function void
+NoteMessageReceived(bench_state *State, DBusMessage *Message)
+{
+    if(State->Measuring)
+    {
+        ++State->MessagesReceived;
+        State->BytesReceived += MessageSize(Message);
+    }
+}
+
+//
+// NOTE(trayge): Stub org.kde.StatusNotifierWatcher. It accepts every registration and only
+// tracks enough to answer the properties a StatusNotifierItem may ask about.
+//
+
+function void
+EmitWatcherSignal(bench_state *State, char *Member, const char *Service)
+{
+    DBusMessage *Signal = dbus_message_new_signal("/StatusNotifierWatcher", "org.kde.StatusNotifierWatcher", Member);
+    if(Service)
+    {
+        dbus_message_append_args(Signal, DBUS_TYPE_STRING, &Service, DBUS_TYPE_INVALID);
+    }
+    
+    dbus_connection_send(State->Watcher, Signal, 0);
+    dbus_message_unref(Signal);
+}
+
+function b32
+AppendWatcherProperty(bench_state *State, string Name, DBusMessageIter *Parent)
+{
+    b32 Result = true;
+    
+    DBusMessageIter Variant = {};
+    if(StringsAreEqual(Name, StrLit("IsStatusNotifierHostRegistered"), 0))
+    {
+        dbus_bool_t Value = (State->HostRegistered != 0);
+        DeferLoop(dbus_message_iter_open_container(Parent, DBUS_TYPE_VARIANT, "b", &Variant),
+                  dbus_message_iter_close_container(Parent, &Variant))
+        {
+            dbus_message_iter_append_basic(&Variant, DBUS_TYPE_BOOLEAN, &Value);
+        }
+    }
+    else if(StringsAreEqual(Name, StrLit("ProtocolVersion"), 0))
+    {
+        s32 Value = 0;
+        DeferLoop(dbus_message_iter_open_container(Parent, DBUS_TYPE_VARIANT, "i", &Variant),
+                  dbus_message_iter_close_container(Parent, &Variant))
+        {
+            dbus_message_iter_append_basic(&Variant, DBUS_TYPE_INT32, &Value);
+        }
+    }
+    else if(StringsAreEqual(Name, StrLit("status"), 0))
+    {
+        // NOTE(trayge): org.gnome.SessionManager.Presence, served only with --session.
+        u32 Value = State->SessionIdle ? 3 : 0;
+        DeferLoop(dbus_message_iter_open_container(Parent, DBUS_TYPE_VARIANT, "u", &Variant),
+                  dbus_message_iter_close_container(Parent, &Variant))
+        {
+            dbus_message_iter_append_basic(&Variant, DBUS_TYPE_UINT32, &Value);
+        }
+    }
+    else if(StringsAreEqual(Name, StrLit("RegisteredStatusNotifierItems"), 0))
+    {
+        DeferLoop(dbus_message_iter_open_container(Parent, DBUS_TYPE_VARIANT, "as", &Variant),
+                  dbus_message_iter_close_container(Parent, &Variant))
+        {
+            DBusMessageIter Items = {};
+            dbus_message_iter_open_container(&Variant, DBUS_TYPE_ARRAY, "s", &Items);
+            dbus_message_iter_close_container(&Variant, &Items);
+        }
+    }
+    else
+    {
+        Result = false;
+    }
+    
+    return Result;
+}
+
+function DBusHandlerResult
+HandleWatcherMessage(DBusConnection *Connection, DBusMessage *Message, void *UserData)
+{
+    bench_state *State = UserData;
+    
+    DBusHandlerResult Result = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    DBusMessage *Response = 0;
+    
+    if(dbus_message_is_method_call(Message, "org.kde.StatusNotifierWatcher", "RegisterStatusNotifierItem"))
+    {
+        char *Service = 0;
+        dbus_message_get_args(Message, 0, DBUS_TYPE_STRING, &Service, DBUS_TYPE_INVALID);
+        
+        const char *Sender = dbus_message_get_sender(Message);
+        if(Sender && !State->TraygeName[0])
+        {
+            snprintf(State->TraygeName, sizeof(State->TraygeName), "%s", Sender);
+        }
+        
+        ++State->ItemCount;
+        Response = dbus_message_new_method_return(Message);
+        EmitWatcherSignal(State, "StatusNotifierItemRegistered", Service);
+    }
+    else if(dbus_message_is_method_call(Message, "org.kde.StatusNotifierWatcher", "RegisterStatusNotifierHost"))
+    {
+        State->HostRegistered = true;
+        Response = dbus_message_new_method_return(Message);
+        EmitWatcherSignal(State, "StatusNotifierHostRegistered", 0);
+    }
+    else if(dbus_message_is_method_call(Message, "org.freedesktop.ScreenSaver", "GetActive"))
+    {
+        dbus_bool_t Active = (State->SessionLocked != 0);
+        Response = dbus_message_new_method_return(Message);
+        dbus_message_append_args(Response, DBUS_TYPE_BOOLEAN, &Active, DBUS_TYPE_INVALID);
+    }
+    else if(dbus_message_is_method_call(Message, "org.freedesktop.DBus.Properties", "Get"))
+    {
+        char *Interface = 0;
+        char *Name = 0;
+        dbus_message_get_args(Message, 0, DBUS_TYPE_STRING, &Interface, DBUS_TYPE_STRING, &Name, DBUS_TYPE_INVALID);
+        
+        Response = dbus_message_new_method_return(Message);
+        
+        DBusMessageIter ResponseArgs = {};
+        dbus_message_iter_init_append(Response, &ResponseArgs);
+        if(!AppendWatcherProperty(State, Str(Name), &ResponseArgs))
+        {
+            dbus_message_unref(Response);
+            Response = dbus_message_new_error(Message, DBUS_ERROR_UNKNOWN_PROPERTY, "Unknown property");
+        }
+    }
+    else if(dbus_message_is_method_call(Message, "org.freedesktop.DBus.Properties", "GetAll"))
+    {
+        Response = dbus_message_new_method_return(Message);
+        
+        DBusMessageIter ResponseArgs = {};
+        dbus_message_iter_init_append(Response, &ResponseArgs);
+        
+        DBusMessageIter PropertiesArray = {};
+        DeferLoop(dbus_message_iter_open_container(&ResponseArgs, DBUS_TYPE_ARRAY, "{sv}", &PropertiesArray),
+                  dbus_message_iter_close_container(&ResponseArgs, &PropertiesArray))
+        {
+            char *Names[] = {"IsStatusNotifierHostRegistered", "ProtocolVersion", "RegisteredStatusNotifierItems"};
+            for(u32 NameIndex = 0;
+                NameIndex < ArrayCount(Names);
+                ++NameIndex)
+            {
+                DBusMessageIter PropertyEntry = {};
+                DeferLoop(dbus_message_iter_open_container(&PropertiesArray, DBUS_TYPE_DICT_ENTRY, 0, &PropertyEntry),
+                          dbus_message_iter_close_container(&PropertiesArray, &PropertyEntry))
+                {
+                    dbus_message_iter_append_basic(&PropertyEntry, DBUS_TYPE_STRING, Names + NameIndex);
+                    AppendWatcherProperty(State, Str(Names[NameIndex]), &PropertyEntry);
+                }
+            }
+        }
+    }
+    
+    if(Response)
+    {
+        dbus_connection_send(Connection, Response, 0);
+        dbus_message_unref(Response);
+        
+        Result = DBUS_HANDLER_RESULT_HANDLED;
+    }
+    
+    return Result;
+}
+
+//
+// NOTE(trayge): Synthetic hosts behave like a panel that repaints on every NewIcon: each one
+// fetches IconPixmap (or the whole item with --fetch getall) as soon as the signal arrives, and
+// the time from signal to reply is the latency we report. Greedy hosts send GreedyFetchCount
+// fetches per signal to stand in for a misbehaving consumer.
+//
+
+function void
+HandleFetchReply(DBusPendingCall *Pending, void *UserData)
+{
+    bench_fetch *Fetch = UserData;
+    bench_state *State = Fetch->State;
+    
+    DBusMessage *Reply = dbus_pending_call_steal_reply(Pending);
+    if(Reply)
+    {
+        if(State->Measuring)
+        {
+            if(dbus_message_get_type(Reply) == DBUS_MESSAGE_TYPE_ERROR)
+            {
+                ++State->FetchErrors;
+            }
+            else
+            {
+                RecordHistogramValue(&State->Latency, GetMonotonicTime() - Fetch->SignalTime);
+                ++State->FramesReceived;
+            }
+        }
+        
+        NoteMessageReceived(State, Reply);
+        dbus_message_unref(Reply);
+    }
+}
+
+function void
+CollectMenuLayoutIds(bench_menu *Menu, DBusMessageIter *Layout)
+{
+    DBusMessageIter Fields = {};
+    dbus_message_iter_recurse(Layout, &Fields);
+    
+    s32 Id = -1;
+    dbus_message_iter_get_basic(&Fields, &Id);
+    if(Id >= 0 && Id < BenchMaxMenuIds)
+    {
+        Menu->KnownIds[Id] = true;
+    }
+    if(Menu->HighestId < Id)
+    {
+        Menu->HighestId = Id;
+    }
+    ++Menu->EntryCount;
+    
+    dbus_message_iter_next(&Fields);
+    dbus_message_iter_next(&Fields);
+    
+    DBusMessageIter Children = {};
+    dbus_message_iter_recurse(&Fields, &Children);
+    while(dbus_message_iter_get_arg_type(&Children) == DBUS_TYPE_VARIANT)
+    {
+        DBusMessageIter Child = {};
+        dbus_message_iter_recurse(&Children, &Child);
+        CollectMenuLayoutIds(Menu, &Child);
+        dbus_message_iter_next(&Children);
+    }
+}
+
+function void
+HandleMenuLayoutReply(DBusPendingCall *Pending, void *UserData)
+{
+    bench_state *State = UserData;
+    bench_menu *Menu = &State->Menu;
+    
+    Menu->LayoutPending = false;
+    
+    DBusMessage *Reply = dbus_pending_call_steal_reply(Pending);
+    if(Reply)
+    {
+        DBusMessageIter Args = {};
+        if(dbus_message_get_type(Reply) == DBUS_MESSAGE_TYPE_METHOD_RETURN && dbus_message_iter_init(Reply, &Args))
+        {
+            memset(Menu->KnownIds, 0, sizeof(Menu->KnownIds));
+            Menu->EntryCount = 0;
+            
+            dbus_message_iter_next(&Args);
+            CollectMenuLayoutIds(Menu, &Args);
+            
+            Menu->HaveLayout = true;
+            if(State->Measuring)
+            {
+                ++Menu->LayoutsFetched;
+                if(Menu->LargestEntryCount < Menu->EntryCount)
+                {
+                    Menu->LargestEntryCount = Menu->EntryCount;
+                }
+            }
+        }
+        
+        NoteMessageReceived(State, Reply);
+        dbus_message_unref(Reply);
+    }
+}
+
+function void
+RequestMenuLayout(bench_state *State)
+{
+    bench_menu *Menu = &State->Menu;
+    
+    DBusMessage *Request = dbus_message_new_method_call(State->TraygeName, "/MenuBar", "com.canonical.dbusmenu", "GetLayout");
+    s32 ParentId = 0;
+    s32 Depth = -1;
+    DBusMessageIter Args = {};
+    DBusMessageIter Names = {};
+    dbus_message_iter_init_append(Request, &Args);
+    dbus_message_iter_append_basic(&Args, DBUS_TYPE_INT32, &ParentId);
+    dbus_message_iter_append_basic(&Args, DBUS_TYPE_INT32, &Depth);
+    dbus_message_iter_open_container(&Args, DBUS_TYPE_ARRAY, "s", &Names);
+    dbus_message_iter_close_container(&Args, &Names);
+    
+    DBusPendingCall *Pending = 0;
+    if(dbus_connection_send_with_reply(State->Hosts[0].Connection, Request, &Pending, DBUS_TIMEOUT_USE_DEFAULT) && Pending)
+    {
+        Menu->LayoutPending = true;
+        Menu->LayoutStale = false;
+        dbus_pending_call_set_notify(Pending, HandleMenuLayoutReply, State, 0);
+        dbus_pending_call_unref(Pending);
+    }
+    dbus_message_unref(Request);
+}
+
+function void
+CheckMenuPropertyUpdates(bench_state *State, DBusMessage *Message)
+{
+    bench_menu *Menu = &State->Menu;
+    
+    // NOTE(trayge): Only checked while the host believes its layout is current; a layout
+    // announced earlier and not yet fetched legitimately knows fewer ids.
+    DBusMessageIter Args = {};
+    if(Menu->HaveLayout && !Menu->LayoutPending && !Menu->LayoutStale && dbus_message_iter_init(Message, &Args))
+    {
+        for(u32 ArrayIndex = 0;
+            ArrayIndex < 2;
+            ++ArrayIndex)
+        {
+            DBusMessageIter Entries = {};
+            dbus_message_iter_recurse(&Args, &Entries);
+            while(dbus_message_iter_get_arg_type(&Entries) == DBUS_TYPE_STRUCT)
+            {
+                DBusMessageIter Entry = {};
+                dbus_message_iter_recurse(&Entries, &Entry);
+                
+                s32 Id = -1;
+                dbus_message_iter_get_basic(&Entry, &Id);
+                if(State->Measuring && (Id < 0 || Id >= BenchMaxMenuIds || !Menu->KnownIds[Id]))
+                {
+                    ++Menu->UnknownIdUpdates;
+                }
+                
+                dbus_message_iter_next(&Entries);
+            }
+            dbus_message_iter_next(&Args);
+        }
+    }
+}
+
+function DBusHandlerResult
+HandleHostMessage(DBusConnection *Connection, DBusMessage *Message, void *UserData)
+{
+    bench_state *State = UserData;
+    
+    DBusHandlerResult Result = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    
+    if(dbus_message_is_signal(Message, "org.kde.StatusNotifierItem", "NewIcon"))
+    {
+        u64 SignalTime = GetMonotonicTime();
+        if(State->Measuring)
+        {
+            ++State->SignalsReceived;
+        }
+        NoteMessageReceived(State, Message);
+        
+        u32 FetchCount = 1;
+        for(u32 HostIndex = 0;
+            HostIndex < State->HostCount;
+            ++HostIndex)
+        {
+            if(State->Hosts[HostIndex].Connection == Connection)
+            {
+                FetchCount = State->Hosts[HostIndex].FetchCount;
+            }
+        }
+        
+        DBusMessage *Request = dbus_message_new_method_call(dbus_message_get_sender(Message),
+                                                            dbus_message_get_path(Message),
+                                                            "org.freedesktop.DBus.Properties",
+                                                            State->FetchAll ? "GetAll" : "Get");
+        char *Interface = "org.kde.StatusNotifierItem";
+        char *Property = "IconPixmap";
+        if(State->FetchAll)
+        {
+            dbus_message_append_args(Request, DBUS_TYPE_STRING, &Interface, DBUS_TYPE_INVALID);
+        }
+        else
+        {
+            dbus_message_append_args(Request, DBUS_TYPE_STRING, &Interface, DBUS_TYPE_STRING, &Property, DBUS_TYPE_INVALID);
+        }
+        
+        for(u32 FetchIndex = 0;
+            FetchIndex < FetchCount;
+            ++FetchIndex)
+        {
+            // NOTE(trayge): A sent message keeps its serial, so every fetch needs its own copy.
+            DBusMessage *Copy = dbus_message_copy(Request);
+            
+            DBusPendingCall *Pending = 0;
+            if(dbus_connection_send_with_reply(Connection, Copy, &Pending, DBUS_TIMEOUT_USE_DEFAULT) && Pending)
+            {
+                bench_fetch *Fetch = malloc(sizeof(bench_fetch));
+                Fetch->State = State;
+                Fetch->SignalTime = SignalTime;
+                
+                dbus_pending_call_set_notify(Pending, HandleFetchReply, Fetch, free);
+                dbus_pending_call_unref(Pending);
+            }
+            dbus_message_unref(Copy);
+        }
+        dbus_message_unref(Request);
+        
+        Result = DBUS_HANDLER_RESULT_HANDLED;
+    }
+    else if(dbus_message_is_signal(Message, "com.canonical.dbusmenu", "LayoutUpdated"))
+    {
+        NoteMessageReceived(State, Message);
+        if(State->Measuring)
+        {
+            ++State->Menu.LayoutSignals;
+        }
+        State->Menu.LayoutStale = true;
+        
+        Result = DBUS_HANDLER_RESULT_HANDLED;
+    }
+    else if(dbus_message_is_signal(Message, "com.canonical.dbusmenu", "ItemsPropertiesUpdated"))
+    {
+        NoteMessageReceived(State, Message);
+        if(State->Measuring)
+        {
+            ++State->Menu.PropertySignals;
+        }
+        CheckMenuPropertyUpdates(State, Message);
+        
+        Result = DBUS_HANDLER_RESULT_HANDLED;
+    }
+    
+    return Result;
+}
+
+function b32
+ConnectHost(bench_state *State, bench_host *Host)
+{
+    Host->Connection = dbus_bus_get_private(DBUS_BUS_SESSION, 0);
+    
+    b32 Result = (Host->Connection != 0);
+    if(Result)
+    {
+        dbus_connection_set_exit_on_disconnect(Host->Connection, false);
+        
+        snprintf(Host->Name, sizeof(Host->Name), "org.kde.StatusNotifierHost-%d-%u", getpid(), Host->Index);
+        dbus_bus_request_name(Host->Connection, Host->Name, DBUS_NAME_FLAG_DO_NOT_QUEUE, 0);
+        dbus_bus_add_match(Host->Connection, "type='signal',interface='org.kde.StatusNotifierItem',member='NewIcon'", 0);
+        if(State->Menu.Enabled && Host->Index == 0)
+        {
+            dbus_bus_add_match(Host->Connection, "type='signal',interface='com.canonical.dbusmenu',path='/MenuBar'", 0);
+        }
+        dbus_connection_add_filter(Host->Connection, HandleHostMessage, State, 0);
+        
+        // NOTE(trayge): The watcher lives in this process, so registration must not block on
+        // its reply.
+        DBusMessage *Request = dbus_message_new_method_call("org.kde.StatusNotifierWatcher",
+                                                            "/StatusNotifierWatcher",
+                                                            "org.kde.StatusNotifierWatcher",
+                                                            "RegisterStatusNotifierHost");
+        char *Name = Host->Name;
+        dbus_message_append_args(Request, DBUS_TYPE_STRING, &Name, DBUS_TYPE_INVALID);
+        dbus_message_set_no_reply(Request, true);
+        dbus_connection_send(Host->Connection, Request, 0);
+        dbus_message_unref(Request);
+    }
+    
+    return Result;
+}
+
+function void
+PumpConnections(bench_state *State, s32 TimeoutMilliseconds)
+{
+    DBusConnection *Connections[BenchMaxHosts + 1];
+    
+    u32 Count = 0;
+    Connections[Count++] = State->Watcher;
+    for(u32 HostIndex = 0;
+        HostIndex < State->HostCount;
+        ++HostIndex)
+    {
+        Connections[Count++] = State->Hosts[HostIndex].Connection;
+    }
+    
+    PumpConnectionList(Connections, Count, TimeoutMilliseconds);
+}
+
+int
+main(int ArgumentCount, char **Arguments)
+{
+    bench_state State = {};
+    
+    u64 HostCount = 4;
+    u64 GreedyHostCount = 0;
+    u64 DurationSeconds = 5;
+    u64 WarmupSeconds = 1;
+    b32 StubSession = false;
+    
+    char DefaultTraygePath[512];
+    GetSiblingPath(DefaultTraygePath, sizeof(DefaultTraygePath), Arguments[0], "trayge");
+    
+    char *TraygeArguments[64] = {DefaultTraygePath};
+    u32 TraygeArgumentCount = 1;
+    
+    for(s32 ArgumentIndex = 1;
+        ArgumentIndex < ArgumentCount;
+        ++ArgumentIndex)
+    {
+        string Argument = Str(Arguments[ArgumentIndex]);
+        
+        if(StringsAreEqual(Argument, StrLit("--hosts"), 0) && ArgumentIndex + 1 < ArgumentCount &&
+           ParseU64(Str(Arguments[ArgumentIndex + 1]), &HostCount) && HostCount && HostCount <= BenchMaxHosts)
+        {
+            ++ArgumentIndex;
+        }
+        else if(StringsAreEqual(Argument, StrLit("--duration"), 0) && ArgumentIndex + 1 < ArgumentCount &&
+                ParseU64(Str(Arguments[ArgumentIndex + 1]), &DurationSeconds) && DurationSeconds)
+        {
+            ++ArgumentIndex;
+        }
+        else if(StringsAreEqual(Argument, StrLit("--warmup"), 0) && ArgumentIndex + 1 < ArgumentCount &&
+                ParseU64(Str(Arguments[ArgumentIndex + 1]), &WarmupSeconds))
+        {
+            ++ArgumentIndex;
+        }
+        else if(StringsAreEqual(Argument, StrLit("--greedy"), 0) && ArgumentIndex + 1 < ArgumentCount &&
+                ParseU64(Str(Arguments[ArgumentIndex + 1]), &GreedyHostCount))
+        {
+            ++ArgumentIndex;
+        }
+        else if(StringsAreEqual(Argument, StrLit("--fetch"), 0) && ArgumentIndex + 1 < ArgumentCount)
+        {
+            char *ModeRaw = Arguments[++ArgumentIndex];
+            State.FetchAll = StringsAreEqual(Str(ModeRaw), StrLit("getall"), 0);
+        }
+        else if(StringsAreEqual(Argument, StrLit("--session"), 0) && ArgumentIndex + 1 < ArgumentCount)
+        {
+            char *ModeRaw = Arguments[++ArgumentIndex];
+            StubSession = true;
+            State.SessionLocked = StringsAreEqual(Str(ModeRaw), StrLit("locked"), 0);
+            State.SessionIdle = StringsAreEqual(Str(ModeRaw), StrLit("idle"), 0);
+        }
+        else if(StringsAreEqual(Argument, StrLit("--menu"), 0))
+        {
+            State.Menu.Enabled = true;
+        }
+        else if(StringsAreEqual(Argument, StrLit("--trayge"), 0) && ArgumentIndex + 1 < ArgumentCount)
+        {
+            TraygeArguments[0] = Arguments[++ArgumentIndex];
+        }
+        else if(StringsAreEqual(Argument, StrLit("--"), 0))
+        {
+            while(++ArgumentIndex < ArgumentCount && TraygeArgumentCount < ArrayCount(TraygeArguments) - 1)
+            {
+                TraygeArguments[TraygeArgumentCount++] = Arguments[ArgumentIndex];
+            }
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [--hosts N] [--duration S] [--warmup S] [--greedy N] [--fetch pixmap|getall] [--session active|idle|locked] [--menu] [--trayge path] [-- trayge arguments]\n", Arguments[0]);
+            return 1;
+        }
+    }
+    
+    signal(SIGPIPE, SIG_IGN);
+    
+    bus_daemon Daemon = {};
+    if(!StartBusDaemon(&Daemon))
+    {
+        fprintf(stderr, "Could not start dbus-daemon\n");
+        return 1;
+    }
+    
+    State.Watcher = dbus_bus_get_private(DBUS_BUS_SESSION, 0);
+    dbus_connection_set_exit_on_disconnect(State.Watcher, false);
+    dbus_bus_request_name(State.Watcher, "org.kde.StatusNotifierWatcher", DBUS_NAME_FLAG_DO_NOT_QUEUE, 0);
+    dbus_connection_add_filter(State.Watcher, HandleWatcherMessage, &State, 0);
+    if(StubSession)
+    {
+        // NOTE(trayge): The screen saver and session presence stubs share the watcher's connection.
+        dbus_bus_request_name(State.Watcher, "org.freedesktop.ScreenSaver", DBUS_NAME_FLAG_DO_NOT_QUEUE, 0);
+        dbus_bus_request_name(State.Watcher, "org.gnome.SessionManager", DBUS_NAME_FLAG_DO_NOT_QUEUE, 0);
+    }
+    
+    State.HostCount = (u32)HostCount;
+    for(u32 HostIndex = 0;
+        HostIndex < State.HostCount;
+        ++HostIndex)
+    {
+        bench_host *Host = State.Hosts + HostIndex;
+        Host->Index = HostIndex;
+        Host->FetchCount = (HostIndex < GreedyHostCount) ? GreedyFetchCount : 1;
+        if(!ConnectHost(&State, Host))
+        {
+            fprintf(stderr, "Could not connect host %u\n", HostIndex);
+            StopBusDaemon(&Daemon);
+            return 1;
+        }
+    }
+    
+    pid_t TraygePid = SpawnProcess(TraygeArguments);
+    
+    u64 StartTime = GetMonotonicTime();
+    u64 MeasureTime = StartTime + WarmupSeconds*Billion;
+    u64 EndTime = MeasureTime + DurationSeconds*Billion;
+    u64 StartCPUTime = 0;
+    
+    for(u64 Now = StartTime;
+        Now < EndTime;
+        Now = GetMonotonicTime())
+    {
+        if(!State.Measuring && Now >= MeasureTime)
+        {
+            State.Measuring = true;
+            MeasureTime = Now;
+            StartCPUTime = GetProcessCPUTime(TraygePid);
+        }
+        
+        // NOTE(trayge): Layouts announced while one is being fetched are folded into one refetch.
+        if(State.Menu.Enabled && State.TraygeName[0] && !State.Menu.LayoutPending &&
+           (!State.Menu.HaveLayout || State.Menu.LayoutStale))
+        {
+            RequestMenuLayout(&State);
+        }
+        
+        PumpConnections(&State, 5);
+    }
+    
+    u64 CPUTime = GetProcessCPUTime(TraygePid) - StartCPUTime;
+    f64 Elapsed = (f64)(GetMonotonicTime() - MeasureTime) / Billion;
+    
+    printf("%u hosts, %u items, %.2fs measured\n", State.HostCount, State.ItemCount, Elapsed);
+    printf("NewIcon received %lu, frames fetched %lu, fetch errors %lu\n",
+           State.SignalsReceived, State.FramesReceived, State.FetchErrors);
+    printf("signal->frame latency us: p50 %.1f  p90 %.1f  p99 %.1f  max %.1f\n",
+           (f64)HistogramPercentile(&State.Latency, 0.5) / 1000.0,
+           (f64)HistogramPercentile(&State.Latency, 0.9) / 1000.0,
+           (f64)HistogramPercentile(&State.Latency, 0.99) / 1000.0,
+           (f64)State.Latency.Max / 1000.0);
+    printf("received %.0f msgs/s, %.2f MB/s\n",
+           (f64)State.MessagesReceived / Elapsed, (f64)State.BytesReceived / Elapsed / (1024.0*1024.0));
+    printf("trayge cpu %.1f ms (%.1f%% of one core)\n", (f64)CPUTime / Million, 100.0*(f64)CPUTime / Billion / Elapsed);
+    if(State.Menu.Enabled)
+    {
+        printf("menu: LayoutUpdated %lu, layouts fetched %lu, ItemsPropertiesUpdated %lu, updates for unknown ids %lu\n",
+               State.Menu.LayoutSignals, State.Menu.LayoutsFetched, State.Menu.PropertySignals, State.Menu.UnknownIdUpdates);
+        printf("menu: largest layout %u entries, highest id %d\n", State.Menu.LargestEntryCount, State.Menu.HighestId);
+    }
+    
+    if(State.TraygeName[0])
+    {
+        PrintTraygeStats(State.Hosts[0].Connection, State.TraygeName);
+    }
+    
+    StopProcess(TraygePid);
+    
+    for(u32 HostIndex = 0;
+        HostIndex < State.HostCount;
+        ++HostIndex)
+    {
+        dbus_connection_close(State.Hosts[HostIndex].Connection);
+        dbus_connection_unref(State.Hosts[HostIndex].Connection);
+    }
+    dbus_connection_close(State.Watcher);
+    dbus_connection_unref(State.Watcher);
+    
+    StopBusDaemon(&Daemon);
+    
+    b32 Succeeded = (State.FramesReceived || State.SessionLocked);
+    return Succeeded ? 0 : 1;
+}
@@ -0,0 +1,413 @@
+typedef enum icon_size_index
+{
+    IconSize_16,
+    IconSize_22,
+    IconSize_24,
+    IconSize_32,
+    IconSize_48,
+    IconSize_64,
+    IconSize_256,
+    
+    IconSize_Count,
+} icon_size_index;
+
+#define IconSizeAll ((1u << IconSize_Count) - 1)
+
+global s32 IconSizes[IconSize_Count] = {16, 22, 24, 32, 48, 64, 256};
+
+// NOTE(trayge): Max is exclusive; an empty rect has MinX >= MaxX.
+typedef struct icon_rect
+{
+    s32 MinX;
+    s32 MinY;
+    s32 MaxX;
+    s32 MaxY;
+} icon_rect;
+
+function b32
+IconRectIsEmpty(icon_rect Rect)
+{
+    b32 Result = (Rect.MinX >= Rect.MaxX || Rect.MinY >= Rect.MaxY);
+    return Result;
+}
+
+typedef struct icon_image
+{
+    s32 Width;
+    s32 Height;
+    u8 *Bytes;
+    
+    icon_rect Dirty;
+} icon_image;
+
+// NOTE(trayge): Frames are pooled and reference counted so a rendered frame can stay alive
+// (for replies, diffs, or a renderer working ahead) while the next one is being produced.
+typedef struct icon_frame
+{
+    u32 RefCount;
+    u64 Version;
+    struct icon_frame *NextFree;
+    u8 *Bytes;
+} icon_frame;
+
+typedef struct icon_frame_pool
+{
+    memory_arena *Arena;
+    u64 FrameSize;
+    u32 AllocatedCount;
+    icon_frame *FirstFree;
+} icon_frame_pool;
+
+typedef struct icon_cache
+{
+    u64 Version;
+    u32 SizeMask;
+    icon_frame_pool *Pool;
+    icon_frame *Frame;
+    icon_image Images[IconSize_Count];
+    
+    u64 FrameCount;
+    u64 UnchangedFrameCount;
+    u64 DirtyPixelCount;
+    u64 ComparedPixelCount;
+} icon_cache;
+
+function u64
+IconImageSize(s32 Size)
+{
+    u64 Result = (u64)Size*(u64)Size*4;
+    return Result;
+}
+
+function u64
+IconCacheStorageSize(u32 SizeMask)
+{
+    u64 Result = 0;
+    
+    for(u32 SizeIndex = 0;
+        SizeIndex < IconSize_Count;
+        ++SizeIndex)
+    {
+        if(SizeMask & (1u << SizeIndex))
+        {
+            Result += IconImageSize(IconSizes[SizeIndex]);
+        }
+    }
+    
+    return Result;
+}
+
+function u32
+IconSizeMaskFromSize(s32 Size)
+{
+    u32 Result = 0;
+    
+    for(u32 SizeIndex = 0;
+        SizeIndex < IconSize_Count;
+        ++SizeIndex)
+    {
+        if(IconSizes[SizeIndex] == Size)
+        {
+            Result = 1u << SizeIndex;
+            break;
+        }
+    }
+    
+    return Result;
+}
+
+// NOTE(trayge): Takes a comma separated list like "16,22,48". Fails on an empty entry or a size
+// trayge does not render, and leaves Mask alone, since an empty mask would mean every size.
+function b32
+ParseIconSizeList(string List, u32 *Mask)
+{
+    b32 Result = (List.Size > 0);
+    u32 SizeMask = 0;
+    
+    while(Result && List.Size)
+    {
+        u64 Length = 0;
+        for(; Length < List.Size && List.Data[Length] != ','; ++Length);
+        
+        u64 Size = 0;
+        u32 SizeBit = 0;
+        if(ParseU64((string){List.Data, Length}, &Size) && Size <= (u64)IconSizes[IconSize_Count - 1])
+        {
+            SizeBit = IconSizeMaskFromSize((s32)Size);
+        }
+        
+        Result = (SizeBit != 0);
+        SizeMask |= SizeBit;
+        
+        u64 Advance = (Length < List.Size) ? Length + 1 : Length;
+        List.Data += Advance;
+        List.Size -= Advance;
+        
+        // NOTE(trayge): A trailing comma leaves an empty entry.
+        Result = Result && !(Advance > Length && List.Size == 0);
+    }
+    
+    if(Result)
+    {
+        *Mask = SizeMask;
+    }
+    
+    return Result;
+}
+
+function void
+InitIconFramePool(icon_frame_pool *Pool, memory_arena *Arena, u64 FrameSize)
+{
+    Pool->Arena = Arena;
+    Pool->FrameSize = FrameSize;
+    Pool->AllocatedCount = 0;
+    Pool->FirstFree = 0;
+}
+
+function icon_frame *
+AcquireIconFrame(icon_frame_pool *Pool)
+{
+    icon_frame *Result = Pool->FirstFree;
+    
+    if(Result)
+    {
+        Pool->FirstFree = Result->NextFree;
+    }
+    else
+    {
+        Result = PushSize(Pool->Arena, sizeof(icon_frame) + Pool->FrameSize);
+        if(Result)
+        {
+            Result->Bytes = (u8 *)(Result + 1);
+            ++Pool->AllocatedCount;
+        }
+    }
+    
+    if(Result)
+    {
+        Result->RefCount = 1;
+        Result->Version = 0;
+        Result->NextFree = 0;
+    }
+    
+    return Result;
+}
+
+function icon_frame *
+RetainIconFrame(icon_frame *Frame)
+{
+    if(Frame)
+    {
+        ++Frame->RefCount;
+    }
+    
+    return Frame;
+}
+
+function void
+ReleaseIconFrame(icon_frame_pool *Pool, icon_frame *Frame)
+{
+    if(Frame)
+    {
+        Assert(Frame->RefCount > 0);
+        if(--Frame->RefCount == 0)
+        {
+            Frame->NextFree = Pool->FirstFree;
+            Pool->FirstFree = Frame;
+        }
+    }
+}
+
+function void
+BindIconFrame(icon_cache *Cache, icon_frame *Frame)
+{
+    u8 *Storage = Frame ? Frame->Bytes : 0;
+    
+    for(u32 SizeIndex = 0;
+        SizeIndex < IconSize_Count;
+        ++SizeIndex)
+    {
+        icon_image *Image = Cache->Images + SizeIndex;
+        
+        if(Storage && (Cache->SizeMask & (1u << SizeIndex)))
+        {
+            Image->Width = IconSizes[SizeIndex];
+            Image->Height = IconSizes[SizeIndex];
+            Image->Bytes = Storage;
+            
+            Storage += IconImageSize(IconSizes[SizeIndex]);
+        }
+        else
+        {
+            Image->Width = 0;
+            Image->Height = 0;
+            Image->Bytes = 0;
+        }
+    }
+    
+    Cache->Frame = Frame;
+}
+
+function void
+InitIconCache(icon_cache *Cache, u32 SizeMask, icon_frame_pool *Pool)
+{
+    Assert(IconCacheStorageSize(SizeMask) <= Pool->FrameSize);
+    
+    *Cache = (icon_cache){};
+    Cache->SizeMask = SizeMask;
+    Cache->Pool = Pool;
+    
+    BindIconFrame(Cache, 0);
+}
+
+function void
+RenderIconImage(icon_image *Image, s32 XOffset, s32 YOffset)
+{
+    PixelKernels->Gradient(Image->Bytes, Image->Width, Image->Height, XOffset, YOffset);
+}
+
+function u64
+DiffIconImage(icon_image *Image, u8 *PreviousBytes)
+{
+    u64 Result = 0;
+    icon_rect Dirty = {Image->Width, Image->Height, 0, 0};
+    
+    u64 RowSize = (u64)Image->Width*4;
+    for(s32 Y = 0;
+        Y < Image->Height;
+        ++Y)
+    {
+        u64 FirstDiff = (u64)Image->Width;
+        u64 LastDiff = 0;
+        u64 Count = PixelKernels->Diff(Image->Bytes + (u64)Y*RowSize, PreviousBytes + (u64)Y*RowSize,
+                                       (u64)Image->Width, &FirstDiff, &LastDiff);
+        if(Count)
+        {
+            if(Dirty.MinY > Y)
+            {
+                Dirty.MinY = Y;
+            }
+            Dirty.MaxY = Y + 1;
+            
+            if(Dirty.MinX > (s32)FirstDiff)
+            {
+                Dirty.MinX = (s32)FirstDiff;
+            }
+            if(Dirty.MaxX < (s32)LastDiff + 1)
+            {
+                Dirty.MaxX = (s32)LastDiff + 1;
+            }
+            
+            Result += Count;
+        }
+    }
+    
+    Image->Dirty = Dirty;
+    return Result;
+}
+
+// NOTE(trayge): Sizes in the mask are stored back to back in ascending order, so an image's
+// offset inside a frame is the storage of every smaller size in the mask.
+function u64
+IconImageOffset(u32 SizeMask, u32 SizeIndex)
+{
+    u64 Result = IconCacheStorageSize(SizeMask & ((1u << SizeIndex) - 1));
+    return Result;
+}
+
+// NOTE(trayge): Takes ownership of Frame, which must hold pixels for every size in the cache's
+// mask. Returns false when the frame is byte-identical to the previous one, in which case the
+// previous frame stays current and the version does not move.
+function b32
+CommitIconFrame(icon_cache *Cache, icon_frame *Frame)
+{
+    b32 Changed = false;
+    
+    if(Frame)
+    {
+        icon_frame *PreviousFrame = Cache->Frame;
+        BindIconFrame(Cache, Frame);
+        
+        u64 DirtyPixels = 0;
+        u64 TotalPixels = 0;
+        
+        for(u32 SizeIndex = 0;
+            SizeIndex < IconSize_Count;
+            ++SizeIndex)
+        {
+            if(Cache->SizeMask & (1u << SizeIndex))
+            {
+                icon_image *Image = Cache->Images + SizeIndex;
+                
+                u64 PixelCount = (u64)Image->Width*(u64)Image->Height;
+                TotalPixels += PixelCount;
+                
+                if(PreviousFrame)
+                {
+                    DirtyPixels += DiffIconImage(Image, PreviousFrame->Bytes + (Image->Bytes - Frame->Bytes));
+                }
+                else
+                {
+                    Image->Dirty = (icon_rect){0, 0, Image->Width, Image->Height};
+                    DirtyPixels += PixelCount;
+                }
+            }
+        }
+        
+        ++Cache->FrameCount;
+        Cache->DirtyPixelCount += DirtyPixels;
+        Cache->ComparedPixelCount += TotalPixels;
+        
+        Changed = (DirtyPixels != 0);
+        if(Changed)
+        {
+            Frame->Version = ++Cache->Version;
+            ReleaseIconFrame(Cache->Pool, PreviousFrame);
+        }
+        else
+        {
+            ++Cache->UnchangedFrameCount;
+            BindIconFrame(Cache, PreviousFrame);
+            ReleaseIconFrame(Cache->Pool, Frame);
+        }
+    }
+    
+    return Changed;
+}
+
+function b32
+RenderIconCache(icon_cache *Cache, s32 XOffset, s32 YOffset)
+{
+    icon_frame *Frame = AcquireIconFrame(Cache->Pool);
+    if(Frame)
+    {
+        for(u32 SizeIndex = 0;
+            SizeIndex < IconSize_Count;
+            ++SizeIndex)
+        {
+            if(Cache->SizeMask & (1u << SizeIndex))
+            {
+                icon_image Image = {};
+                Image.Width = IconSizes[SizeIndex];
+                Image.Height = IconSizes[SizeIndex];
+                Image.Bytes = Frame->Bytes + IconImageOffset(Cache->SizeMask, SizeIndex);
+                RenderIconImage(&Image, XOffset, YOffset);
+            }
+        }
+    }
+    
+    b32 Result = CommitIconFrame(Cache, Frame);
+    return Result;
+}
+
+function f64
+IconCacheDirtyRatio(icon_cache *Cache)
+{
+    f64 Result = 0;
+    if(Cache->ComparedPixelCount)
+    {
+        Result = (f64)Cache->DirtyPixelCount / (f64)Cache->ComparedPixelCount;
+    }
+    
+    return Result;
+}
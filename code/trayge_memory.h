@@ -0,0 +1,236 @@
+#define ZeroStruct(pointer) ZeroSize(pointer, sizeof(*(pointer)))
+
+function void
+ZeroSize(void *Dest, u64 Count)
+{
+    asm volatile("rep stosb" : "+D"(Dest), "+c"(Count) : "a"(0) : "memory");
+}
+
+//
+// NOTE(trayge): Arenas are chains of mmap'd blocks. Pushing never frees; ResetArena drops
+// everything at once. When a reset finds more than one block it replaces them with a single
+// block big enough for all of them, so a transient arena settles after its first busy
+// iteration and steady-state pushes are just a pointer bump.
+//
+
+#define ArenaDefaultAlignment 16
+
+typedef struct memory_arena_block
+{
+    struct memory_arena_block *Previous;
+    u64 Size;
+    u64 Used;
+} memory_arena_block;
+
+typedef struct memory_arena
+{
+    memory_arena_block *Current;
+    u64 MinimumBlockSize;
+    u32 BlockCount;
+    
+    u64 UsedSize;
+    u64 PeakUsedSize;
+} memory_arena;
+
+typedef struct memory_pool_entry
+{
+    struct memory_pool_entry *Next;
+} memory_pool_entry;
+
+typedef struct memory_pool
+{
+    memory_arena *Arena;
+    u64 ElementSize;
+    memory_pool_entry *FirstFree;
+    
+    u32 AllocatedCount;
+    u32 InUseCount;
+} memory_pool;
+
+function memory_arena_block *
+AllocateArenaBlock(u64 Size)
+{
+    memory_arena_block *Result = mmap(0, Size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(Result == MAP_FAILED)
+    {
+        Result = 0;
+    }
+    
+    if(Result)
+    {
+        Result->Previous = 0;
+        Result->Size = Size;
+        Result->Used = sizeof(memory_arena_block);
+    }
+    
+    return Result;
+}
+
+function void
+InitArena(memory_arena *Arena, u64 MinimumBlockSize)
+{
+    *Arena = (memory_arena){};
+    Arena->MinimumBlockSize = MinimumBlockSize;
+}
+
+function void *
+PushSize(memory_arena *Arena, u64 Size)
+{
+    void *Result = 0;
+    
+    memory_arena_block *Block = Arena->Current;
+    u64 Start = Block ? (Block->Used + ArenaDefaultAlignment - 1) & ~(u64)(ArenaDefaultAlignment - 1) : 0;
+    
+    if(!Block || Start + Size > Block->Size)
+    {
+        u64 BlockSize = sizeof(memory_arena_block) + ArenaDefaultAlignment + Size;
+        if(BlockSize < Arena->MinimumBlockSize)
+        {
+            BlockSize = Arena->MinimumBlockSize;
+        }
+        
+        Block = AllocateArenaBlock(BlockSize);
+        if(Block)
+        {
+            Block->Previous = Arena->Current;
+            Arena->Current = Block;
+            ++Arena->BlockCount;
+            
+            Start = (Block->Used + ArenaDefaultAlignment - 1) & ~(u64)(ArenaDefaultAlignment - 1);
+        }
+    }
+    
+    if(Block)
+    {
+        Result = (u8 *)Block + Start;
+        Block->Used = Start + Size;
+        
+        Arena->UsedSize += Size;
+        if(Arena->PeakUsedSize < Arena->UsedSize)
+        {
+            Arena->PeakUsedSize = Arena->UsedSize;
+        }
+    }
+    
+    Assert(Result);
+    return Result;
+}
+
+function void *
+PushSizeZeroed(memory_arena *Arena, u64 Size)
+{
+    void *Result = PushSize(Arena, Size);
+    if(Result)
+    {
+        ZeroSize(Result, Size);
+    }
+    
+    return Result;
+}
+
+// NOTE(trayge): For structs whose members are kept on separate cache lines; the arena only
+// guarantees ArenaDefaultAlignment, so this pads and rounds up.
+function void *
+PushSizeAligned(memory_arena *Arena, u64 Size, u64 Alignment)
+{
+    u8 *Memory = PushSizeZeroed(Arena, Size + Alignment - 1);
+    void *Result = Memory ? (void *)(((u64)Memory + Alignment - 1) & ~(Alignment - 1)) : 0;
+    return Result;
+}
+
+#define PushStruct(arena, type) (type *)PushSizeZeroed(arena, sizeof(type))
+#define PushStructAligned(arena, type) (type *)PushSizeAligned(arena, sizeof(type), _Alignof(type))
+#define PushArray(arena, type, count) (type *)PushSizeZeroed(arena, (count)*sizeof(type))
+
+function void
+ResetArena(memory_arena *Arena)
+{
+    if(Arena->BlockCount > 1)
+    {
+        u64 TotalSize = 0;
+        while(Arena->Current)
+        {
+            memory_arena_block *Block = Arena->Current;
+            Arena->Current = Block->Previous;
+            
+            TotalSize += Block->Size;
+            munmap(Block, Block->Size);
+        }
+        
+        Arena->BlockCount = 0;
+        if(Arena->MinimumBlockSize < TotalSize)
+        {
+            Arena->MinimumBlockSize = TotalSize;
+        }
+        
+        Arena->Current = AllocateArenaBlock(Arena->MinimumBlockSize);
+        Arena->BlockCount = Arena->Current ? 1 : 0;
+    }
+    else if(Arena->Current)
+    {
+        Arena->Current->Used = sizeof(memory_arena_block);
+    }
+    
+    Arena->UsedSize = 0;
+}
+
+function void
+FreeArena(memory_arena *Arena)
+{
+    while(Arena->Current)
+    {
+        memory_arena_block *Block = Arena->Current;
+        Arena->Current = Block->Previous;
+        munmap(Block, Block->Size);
+    }
+    
+    Arena->BlockCount = 0;
+    Arena->UsedSize = 0;
+}
+
+function void
+InitPool(memory_pool *Pool, memory_arena *Arena, u64 ElementSize)
+{
+    *Pool = (memory_pool){};
+    Pool->Arena = Arena;
+    Pool->ElementSize = (ElementSize < sizeof(memory_pool_entry)) ? sizeof(memory_pool_entry) : ElementSize;
+}
+
+function void *
+PoolAllocate(memory_pool *Pool)
+{
+    void *Result = Pool->FirstFree;
+    
+    if(Result)
+    {
+        Pool->FirstFree = Pool->FirstFree->Next;
+    }
+    else
+    {
+        Result = PushSize(Pool->Arena, Pool->ElementSize);
+        if(Result)
+        {
+            ++Pool->AllocatedCount;
+        }
+    }
+    
+    if(Result)
+    {
+        ZeroSize(Result, Pool->ElementSize);
+        ++Pool->InUseCount;
+    }
+    
+    return Result;
+}
+
+function void
+PoolFree(memory_pool *Pool, void *Memory)
+{
+    if(Memory)
+    {
+        memory_pool_entry *Entry = Memory;
+        Entry->Next = Pool->FirstFree;
+        Pool->FirstFree = Entry;
+        --Pool->InUseCount;
+    }
+}
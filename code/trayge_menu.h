@@ -0,0 +1,396 @@
+#define MenuPropertyList(X) \
+    X(Type,            "type",             "s") \
+    X(Label,           "label",            "s") \
+    X(Enabled,         "enabled",          "b") \
+    X(Visible,         "visible",          "b") \
+    X(IconName,        "icon-name",        "s") \
+    X(ToggleType,      "toggle-type",      "s") \
+    X(ToggleState,     "toggle-state",     "i") \
+    X(ChildrenDisplay, "children-display", "s")
+
+typedef enum menu_property_type
+{
+#define X(Name, Key, Signature) MenuProperty_##Name,
+    MenuPropertyList(X)
+#undef X
+    
+    MenuProperty_Count,
+} menu_property_type;
+
+#define MenuPropertyAll ((1u << MenuProperty_Count) - 1)
+
+// NOTE(trayge): Labels are copied into the node, so callers can build them in any buffer;
+// longer ones are cut.
+#define MenuLabelMax 128
+
+typedef enum menu_item_type
+{
+    MenuItem_Standard,
+    MenuItem_Separator,
+} menu_item_type;
+
+typedef enum menu_toggle_type
+{
+    MenuToggle_None,
+    MenuToggle_Checkmark,
+    MenuToggle_Radio,
+} menu_toggle_type;
+
+typedef struct menu_node
+{
+    s32 Parent;
+    s32 FirstChild;
+    s32 LastChild;
+    s32 NextSibling;
+    
+    b32 Removed;
+    u32 Action;
+    
+    menu_item_type Type;
+    char Label[MenuLabelMax];
+    char *IconName;
+    b32 Enabled;
+    b32 Visible;
+    menu_toggle_type ToggleType;
+    s32 ToggleState;
+    
+    u32 DirtyProperties;
+    s32 NextDirty;
+    u32 AddedRevision;
+} menu_node;
+
+// NOTE(trayge): Removed nodes go on a free list threaded through NextSibling and their slots
+// are handed out again by AddMenuItem, so menus that churn through entries stay the size of
+// their largest state. Hosts see a new layout revision before a reused id means anything new.
+typedef struct menu_tree
+{
+    u32 Count;
+    u32 Capacity;
+    menu_node *Nodes;
+    s32 FirstFree;
+    
+    u32 Revision;
+    u32 SignalledRevision;
+    b32 LayoutDirty;
+    s32 LayoutDirtyParent;
+    
+    s32 FirstDirty;
+} menu_tree;
+
+function b32
+IsValidMenuId(menu_tree *Tree, s32 Id)
+{
+    b32 Result = (Id >= 0 && (u32)Id < Tree->Count && !Tree->Nodes[Id].Removed);
+    return Result;
+}
+
+// NOTE(trayge): Hosts learn about an item from a layout, so a property delta may only name
+// items that a layout revision hosts were already told about contains.
+function b32
+MenuItemIsAnnounced(menu_tree *Tree, s32 Id, u32 KnownRevision)
+{
+    b32 Result = (IsValidMenuId(Tree, Id) && Tree->Nodes[Id].AddedRevision <= KnownRevision);
+    return Result;
+}
+
+function void
+MarkMenuLayoutChanged(menu_tree *Tree, s32 Parent)
+{
+    if(Tree->LayoutDirty && Tree->LayoutDirtyParent != Parent)
+    {
+        Parent = 0;
+    }
+    
+    Tree->LayoutDirty = true;
+    Tree->LayoutDirtyParent = Parent;
+    ++Tree->Revision;
+}
+
+function void
+MarkMenuPropertyChanged(menu_tree *Tree, s32 Id, menu_property_type Property)
+{
+    menu_node *Node = Tree->Nodes + Id;
+    if(!Node->DirtyProperties)
+    {
+        Node->NextDirty = Tree->FirstDirty;
+        Tree->FirstDirty = Id;
+    }
+    
+    Node->DirtyProperties |= (1u << Property);
+}
+
+function void
+InitMenuTree(menu_tree *Tree)
+{
+    *Tree = (menu_tree){};
+    
+    Tree->Capacity = 16;
+    Tree->Nodes = malloc(Tree->Capacity*sizeof(menu_node));
+    Tree->Count = 1;
+    Tree->Revision = 1;
+    Tree->SignalledRevision = 1;
+    Tree->FirstDirty = -1;
+    Tree->FirstFree = -1;
+    
+    menu_node *Root = Tree->Nodes;
+    *Root = (menu_node){};
+    Root->Parent = -1;
+    Root->FirstChild = -1;
+    Root->LastChild = -1;
+    Root->NextSibling = -1;
+    Root->Enabled = true;
+    Root->Visible = true;
+    Root->ToggleState = -1;
+}
+
+function void
+FreeMenuTree(menu_tree *Tree)
+{
+    free(Tree->Nodes);
+    *Tree = (menu_tree){};
+}
+
+function s32
+AddMenuItem(menu_tree *Tree, s32 Parent, menu_item_type Type, char *Label, u32 Action)
+{
+    s32 Result = -1;
+    
+    if(IsValidMenuId(Tree, Parent))
+    {
+        if(Tree->FirstFree < 0 && Tree->Count == Tree->Capacity)
+        {
+            u32 Capacity = Tree->Capacity*2;
+            menu_node *Nodes = realloc(Tree->Nodes, Capacity*sizeof(menu_node));
+            if(Nodes)
+            {
+                Tree->Nodes = Nodes;
+                Tree->Capacity = Capacity;
+            }
+        }
+        
+        u32 DirtyProperties = 0;
+        s32 NextDirty = -1;
+        if(Tree->FirstFree >= 0)
+        {
+            Result = Tree->FirstFree;
+            Tree->FirstFree = Tree->Nodes[Result].NextSibling;
+            
+            // NOTE(trayge): A slot freed since the last flush may still be linked into the
+            // dirty list; it stays there, and is left out of deltas until a layout has
+            // announced the new item.
+            DirtyProperties = Tree->Nodes[Result].DirtyProperties;
+            NextDirty = Tree->Nodes[Result].NextDirty;
+        }
+        else if(Tree->Count < Tree->Capacity)
+        {
+            Result = (s32)Tree->Count++;
+        }
+        
+        if(Result >= 0)
+        {
+            menu_node *Node = Tree->Nodes + Result;
+            *Node = (menu_node){};
+            Node->DirtyProperties = DirtyProperties;
+            Node->NextDirty = NextDirty;
+            Node->Parent = Parent;
+            Node->FirstChild = -1;
+            Node->LastChild = -1;
+            Node->NextSibling = -1;
+            Node->Action = Action;
+            Node->Type = Type;
+            snprintf(Node->Label, sizeof(Node->Label), "%s", Label ? Label : "");
+            Node->Enabled = true;
+            Node->Visible = true;
+            Node->ToggleState = -1;
+            
+            menu_node *ParentNode = Tree->Nodes + Parent;
+            if(ParentNode->LastChild >= 0)
+            {
+                Tree->Nodes[ParentNode->LastChild].NextSibling = Result;
+            }
+            else
+            {
+                ParentNode->FirstChild = Result;
+            }
+            ParentNode->LastChild = Result;
+            
+            MarkMenuLayoutChanged(Tree, Parent);
+            Node->AddedRevision = Tree->Revision;
+        }
+    }
+    
+    return Result;
+}
+
+function void
+FreeMenuSubtree(menu_tree *Tree, s32 Id)
+{
+    menu_node *Node = Tree->Nodes + Id;
+    
+    s32 Child = Node->FirstChild;
+    while(Child >= 0)
+    {
+        s32 NextChild = Tree->Nodes[Child].NextSibling;
+        FreeMenuSubtree(Tree, Child);
+        Child = NextChild;
+    }
+    
+    Node->Removed = true;
+    Node->FirstChild = -1;
+    Node->LastChild = -1;
+    Node->NextSibling = Tree->FirstFree;
+    Tree->FirstFree = Id;
+}
+
+// NOTE(trayge): Removes the item and everything below it.
+function void
+RemoveMenuItem(menu_tree *Tree, s32 Id)
+{
+    if(Id > 0 && IsValidMenuId(Tree, Id))
+    {
+        menu_node *Node = Tree->Nodes + Id;
+        menu_node *ParentNode = Tree->Nodes + Node->Parent;
+        
+        s32 Previous = -1;
+        for(s32 Child = ParentNode->FirstChild;
+            Child != Id;
+            Child = Tree->Nodes[Child].NextSibling)
+        {
+            Previous = Child;
+        }
+        
+        if(Previous >= 0)
+        {
+            Tree->Nodes[Previous].NextSibling = Node->NextSibling;
+        }
+        else
+        {
+            ParentNode->FirstChild = Node->NextSibling;
+        }
+        
+        if(ParentNode->LastChild == Id)
+        {
+            ParentNode->LastChild = Previous;
+        }
+        
+        s32 Parent = Node->Parent;
+        FreeMenuSubtree(Tree, Id);
+        MarkMenuLayoutChanged(Tree, Parent);
+    }
+}
+
+function void
+SetMenuLabel(menu_tree *Tree, s32 Id, char *Label)
+{
+    // NOTE(trayge): Compared as it would be stored, so a label that gets cut is not reported
+    // as changed on every call.
+    string Stored = Str(Label);
+    if(Stored.Size > MenuLabelMax - 1)
+    {
+        Stored.Size = MenuLabelMax - 1;
+    }
+    
+    if(IsValidMenuId(Tree, Id) && !StringsAreEqual(Str(Tree->Nodes[Id].Label), Stored, 0))
+    {
+        snprintf(Tree->Nodes[Id].Label, sizeof(Tree->Nodes[Id].Label), "%s", Label ? Label : "");
+        MarkMenuPropertyChanged(Tree, Id, MenuProperty_Label);
+    }
+}
+
+function void
+SetMenuEnabled(menu_tree *Tree, s32 Id, b32 Enabled)
+{
+    if(IsValidMenuId(Tree, Id) && Tree->Nodes[Id].Enabled != Enabled)
+    {
+        Tree->Nodes[Id].Enabled = Enabled;
+        MarkMenuPropertyChanged(Tree, Id, MenuProperty_Enabled);
+    }
+}
+
+function void
+SetMenuVisible(menu_tree *Tree, s32 Id, b32 Visible)
+{
+    if(IsValidMenuId(Tree, Id) && Tree->Nodes[Id].Visible != Visible)
+    {
+        Tree->Nodes[Id].Visible = Visible;
+        MarkMenuPropertyChanged(Tree, Id, MenuProperty_Visible);
+    }
+}
+
+function void
+SetMenuToggle(menu_tree *Tree, s32 Id, menu_toggle_type ToggleType, s32 ToggleState)
+{
+    if(IsValidMenuId(Tree, Id))
+    {
+        menu_node *Node = Tree->Nodes + Id;
+        
+        if(Node->ToggleType != ToggleType)
+        {
+            Node->ToggleType = ToggleType;
+            MarkMenuPropertyChanged(Tree, Id, MenuProperty_ToggleType);
+        }
+        
+        if(Node->ToggleState != ToggleState)
+        {
+            Node->ToggleState = ToggleState;
+            MarkMenuPropertyChanged(Tree, Id, MenuProperty_ToggleState);
+        }
+    }
+}
+
+function b32
+MenuPropertyIsDefault(menu_tree *Tree, s32 Id, menu_property_type Property)
+{
+    menu_node *Node = Tree->Nodes + Id;
+    
+    b32 Result = true;
+    
+    switch(Property)
+    {
+        case MenuProperty_Type:
+        {
+            Result = (Node->Type == MenuItem_Standard);
+        } break;
+        
+        case MenuProperty_Label:
+        {
+            Result = (StringLength(Node->Label) == 0);
+        } break;
+        
+        case MenuProperty_Enabled:
+        {
+            Result = Node->Enabled;
+        } break;
+        
+        case MenuProperty_Visible:
+        {
+            Result = Node->Visible;
+        } break;
+        
+        case MenuProperty_IconName:
+        {
+            Result = (StringLength(Node->IconName) == 0);
+        } break;
+        
+        case MenuProperty_ToggleType:
+        {
+            Result = (Node->ToggleType == MenuToggle_None);
+        } break;
+        
+        case MenuProperty_ToggleState:
+        {
+            Result = (Node->ToggleState == -1);
+        } break;
+        
+        case MenuProperty_ChildrenDisplay:
+        {
+            Result = (Node->FirstChild < 0);
+        } break;
+        
+        case MenuProperty_Count:
+        {
+        } break;
+    }
+    
+    return Result;
+}
@@ -0,0 +1,881 @@
+// NOTE(trayge): All kernels work on packed 32-bit pixels addressed as bytes. "ARGB" is the
+// StatusNotifierItem wire order (network byte order, A first in memory) and "RGBA" is the
+// usual in-memory order of decoded images (R first in memory). Alpha kernels work on ARGB.
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TRAYGE_PIXEL_X86 1
+#else
+#define TRAYGE_PIXEL_X86 0
+#endif
+
+typedef enum pixel_kernel_level
+{
+    PixelKernel_Scalar,
+    PixelKernel_SSE2,
+    PixelKernel_AVX2,
+    
+    PixelKernel_Count,
+} pixel_kernel_level;
+
+typedef void pixel_fill_kernel(u8 *Dest, u64 Count, u8 A, u8 R, u8 G, u8 B);
+typedef void pixel_gradient_kernel(u8 *Dest, s32 Width, s32 Height, s32 XOffset, s32 YOffset);
+typedef void pixel_convert_kernel(u8 *Dest, u8 *Source, u64 Count);
+typedef void pixel_downscale_kernel(u8 *Dest, s32 DestWidth, s32 DestHeight, u8 *Source, s32 SourceWidth, s32 SourceHeight);
+typedef u64 pixel_diff_kernel(u8 *A, u8 *B, u64 Count, u64 *FirstDiff, u64 *LastDiff);
+
+typedef struct pixel_kernels
+{
+    char *Name;
+    pixel_fill_kernel *Fill;
+    pixel_gradient_kernel *Gradient;
+    pixel_convert_kernel *RGBAToARGB;
+    pixel_convert_kernel *ARGBToRGBA;
+    pixel_convert_kernel *Premultiply;
+    pixel_convert_kernel *Unpremultiply;
+    pixel_downscale_kernel *Downscale;
+    pixel_diff_kernel *Diff;
+} pixel_kernels;
+
+// NOTE(trayge): Fixed-point reciprocals for unpremultiply: C' = (C*Table[A] + 0x8000) >> 16.
+// Entry 256 is an identity multiplier the vector paths use for the alpha lane itself.
+global u32 UnpremultiplyTable[257];
+
+//
+// NOTE(trayge): Scalar reference kernels. The vector paths must produce identical bytes.
+//
+
+function void
+FillPixelsScalar(u8 *Dest, u64 Count, u8 A, u8 R, u8 G, u8 B)
+{
+    for(u64 Index = 0;
+        Index < Count;
+        ++Index)
+    {
+        *Dest++ = A;
+        *Dest++ = R;
+        *Dest++ = G;
+        *Dest++ = B;
+    }
+}
+
+function void
+BuildGradientRamp(u8 *Ramp, s32 First, s32 Count, s32 Width, s32 Offset)
+{
+    for(s32 Index = 0;
+        Index < Count;
+        ++Index)
+    {
+        Ramp[Index] = (u8)(((First + Index)*256)/Width + Offset);
+    }
+}
+
+function void
+GradientPixelsScalar(u8 *Dest, s32 Width, s32 Height, s32 XOffset, s32 YOffset)
+{
+    u8 *Pixel = Dest;
+    for(s32 Y = 0;
+        Y < Height;
+        ++Y)
+    {
+        u8 Green = (u8)((Y*256)/Height + YOffset);
+        for(s32 X = 0;
+            X < Width;
+            ++X)
+        {
+            *Pixel++ = 0xFF;
+            *Pixel++ = 0;
+            *Pixel++ = Green;
+            *Pixel++ = (u8)((X*256)/Width + XOffset);
+        }
+    }
+}
+
+function void
+RGBAToARGBScalar(u8 *Dest, u8 *Source, u64 Count)
+{
+    for(u64 Index = 0;
+        Index < Count;
+        ++Index)
+    {
+        u8 R = Source[0];
+        u8 G = Source[1];
+        u8 B = Source[2];
+        u8 A = Source[3];
+        
+        Dest[0] = A;
+        Dest[1] = R;
+        Dest[2] = G;
+        Dest[3] = B;
+        
+        Source += 4;
+        Dest += 4;
+    }
+}
+
+function void
+ARGBToRGBAScalar(u8 *Dest, u8 *Source, u64 Count)
+{
+    for(u64 Index = 0;
+        Index < Count;
+        ++Index)
+    {
+        u8 A = Source[0];
+        u8 R = Source[1];
+        u8 G = Source[2];
+        u8 B = Source[3];
+        
+        Dest[0] = R;
+        Dest[1] = G;
+        Dest[2] = B;
+        Dest[3] = A;
+        
+        Source += 4;
+        Dest += 4;
+    }
+}
+
+function u8
+PremultiplyChannel(u32 Channel, u32 Alpha)
+{
+    u32 Product = Channel*Alpha + 128;
+    u8 Result = (u8)((Product + (Product >> 8)) >> 8);
+    return Result;
+}
+
+function void
+PremultiplyScalar(u8 *Dest, u8 *Source, u64 Count)
+{
+    for(u64 Index = 0;
+        Index < Count;
+        ++Index)
+    {
+        u32 A = Source[0];
+        
+        Dest[0] = (u8)A;
+        Dest[1] = PremultiplyChannel(Source[1], A);
+        Dest[2] = PremultiplyChannel(Source[2], A);
+        Dest[3] = PremultiplyChannel(Source[3], A);
+        
+        Source += 4;
+        Dest += 4;
+    }
+}
+
+function u8
+UnpremultiplyChannel(u32 Channel, u32 Reciprocal)
+{
+    u32 Value = (Channel*Reciprocal + 0x8000) >> 16;
+    u8 Result = (u8)((Value > 255) ? 255 : Value);
+    return Result;
+}
+
+function void
+UnpremultiplyScalar(u8 *Dest, u8 *Source, u64 Count)
+{
+    for(u64 Index = 0;
+        Index < Count;
+        ++Index)
+    {
+        u8 A = Source[0];
+        u32 Reciprocal = UnpremultiplyTable[A];
+        
+        Dest[0] = A;
+        Dest[1] = UnpremultiplyChannel(Source[1], Reciprocal);
+        Dest[2] = UnpremultiplyChannel(Source[2], Reciprocal);
+        Dest[3] = UnpremultiplyChannel(Source[3], Reciprocal);
+        
+        Source += 4;
+        Dest += 4;
+    }
+}
+
+function void
+DownscaleBoxSpan(u8 *Dest, s32 DestWidth, s32 DestHeight, u8 *Source, s32 SourceWidth, s32 SourceHeight,
+                 s32 DestY, s32 FirstX)
+{
+    s32 MinY = (DestY*SourceHeight)/DestHeight;
+    s32 MaxY = ((DestY + 1)*SourceHeight)/DestHeight;
+    if(MaxY <= MinY)
+    {
+        MaxY = MinY + 1;
+    }
+    
+    for(s32 DestX = FirstX;
+        DestX < DestWidth;
+        ++DestX)
+    {
+        s32 MinX = (DestX*SourceWidth)/DestWidth;
+        s32 MaxX = ((DestX + 1)*SourceWidth)/DestWidth;
+        if(MaxX <= MinX)
+        {
+            MaxX = MinX + 1;
+        }
+        
+        u32 Sums[4] = {};
+        for(s32 Y = MinY;
+            Y < MaxY;
+            ++Y)
+        {
+            u8 *Pixel = Source + ((u64)Y*(u64)SourceWidth + (u64)MinX)*4;
+            for(s32 X = MinX;
+                X < MaxX;
+                ++X)
+            {
+                Sums[0] += *Pixel++;
+                Sums[1] += *Pixel++;
+                Sums[2] += *Pixel++;
+                Sums[3] += *Pixel++;
+            }
+        }
+        
+        u32 Area = (u32)((MaxX - MinX)*(MaxY - MinY));
+        u8 *Out = Dest + ((u64)DestY*(u64)DestWidth + (u64)DestX)*4;
+        for(u32 Channel = 0;
+            Channel < 4;
+            ++Channel)
+        {
+            Out[Channel] = (u8)((Sums[Channel] + Area/2)/Area);
+        }
+    }
+}
+
+function void
+DownscaleBoxScalar(u8 *Dest, s32 DestWidth, s32 DestHeight, u8 *Source, s32 SourceWidth, s32 SourceHeight)
+{
+    for(s32 DestY = 0;
+        DestY < DestHeight;
+        ++DestY)
+    {
+        DownscaleBoxSpan(Dest, DestWidth, DestHeight, Source, SourceWidth, SourceHeight, DestY, 0);
+    }
+}
+
+// NOTE(trayge): Diff kernels return how many pixels differ and widen [FirstDiff, LastDiff] to
+// cover them. Callers start with FirstDiff = Count and LastDiff = 0.
+function u64
+DiffPixelRange(u8 *A, u8 *B, u64 Start, u64 End, u64 *FirstDiff, u64 *LastDiff)
+{
+    u64 Result = 0;
+    
+    u32 *PixelsA = (u32 *)A;
+    u32 *PixelsB = (u32 *)B;
+    for(u64 Index = Start;
+        Index < End;
+        ++Index)
+    {
+        if(PixelsA[Index] != PixelsB[Index])
+        {
+            if(Index < *FirstDiff)
+            {
+                *FirstDiff = Index;
+            }
+            *LastDiff = Index;
+            ++Result;
+        }
+    }
+    
+    return Result;
+}
+
+function u64
+DiffPixelsScalar(u8 *A, u8 *B, u64 Count, u64 *FirstDiff, u64 *LastDiff)
+{
+    u64 Result = DiffPixelRange(A, B, 0, Count, FirstDiff, LastDiff);
+    return Result;
+}
+
+#if TRAYGE_PIXEL_X86
+
+//
+// NOTE(trayge): SSE2 kernels, 16 bytes (4 pixels) per step with scalar tails.
+//
+
+function void
+FillPixelsSSE2(u8 *Dest, u64 Count, u8 A, u8 R, u8 G, u8 B)
+{
+    u32 Packed = (u32)A | ((u32)R << 8) | ((u32)G << 16) | ((u32)B << 24);
+    __m128i Value = _mm_set1_epi32((int)Packed);
+    
+    u64 Index = 0;
+    for(; Index + 4 <= Count; Index += 4)
+    {
+        _mm_storeu_si128((__m128i *)(Dest + Index*4), Value);
+    }
+    
+    FillPixelsScalar(Dest + Index*4, Count - Index, A, R, G, B);
+}
+
+function void
+GradientPixelsSSE2(u8 *Dest, s32 Width, s32 Height, s32 XOffset, s32 YOffset)
+{
+    u8 Ramp[256];
+    __m128i AlphaRed = _mm_set1_epi16(0x00FF);
+    
+    for(s32 FirstX = 0;
+        FirstX < Width;
+        FirstX += (s32)sizeof(Ramp))
+    {
+        s32 Count = Width - FirstX;
+        if(Count > (s32)sizeof(Ramp))
+        {
+            Count = (s32)sizeof(Ramp);
+        }
+        BuildGradientRamp(Ramp, FirstX, Count, Width, XOffset);
+        
+        for(s32 Y = 0;
+            Y < Height;
+            ++Y)
+        {
+            u8 Green = (u8)((Y*256)/Height + YOffset);
+            __m128i GreenVector = _mm_set1_epi8((char)Green);
+            u8 *Row = Dest + ((u64)Y*(u64)Width + (u64)FirstX)*4;
+            
+            s32 X = 0;
+            for(; X + 16 <= Count; X += 16)
+            {
+                __m128i Blue = _mm_loadu_si128((__m128i *)(Ramp + X));
+                __m128i GreenBlueLow = _mm_unpacklo_epi8(GreenVector, Blue);
+                __m128i GreenBlueHigh = _mm_unpackhi_epi8(GreenVector, Blue);
+                
+                u8 *Out = Row + X*4;
+                _mm_storeu_si128((__m128i *)(Out + 0), _mm_unpacklo_epi16(AlphaRed, GreenBlueLow));
+                _mm_storeu_si128((__m128i *)(Out + 16), _mm_unpackhi_epi16(AlphaRed, GreenBlueLow));
+                _mm_storeu_si128((__m128i *)(Out + 32), _mm_unpacklo_epi16(AlphaRed, GreenBlueHigh));
+                _mm_storeu_si128((__m128i *)(Out + 48), _mm_unpackhi_epi16(AlphaRed, GreenBlueHigh));
+            }
+            
+            for(; X < Count; ++X)
+            {
+                u8 *Out = Row + X*4;
+                Out[0] = 0xFF;
+                Out[1] = 0;
+                Out[2] = Green;
+                Out[3] = Ramp[X];
+            }
+        }
+    }
+}
+
+function __m128i
+RotatePixelsLeftSSE2(__m128i Pixels)
+{
+    __m128i Result = _mm_or_si128(_mm_slli_epi32(Pixels, 8), _mm_srli_epi32(Pixels, 24));
+    return Result;
+}
+
+function __m128i
+RotatePixelsRightSSE2(__m128i Pixels)
+{
+    __m128i Result = _mm_or_si128(_mm_srli_epi32(Pixels, 8), _mm_slli_epi32(Pixels, 24));
+    return Result;
+}
+
+function void
+RGBAToARGBSSE2(u8 *Dest, u8 *Source, u64 Count)
+{
+    u64 Index = 0;
+    for(; Index + 4 <= Count; Index += 4)
+    {
+        __m128i Pixels = _mm_loadu_si128((__m128i *)(Source + Index*4));
+        _mm_storeu_si128((__m128i *)(Dest + Index*4), RotatePixelsLeftSSE2(Pixels));
+    }
+    
+    RGBAToARGBScalar(Dest + Index*4, Source + Index*4, Count - Index);
+}
+
+function void
+ARGBToRGBASSE2(u8 *Dest, u8 *Source, u64 Count)
+{
+    u64 Index = 0;
+    for(; Index + 4 <= Count; Index += 4)
+    {
+        __m128i Pixels = _mm_loadu_si128((__m128i *)(Source + Index*4));
+        _mm_storeu_si128((__m128i *)(Dest + Index*4), RotatePixelsRightSSE2(Pixels));
+    }
+    
+    ARGBToRGBAScalar(Dest + Index*4, Source + Index*4, Count - Index);
+}
+
+function __m128i
+PremultiplyWordsSSE2(__m128i Words)
+{
+    __m128i AlphaMask = _mm_set_epi16(0, 0, 0, -1, 0, 0, 0, -1);
+    __m128i Alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(Words, 0x00), 0x00);
+    
+    __m128i Product = _mm_add_epi16(_mm_mullo_epi16(Words, Alpha), _mm_set1_epi16(128));
+    Product = _mm_srli_epi16(_mm_add_epi16(Product, _mm_srli_epi16(Product, 8)), 8);
+    
+    __m128i Result = _mm_or_si128(_mm_and_si128(AlphaMask, Words), _mm_andnot_si128(AlphaMask, Product));
+    return Result;
+}
+
+function void
+PremultiplySSE2(u8 *Dest, u8 *Source, u64 Count)
+{
+    __m128i Zero = _mm_setzero_si128();
+    
+    u64 Index = 0;
+    for(; Index + 4 <= Count; Index += 4)
+    {
+        __m128i Pixels = _mm_loadu_si128((__m128i *)(Source + Index*4));
+        __m128i Low = PremultiplyWordsSSE2(_mm_unpacklo_epi8(Pixels, Zero));
+        __m128i High = PremultiplyWordsSSE2(_mm_unpackhi_epi8(Pixels, Zero));
+        _mm_storeu_si128((__m128i *)(Dest + Index*4), _mm_packus_epi16(Low, High));
+    }
+    
+    PremultiplyScalar(Dest + Index*4, Source + Index*4, Count - Index);
+}
+
+function __m128i
+UnpremultiplyPixelSSE2(__m128i Channels, u8 Alpha)
+{
+    u32 Reciprocal = UnpremultiplyTable[Alpha];
+    __m128i Multiplier = _mm_set_epi32((int)Reciprocal, (int)Reciprocal, (int)Reciprocal, (int)UnpremultiplyTable[256]);
+    __m128i Round = _mm_set1_epi64x(0x8000);
+    
+    // NOTE(trayge): SSE2 has no 32-bit low multiply; do even and odd lanes as 64-bit products.
+    __m128i Even = _mm_mul_epu32(Channels, Multiplier);
+    __m128i Odd = _mm_mul_epu32(_mm_srli_si128(Channels, 4), _mm_srli_si128(Multiplier, 4));
+    Even = _mm_srli_epi64(_mm_add_epi64(Even, Round), 16);
+    Odd = _mm_srli_epi64(_mm_add_epi64(Odd, Round), 16);
+    
+    __m128i Result = _mm_or_si128(Even, _mm_slli_si128(Odd, 4));
+    return Result;
+}
+
+function void
+UnpremultiplySSE2(u8 *Dest, u8 *Source, u64 Count)
+{
+    __m128i Zero = _mm_setzero_si128();
+    
+    u64 Index = 0;
+    for(; Index + 4 <= Count; Index += 4)
+    {
+        u8 *In = Source + Index*4;
+        __m128i Pixels = _mm_loadu_si128((__m128i *)In);
+        __m128i Low = _mm_unpacklo_epi8(Pixels, Zero);
+        __m128i High = _mm_unpackhi_epi8(Pixels, Zero);
+        
+        __m128i P0 = UnpremultiplyPixelSSE2(_mm_unpacklo_epi16(Low, Zero), In[0]);
+        __m128i P1 = UnpremultiplyPixelSSE2(_mm_unpackhi_epi16(Low, Zero), In[4]);
+        __m128i P2 = UnpremultiplyPixelSSE2(_mm_unpacklo_epi16(High, Zero), In[8]);
+        __m128i P3 = UnpremultiplyPixelSSE2(_mm_unpackhi_epi16(High, Zero), In[12]);
+        
+        // NOTE(trayge): Signed saturation then unsigned saturation clamps out-of-range results to 255.
+        __m128i Words = _mm_packus_epi16(_mm_packs_epi32(P0, P1), _mm_packs_epi32(P2, P3));
+        _mm_storeu_si128((__m128i *)(Dest + Index*4), Words);
+    }
+    
+    UnpremultiplyScalar(Dest + Index*4, Source + Index*4, Count - Index);
+}
+
+function void
+DownscaleBoxSSE2(u8 *Dest, s32 DestWidth, s32 DestHeight, u8 *Source, s32 SourceWidth, s32 SourceHeight)
+{
+    if(SourceWidth == DestWidth*2 && SourceHeight == DestHeight*2)
+    {
+        __m128i Zero = _mm_setzero_si128();
+        __m128i Round = _mm_set1_epi16(2);
+        
+        for(s32 DestY = 0;
+            DestY < DestHeight;
+            ++DestY)
+        {
+            u8 *Row0 = Source + (u64)DestY*2*(u64)SourceWidth*4;
+            u8 *Row1 = Row0 + (u64)SourceWidth*4;
+            u8 *Out = Dest + (u64)DestY*(u64)DestWidth*4;
+            
+            s32 DestX = 0;
+            for(; DestX + 2 <= DestWidth; DestX += 2)
+            {
+                __m128i A = _mm_loadu_si128((__m128i *)(Row0 + DestX*8));
+                __m128i B = _mm_loadu_si128((__m128i *)(Row1 + DestX*8));
+                
+                __m128i Low = _mm_add_epi16(_mm_unpacklo_epi8(A, Zero), _mm_unpacklo_epi8(B, Zero));
+                __m128i High = _mm_add_epi16(_mm_unpackhi_epi8(A, Zero), _mm_unpackhi_epi8(B, Zero));
+                Low = _mm_add_epi16(Low, _mm_srli_si128(Low, 8));
+                High = _mm_add_epi16(High, _mm_srli_si128(High, 8));
+                
+                __m128i Sum = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(Low, High), Round), 2);
+                _mm_storel_epi64((__m128i *)(Out + DestX*4), _mm_packus_epi16(Sum, Sum));
+            }
+            
+            DownscaleBoxSpan(Dest, DestWidth, DestHeight, Source, SourceWidth, SourceHeight, DestY, DestX);
+        }
+    }
+    else
+    {
+        DownscaleBoxScalar(Dest, DestWidth, DestHeight, Source, SourceWidth, SourceHeight);
+    }
+}
+
+function u64
+DiffPixelsSSE2(u8 *A, u8 *B, u64 Count, u64 *FirstDiff, u64 *LastDiff)
+{
+    u64 Result = 0;
+    
+    u64 Index = 0;
+    for(; Index + 4 <= Count; Index += 4)
+    {
+        __m128i Equal = _mm_cmpeq_epi32(_mm_loadu_si128((__m128i *)(A + Index*4)),
+                                        _mm_loadu_si128((__m128i *)(B + Index*4)));
+        u32 Mask = ~(u32)_mm_movemask_ps(_mm_castsi128_ps(Equal)) & 0xF;
+        if(Mask)
+        {
+            u64 First = Index + (u64)__builtin_ctz(Mask);
+            if(First < *FirstDiff)
+            {
+                *FirstDiff = First;
+            }
+            *LastDiff = Index + 31 - (u64)__builtin_clz(Mask);
+            Result += (u64)__builtin_popcount(Mask);
+        }
+    }
+    
+    Result += DiffPixelRange(A, B, Index, Count, FirstDiff, LastDiff);
+    return Result;
+}
+
+//
+// NOTE(trayge): AVX2 kernels, 32 bytes (8 pixels) per step. These are compiled with a target
+// attribute so the rest of the program keeps the baseline instruction set.
+//
+
+#define TRAYGE_AVX2 __attribute__((target("avx2")))
+
+TRAYGE_AVX2 function void
+FillPixelsAVX2(u8 *Dest, u64 Count, u8 A, u8 R, u8 G, u8 B)
+{
+    u32 Packed = (u32)A | ((u32)R << 8) | ((u32)G << 16) | ((u32)B << 24);
+    __m256i Value = _mm256_set1_epi32((int)Packed);
+    
+    u64 Index = 0;
+    for(; Index + 8 <= Count; Index += 8)
+    {
+        _mm256_storeu_si256((__m256i *)(Dest + Index*4), Value);
+    }
+    
+    FillPixelsScalar(Dest + Index*4, Count - Index, A, R, G, B);
+}
+
+TRAYGE_AVX2 function void
+GradientPixelsAVX2(u8 *Dest, s32 Width, s32 Height, s32 XOffset, s32 YOffset)
+{
+    u8 Ramp[256];
+    __m256i AlphaRed = _mm256_set1_epi16(0x00FF);
+    
+    for(s32 FirstX = 0;
+        FirstX < Width;
+        FirstX += (s32)sizeof(Ramp))
+    {
+        s32 Count = Width - FirstX;
+        if(Count > (s32)sizeof(Ramp))
+        {
+            Count = (s32)sizeof(Ramp);
+        }
+        BuildGradientRamp(Ramp, FirstX, Count, Width, XOffset);
+        
+        for(s32 Y = 0;
+            Y < Height;
+            ++Y)
+        {
+            u8 Green = (u8)((Y*256)/Height + YOffset);
+            __m256i GreenVector = _mm256_set1_epi8((char)Green);
+            u8 *Row = Dest + ((u64)Y*(u64)Width + (u64)FirstX)*4;
+            
+            s32 X = 0;
+            for(; X + 32 <= Count; X += 32)
+            {
+                // NOTE(trayge): Unpacks stay within 128-bit lanes, so interleave the quadwords
+                // up front and swap the halves back when storing.
+                __m256i Blue = _mm256_loadu_si256((__m256i *)(Ramp + X));
+                Blue = _mm256_permute4x64_epi64(Blue, 0xD8);
+                
+                __m256i GreenBlueLow = _mm256_unpacklo_epi8(GreenVector, Blue);
+                __m256i GreenBlueHigh = _mm256_unpackhi_epi8(GreenVector, Blue);
+                
+                __m256i P0 = _mm256_unpacklo_epi16(AlphaRed, GreenBlueLow);
+                __m256i P1 = _mm256_unpackhi_epi16(AlphaRed, GreenBlueLow);
+                __m256i P2 = _mm256_unpacklo_epi16(AlphaRed, GreenBlueHigh);
+                __m256i P3 = _mm256_unpackhi_epi16(AlphaRed, GreenBlueHigh);
+                
+                u8 *Out = Row + X*4;
+                _mm256_storeu_si256((__m256i *)(Out + 0), _mm256_permute2x128_si256(P0, P1, 0x20));
+                _mm256_storeu_si256((__m256i *)(Out + 32), _mm256_permute2x128_si256(P0, P1, 0x31));
+                _mm256_storeu_si256((__m256i *)(Out + 64), _mm256_permute2x128_si256(P2, P3, 0x20));
+                _mm256_storeu_si256((__m256i *)(Out + 96), _mm256_permute2x128_si256(P2, P3, 0x31));
+            }
+            
+            for(; X < Count; ++X)
+            {
+                u8 *Out = Row + X*4;
+                Out[0] = 0xFF;
+                Out[1] = 0;
+                Out[2] = Green;
+                Out[3] = Ramp[X];
+            }
+        }
+    }
+}
+
+TRAYGE_AVX2 function void
+RGBAToARGBAVX2(u8 *Dest, u8 *Source, u64 Count)
+{
+    __m256i Shuffle = _mm256_setr_epi8(3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14,
+                                       3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14);
+    
+    u64 Index = 0;
+    for(; Index + 8 <= Count; Index += 8)
+    {
+        __m256i Pixels = _mm256_loadu_si256((__m256i *)(Source + Index*4));
+        _mm256_storeu_si256((__m256i *)(Dest + Index*4), _mm256_shuffle_epi8(Pixels, Shuffle));
+    }
+    
+    RGBAToARGBScalar(Dest + Index*4, Source + Index*4, Count - Index);
+}
+
+TRAYGE_AVX2 function void
+ARGBToRGBAAVX2(u8 *Dest, u8 *Source, u64 Count)
+{
+    __m256i Shuffle = _mm256_setr_epi8(1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12,
+                                       1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12);
+    
+    u64 Index = 0;
+    for(; Index + 8 <= Count; Index += 8)
+    {
+        __m256i Pixels = _mm256_loadu_si256((__m256i *)(Source + Index*4));
+        _mm256_storeu_si256((__m256i *)(Dest + Index*4), _mm256_shuffle_epi8(Pixels, Shuffle));
+    }
+    
+    ARGBToRGBAScalar(Dest + Index*4, Source + Index*4, Count - Index);
+}
+
+TRAYGE_AVX2 function __m256i
+PremultiplyWordsAVX2(__m256i Words)
+{
+    __m256i AlphaMask = _mm256_set_epi16(0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1);
+    __m256i Alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(Words, 0x00), 0x00);
+    
+    __m256i Product = _mm256_add_epi16(_mm256_mullo_epi16(Words, Alpha), _mm256_set1_epi16(128));
+    Product = _mm256_srli_epi16(_mm256_add_epi16(Product, _mm256_srli_epi16(Product, 8)), 8);
+    
+    __m256i Result = _mm256_blendv_epi8(Product, Words, AlphaMask);
+    return Result;
+}
+
+TRAYGE_AVX2 function void
+PremultiplyAVX2(u8 *Dest, u8 *Source, u64 Count)
+{
+    __m256i Zero = _mm256_setzero_si256();
+    
+    u64 Index = 0;
+    for(; Index + 8 <= Count; Index += 8)
+    {
+        __m256i Pixels = _mm256_loadu_si256((__m256i *)(Source + Index*4));
+        __m256i Low = PremultiplyWordsAVX2(_mm256_unpacklo_epi8(Pixels, Zero));
+        __m256i High = PremultiplyWordsAVX2(_mm256_unpackhi_epi8(Pixels, Zero));
+        _mm256_storeu_si256((__m256i *)(Dest + Index*4), _mm256_packus_epi16(Low, High));
+    }
+    
+    PremultiplyScalar(Dest + Index*4, Source + Index*4, Count - Index);
+}
+
+TRAYGE_AVX2 function __m256i
+UnpremultiplyPairAVX2(u8 *Source)
+{
+    __m256i Channels = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i *)Source));
+    
+    // NOTE(trayge): Gather the reciprocal for each pixel's alpha into its colour lanes and the
+    // identity entry into its alpha lane.
+    __m256i Indices = _mm256_shuffle_epi32(Channels, 0x00);
+    Indices = _mm256_blend_epi32(Indices, _mm256_set1_epi32(256), 0x11);
+    __m256i Multiplier = _mm256_i32gather_epi32((int *)UnpremultiplyTable, Indices, 4);
+    
+    __m256i Result = _mm256_mullo_epi32(Channels, Multiplier);
+    Result = _mm256_srli_epi32(_mm256_add_epi32(Result, _mm256_set1_epi32(0x8000)), 16);
+    return Result;
+}
+
+TRAYGE_AVX2 function void
+UnpremultiplyAVX2(u8 *Dest, u8 *Source, u64 Count)
+{
+    __m256i Order = _mm256_setr_epi32(0, 4, 1, 5, 2, 3, 6, 7);
+    
+    u64 Index = 0;
+    for(; Index + 4 <= Count; Index += 4)
+    {
+        __m256i P01 = UnpremultiplyPairAVX2(Source + Index*4);
+        __m256i P23 = UnpremultiplyPairAVX2(Source + Index*4 + 8);
+        
+        __m256i Bytes = _mm256_packus_epi16(_mm256_packs_epi32(P01, P23), _mm256_setzero_si256());
+        Bytes = _mm256_permutevar8x32_epi32(Bytes, Order);
+        _mm_storeu_si128((__m128i *)(Dest + Index*4), _mm256_castsi256_si128(Bytes));
+    }
+    
+    UnpremultiplyScalar(Dest + Index*4, Source + Index*4, Count - Index);
+}
+
+TRAYGE_AVX2 function void
+DownscaleBoxAVX2(u8 *Dest, s32 DestWidth, s32 DestHeight, u8 *Source, s32 SourceWidth, s32 SourceHeight)
+{
+    if(SourceWidth == DestWidth*2 && SourceHeight == DestHeight*2)
+    {
+        __m256i Zero = _mm256_setzero_si256();
+        __m256i Round = _mm256_set1_epi16(2);
+        
+        for(s32 DestY = 0;
+            DestY < DestHeight;
+            ++DestY)
+        {
+            u8 *Row0 = Source + (u64)DestY*2*(u64)SourceWidth*4;
+            u8 *Row1 = Row0 + (u64)SourceWidth*4;
+            u8 *Out = Dest + (u64)DestY*(u64)DestWidth*4;
+            
+            s32 DestX = 0;
+            for(; DestX + 4 <= DestWidth; DestX += 4)
+            {
+                __m256i A = _mm256_loadu_si256((__m256i *)(Row0 + DestX*8));
+                __m256i B = _mm256_loadu_si256((__m256i *)(Row1 + DestX*8));
+                
+                __m256i Low = _mm256_add_epi16(_mm256_unpacklo_epi8(A, Zero), _mm256_unpacklo_epi8(B, Zero));
+                __m256i High = _mm256_add_epi16(_mm256_unpackhi_epi8(A, Zero), _mm256_unpackhi_epi8(B, Zero));
+                Low = _mm256_add_epi16(Low, _mm256_srli_si256(Low, 8));
+                High = _mm256_add_epi16(High, _mm256_srli_si256(High, 8));
+                
+                __m256i Sum = _mm256_srli_epi16(_mm256_add_epi16(_mm256_unpacklo_epi64(Low, High), Round), 2);
+                __m256i Bytes = _mm256_permute4x64_epi64(_mm256_packus_epi16(Sum, Sum), 0x08);
+                _mm_storeu_si128((__m128i *)(Out + DestX*4), _mm256_castsi256_si128(Bytes));
+            }
+            
+            DownscaleBoxSpan(Dest, DestWidth, DestHeight, Source, SourceWidth, SourceHeight, DestY, DestX);
+        }
+    }
+    else
+    {
+        DownscaleBoxScalar(Dest, DestWidth, DestHeight, Source, SourceWidth, SourceHeight);
+    }
+}
+
+TRAYGE_AVX2 function u64
+DiffPixelsAVX2(u8 *A, u8 *B, u64 Count, u64 *FirstDiff, u64 *LastDiff)
+{
+    u64 Result = 0;
+    
+    u64 Index = 0;
+    for(; Index + 8 <= Count; Index += 8)
+    {
+        __m256i Equal = _mm256_cmpeq_epi32(_mm256_loadu_si256((__m256i *)(A + Index*4)),
+                                           _mm256_loadu_si256((__m256i *)(B + Index*4)));
+        u32 Mask = ~(u32)_mm256_movemask_ps(_mm256_castsi256_ps(Equal)) & 0xFF;
+        if(Mask)
+        {
+            u64 First = Index + (u64)__builtin_ctz(Mask);
+            if(First < *FirstDiff)
+            {
+                *FirstDiff = First;
+            }
+            *LastDiff = Index + 31 - (u64)__builtin_clz(Mask);
+            Result += (u64)__builtin_popcount(Mask);
+        }
+    }
+    
+    Result += DiffPixelRange(A, B, Index, Count, FirstDiff, LastDiff);
+    return Result;
+}
+
+#endif
+
+global pixel_kernels PixelKernelTable[PixelKernel_Count] =
+{
+    {"scalar", FillPixelsScalar, GradientPixelsScalar, RGBAToARGBScalar, ARGBToRGBAScalar, PremultiplyScalar, UnpremultiplyScalar, DownscaleBoxScalar, DiffPixelsScalar},
+#if TRAYGE_PIXEL_X86
+    {"sse2", FillPixelsSSE2, GradientPixelsSSE2, RGBAToARGBSSE2, ARGBToRGBASSE2, PremultiplySSE2, UnpremultiplySSE2, DownscaleBoxSSE2, DiffPixelsSSE2},
+    {"avx2", FillPixelsAVX2, GradientPixelsAVX2, RGBAToARGBAVX2, ARGBToRGBAAVX2, PremultiplyAVX2, UnpremultiplyAVX2, DownscaleBoxAVX2, DiffPixelsAVX2},
+#endif
+};
+
+global pixel_kernels *PixelKernels = PixelKernelTable;
+
+function b32
+PixelKernelLevelSupported(pixel_kernel_level Level)
+{
+    b32 Result = false;
+    
+    switch(Level)
+    {
+        case PixelKernel_Scalar:
+        {
+            Result = true;
+        } break;
+
+#if TRAYGE_PIXEL_X86
+        case PixelKernel_SSE2:
+        {
+            Result = __builtin_cpu_supports("sse2");
+        } break;
+        
+        case PixelKernel_AVX2:
+        {
+            Result = __builtin_cpu_supports("avx2");
+        } break;
+#endif
+        
+        default:
+        {
+        } break;
+    }
+    
+    return Result;
+}
+
+function b32
+ParsePixelKernelLevel(string Name, pixel_kernel_level *Level)
+{
+    b32 Result = false;
+    
+    for(u32 Candidate = 0;
+        Candidate < PixelKernel_Count;
+        ++Candidate)
+    {
+        if(StringsAreEqual(Name, Str(PixelKernelTable[Candidate].Name), 0))
+        {
+            *Level = (pixel_kernel_level)Candidate;
+            Result = true;
+            break;
+        }
+    }
+    
+    return Result;
+}
+
+function pixel_kernel_level
+InitPixelKernels(pixel_kernel_level MaxLevel)
+{
+    UnpremultiplyTable[0] = 0;
+    for(u32 Alpha = 1;
+        Alpha < 256;
+        ++Alpha)
+    {
+        UnpremultiplyTable[Alpha] = (255*65536 + Alpha/2)/Alpha;
+    }
+    UnpremultiplyTable[256] = 65536;
+
+#if TRAYGE_PIXEL_X86
+    __builtin_cpu_init();
+#endif
+    
+    pixel_kernel_level Level = PixelKernel_Scalar;
+    for(u32 Candidate = PixelKernel_Scalar;
+        Candidate <= (u32)MaxLevel && Candidate < PixelKernel_Count;
+        ++Candidate)
+    {
+        if(PixelKernelLevelSupported((pixel_kernel_level)Candidate))
+        {
+            Level = (pixel_kernel_level)Candidate;
+        }
+    }
+    
+    PixelKernels = PixelKernelTable + Level;
+    return Level;
+}
@@ -0,0 +1,292 @@
+#include <time.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "trayge_types.h"
+#include "trayge_string.h"
+#include "trayge_pixel.h"
+
+#define BenchImageSize 256
+#define BenchPixelCount (BenchImageSize*BenchImageSize)
+#define BenchIterations 200
+
+typedef enum bench_kernel_type
+{
+    BenchKernel_Gradient,
+    BenchKernel_Fill,
+    BenchKernel_RGBAToARGB,
+    BenchKernel_ARGBToRGBA,
+    BenchKernel_Premultiply,
+    BenchKernel_Unpremultiply,
+    BenchKernel_Downscale,
+    BenchKernel_Diff,
+    
+    BenchKernel_Count,
+} bench_kernel_type;
+
+global char *BenchKernelNames[BenchKernel_Count] =
+{
+    "gradient",
+    "fill",
+    "rgba-to-argb",
+    "argb-to-rgba",
+    "premultiply",
+    "unpremultiply",
+    "downscale-2x",
+    "diff",
+};
+
+function u64
+GetMonotonicTime(void)
+{
+    struct timespec Now = {};
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    
+    u64 Result = (u64)Now.tv_sec*Billion + (u64)Now.tv_nsec;
+    return Result;
+}
+
+// NOTE(trayge): The per-pixel loop RenderIconImage used before the kernels existed, kept as the
+// baseline every level is compared against.
+function void
+ReferenceGradient(u8 *Dest, s32 Width, s32 Height, s32 XOffset, s32 YOffset)
+{
+    u8 *Pixel = Dest;
+    for(s32 Y = 0;
+        Y < Height;
+        ++Y)
+    {
+        u8 Green = (u8)((Y*256)/Height + YOffset);
+        for(s32 X = 0;
+            X < Width;
+            ++X)
+        {
+            *Pixel++ = 0xFF;
+            *Pixel++ = 0;
+            *Pixel++ = Green;
+            *Pixel++ = (u8)((X*256)/Width + XOffset);
+        }
+    }
+}
+
+function void
+RunKernel(pixel_kernels *Kernels, bench_kernel_type Type, u8 *Dest, u8 *Source, u8 *Other, u32 Iteration)
+{
+    switch(Type)
+    {
+        case BenchKernel_Gradient:
+        {
+            Kernels->Gradient(Dest, BenchImageSize, BenchImageSize, (s32)Iteration, (s32)Iteration*3);
+        } break;
+        
+        case BenchKernel_Fill:
+        {
+            Kernels->Fill(Dest, BenchPixelCount, 0xFF, (u8)Iteration, 0x80, 0x40);
+        } break;
+        
+        case BenchKernel_RGBAToARGB:
+        {
+            Kernels->RGBAToARGB(Dest, Source, BenchPixelCount);
+        } break;
+        
+        case BenchKernel_ARGBToRGBA:
+        {
+            Kernels->ARGBToRGBA(Dest, Source, BenchPixelCount);
+        } break;
+        
+        case BenchKernel_Premultiply:
+        {
+            Kernels->Premultiply(Dest, Source, BenchPixelCount);
+        } break;
+        
+        case BenchKernel_Unpremultiply:
+        {
+            Kernels->Unpremultiply(Dest, Source, BenchPixelCount);
+        } break;
+        
+        case BenchKernel_Downscale:
+        {
+            Kernels->Downscale(Dest, BenchImageSize/2, BenchImageSize/2, Source, BenchImageSize, BenchImageSize);
+        } break;
+        
+        case BenchKernel_Diff:
+        {
+            u64 *Out = (u64 *)Dest;
+            Out[1] = BenchPixelCount;
+            Out[2] = 0;
+            Out[0] = Kernels->Diff(Source, Other, BenchPixelCount, Out + 1, Out + 2);
+        } break;
+        
+        InvalidDefaultCase;
+    }
+}
+
+function u64
+BenchKernelOutputSize(bench_kernel_type Type)
+{
+    u64 Result = BenchPixelCount*4;
+    if(Type == BenchKernel_Downscale)
+    {
+        Result = BenchPixelCount;
+    }
+    else if(Type == BenchKernel_Diff)
+    {
+        Result = 3*sizeof(u64);
+    }
+    
+    return Result;
+}
+
+function b32
+CheckOddSizes(pixel_kernels *Kernels, u8 *Source, u8 *Expected, u8 *Actual)
+{
+    b32 Result = true;
+    
+    // NOTE(trayge): Odd widths and counts exercise the scalar tails of the vector paths.
+    s32 Sizes[] = {1, 3, 7, 22, 33};
+    for(u32 SizeIndex = 0;
+        SizeIndex < ArrayCount(Sizes);
+        ++SizeIndex)
+    {
+        s32 Size = Sizes[SizeIndex];
+        u64 Count = (u64)(Size*Size);
+        u64 Bytes = Count*4;
+        
+        PixelKernelTable[PixelKernel_Scalar].Gradient(Expected, Size, Size, 7, 11);
+        Kernels->Gradient(Actual, Size, Size, 7, 11);
+        Result &= !memcmp(Expected, Actual, Bytes);
+        
+        PixelKernelTable[PixelKernel_Scalar].Unpremultiply(Expected, Source, Count);
+        Kernels->Unpremultiply(Actual, Source, Count);
+        Result &= !memcmp(Expected, Actual, Bytes);
+        
+        PixelKernelTable[PixelKernel_Scalar].Premultiply(Expected, Source, Count);
+        Kernels->Premultiply(Actual, Source, Count);
+        Result &= !memcmp(Expected, Actual, Bytes);
+        
+        PixelKernelTable[PixelKernel_Scalar].Downscale(Expected, Size, Size, Source, Size*2, Size*2);
+        Kernels->Downscale(Actual, Size, Size, Source, Size*2, Size*2);
+        Result &= !memcmp(Expected, Actual, Bytes);
+        
+        u64 ExpectedRange[2] = {Count, 0};
+        u64 ActualRange[2] = {Count, 0};
+        u64 ExpectedCount = PixelKernelTable[PixelKernel_Scalar].Diff(Source, Source + Bytes, Count, ExpectedRange, ExpectedRange + 1);
+        u64 ActualCount = Kernels->Diff(Source, Source + Bytes, Count, ActualRange, ActualRange + 1);
+        Result &= (ExpectedCount == ActualCount && !memcmp(ExpectedRange, ActualRange, sizeof(ExpectedRange)));
+    }
+    
+    return Result;
+}
+
+int
+main(int ArgumentCount, char **Arguments)
+{
+    InitPixelKernels(PixelKernel_Scalar);
+    
+    u64 BufferSize = BenchPixelCount*4;
+    u8 *Source = malloc(BufferSize);
+    u8 *Expected = malloc(BufferSize);
+    u8 *Actual = malloc(BufferSize);
+    u8 *Other = malloc(BufferSize);
+    
+    u32 Seed = 0x12345678;
+    for(u64 Index = 0;
+        Index < BufferSize;
+        ++Index)
+    {
+        Seed = Seed*1664525u + 1013904223u;
+        Source[Index] = (u8)(Seed >> 24);
+    }
+    
+    // NOTE(trayge): A mostly identical frame with a small changed patch, like a badge update.
+    memcpy(Other, Source, BufferSize);
+    for(u32 Y = 100;
+        Y < 120;
+        ++Y)
+    {
+        memset(Other + (Y*BenchImageSize + 180)*4, 0x5A, 24*4);
+    }
+    
+    b32 Failed = false;
+    
+    printf("%-14s %-8s %10s %10s %8s\n", "kernel", "level", "ns/pixel", "MPixel/s", "speedup");
+    
+    {
+        u64 Start = GetMonotonicTime();
+        for(u32 Iteration = 0;
+            Iteration < BenchIterations;
+            ++Iteration)
+        {
+            ReferenceGradient(Expected, BenchImageSize, BenchImageSize, (s32)Iteration, (s32)Iteration*3);
+        }
+        f64 Elapsed = (f64)(GetMonotonicTime() - Start);
+        f64 PerPixel = Elapsed / ((f64)BenchPixelCount*BenchIterations);
+        
+        printf("%-14s %-8s %10.3f %10.1f %8s\n", "gradient", "baseline", PerPixel, 1000.0 / PerPixel, "1.00x");
+    }
+    
+    for(u32 Type = 0;
+        Type < BenchKernel_Count;
+        ++Type)
+    {
+        f64 ScalarPerPixel = 0;
+        
+        for(u32 Level = 0;
+            Level < PixelKernel_Count;
+            ++Level)
+        {
+            if(!PixelKernelLevelSupported((pixel_kernel_level)Level))
+            {
+                continue;
+            }
+            
+            pixel_kernels *Kernels = PixelKernelTable + Level;
+            
+            u64 Start = GetMonotonicTime();
+            for(u32 Iteration = 0;
+                Iteration < BenchIterations;
+                ++Iteration)
+            {
+                RunKernel(Kernels, (bench_kernel_type)Type, Actual, Source, Other, Iteration);
+            }
+            f64 Elapsed = (f64)(GetMonotonicTime() - Start);
+            f64 PerPixel = Elapsed / ((f64)BenchPixelCount*BenchIterations);
+            
+            if(Level == PixelKernel_Scalar)
+            {
+                if(Type == BenchKernel_Gradient && memcmp(Expected, Actual, BenchKernelOutputSize(BenchKernel_Gradient)))
+                {
+                    printf("gradient/scalar: output differs from baseline\n");
+                    Failed = true;
+                }
+                
+                ScalarPerPixel = PerPixel;
+                memcpy(Expected, Actual, BenchKernelOutputSize((bench_kernel_type)Type));
+            }
+            else if(memcmp(Expected, Actual, BenchKernelOutputSize((bench_kernel_type)Type)))
+            {
+                printf("%s/%s: output differs from scalar\n", BenchKernelNames[Type], Kernels->Name);
+                Failed = true;
+            }
+            
+            printf("%-14s %-8s %10.3f %10.1f %7.2fx\n", BenchKernelNames[Type], Kernels->Name,
+                   PerPixel, 1000.0 / PerPixel, ScalarPerPixel / PerPixel);
+        }
+    }
+    
+    for(u32 Level = 1;
+        Level < PixelKernel_Count;
+        ++Level)
+    {
+        if(PixelKernelLevelSupported((pixel_kernel_level)Level) &&
+           !CheckOddSizes(PixelKernelTable + Level, Source, Expected, Actual))
+        {
+            printf("%s: tail handling differs from scalar\n", PixelKernelTable[Level].Name);
+            Failed = true;
+        }
+    }
+    
+    return Failed ? 1 : 0;
+}
@@ -0,0 +1,232 @@
+// NOTE(trayge): Minimal PNG encoder for tmpfs-backed icon themes. The zlib stream uses stored
+// (uncompressed) deflate blocks: the files never leave the machine, and hosts decode them in
+// a single memcpy-like pass, so spending CPU on compression would only cost frame time.
+
+#define PNGStoredBlockMax 65535
+#define AdlerModulus 65521
+#define AdlerBlockMax 5552
+
+global u32 CRC32Table[256];
+
+typedef struct png_writer
+{
+    u8 *At;
+    u32 AdlerA;
+    u32 AdlerB;
+    u64 BlockRemaining;
+    u64 RawRemaining;
+} png_writer;
+
+function void
+InitCRC32Table(void)
+{
+    for(u32 Index = 0;
+        Index < 256;
+        ++Index)
+    {
+        u32 Value = Index;
+        for(u32 Bit = 0;
+            Bit < 8;
+            ++Bit)
+        {
+            Value = (Value & 1) ? (0xEDB88320u ^ (Value >> 1)) : (Value >> 1);
+        }
+        CRC32Table[Index] = Value;
+    }
+}
+
+function u32
+ComputeCRC32(u8 *Bytes, u64 Count)
+{
+    if(!CRC32Table[1])
+    {
+        InitCRC32Table();
+    }
+    
+    u32 Result = 0xFFFFFFFFu;
+    for(u64 Index = 0;
+        Index < Count;
+        ++Index)
+    {
+        Result = CRC32Table[(Result ^ Bytes[Index]) & 0xFF] ^ (Result >> 8);
+    }
+    
+    return Result ^ 0xFFFFFFFFu;
+}
+
+function void
+UpdateAdler32(png_writer *Writer, u8 *Bytes, u64 Count)
+{
+    while(Count)
+    {
+        u64 Chunk = (Count < AdlerBlockMax) ? Count : AdlerBlockMax;
+        for(u64 Index = 0;
+            Index < Chunk;
+            ++Index)
+        {
+            Writer->AdlerA += Bytes[Index];
+            Writer->AdlerB += Writer->AdlerA;
+        }
+        
+        Writer->AdlerA %= AdlerModulus;
+        Writer->AdlerB %= AdlerModulus;
+        
+        Bytes += Chunk;
+        Count -= Chunk;
+    }
+}
+
+function void
+PutU8(png_writer *Writer, u8 Value)
+{
+    *Writer->At++ = Value;
+}
+
+function void
+PutU32BE(png_writer *Writer, u32 Value)
+{
+    PutU8(Writer, (u8)(Value >> 24));
+    PutU8(Writer, (u8)(Value >> 16));
+    PutU8(Writer, (u8)(Value >> 8));
+    PutU8(Writer, (u8)Value);
+}
+
+function void
+PutBytes(png_writer *Writer, void *Bytes, u64 Count)
+{
+    u8 *Source = Bytes;
+    for(u64 Index = 0;
+        Index < Count;
+        ++Index)
+    {
+        *Writer->At++ = Source[Index];
+    }
+}
+
+function void
+PutDeflateData(png_writer *Writer, u8 *Bytes, u64 Count)
+{
+    while(Count)
+    {
+        if(!Writer->BlockRemaining)
+        {
+            u64 Length = (Writer->RawRemaining < PNGStoredBlockMax) ? Writer->RawRemaining : PNGStoredBlockMax;
+            PutU8(Writer, (Length == Writer->RawRemaining) ? 1 : 0);
+            PutU8(Writer, (u8)Length);
+            PutU8(Writer, (u8)(Length >> 8));
+            PutU8(Writer, (u8)~Length);
+            PutU8(Writer, (u8)(~Length >> 8));
+            Writer->BlockRemaining = Length;
+        }
+        
+        u64 Chunk = (Count < Writer->BlockRemaining) ? Count : Writer->BlockRemaining;
+        PutBytes(Writer, Bytes, Chunk);
+        UpdateAdler32(Writer, Bytes, Chunk);
+        
+        Writer->BlockRemaining -= Chunk;
+        Writer->RawRemaining -= Chunk;
+        Bytes += Chunk;
+        Count -= Chunk;
+    }
+}
+
+function void
+EndPNGChunk(png_writer *Writer, u8 *ChunkStart)
+{
+    // NOTE(trayge): ChunkStart points at the length field; the CRC covers type and data.
+    u64 DataSize = (u64)(Writer->At - ChunkStart) - 8;
+    
+    png_writer LengthWriter = {};
+    LengthWriter.At = ChunkStart;
+    PutU32BE(&LengthWriter, (u32)DataSize);
+    PutU32BE(Writer, ComputeCRC32(ChunkStart + 4, DataSize + 4));
+}
+
+function u64
+PNGRawSize(s32 Width, s32 Height)
+{
+    u64 Result = (u64)Height*(1 + (u64)Width*4);
+    return Result;
+}
+
+function u64
+PNGEncodedSize(s32 Width, s32 Height)
+{
+    u64 RawSize = PNGRawSize(Width, Height);
+    u64 BlockCount = (RawSize + PNGStoredBlockMax - 1) / PNGStoredBlockMax;
+    if(!BlockCount)
+    {
+        BlockCount = 1;
+    }
+    
+    u64 Result = 8 + (12 + 13) + (12 + 2 + BlockCount*5 + RawSize + 4) + 12;
+    return Result;
+}
+
+// NOTE(trayge): Source is ARGB in network byte order, as served in IconPixmap. Dest must hold
+// PNGEncodedSize bytes. Returns the number of bytes written.
+function u64
+EncodePNG(u8 *Dest, u8 *Source, s32 Width, s32 Height)
+{
+    png_writer Writer = {};
+    Writer.At = Dest;
+    Writer.AdlerA = 1;
+    Writer.RawRemaining = PNGRawSize(Width, Height);
+    
+    u8 Signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    PutBytes(&Writer, Signature, sizeof(Signature));
+    
+    u8 *Chunk = Writer.At;
+    PutU32BE(&Writer, 0);
+    PutBytes(&Writer, "IHDR", 4);
+    PutU32BE(&Writer, (u32)Width);
+    PutU32BE(&Writer, (u32)Height);
+    PutU8(&Writer, 8);
+    PutU8(&Writer, 6);
+    PutU8(&Writer, 0);
+    PutU8(&Writer, 0);
+    PutU8(&Writer, 0);
+    EndPNGChunk(&Writer, Chunk);
+    
+    Chunk = Writer.At;
+    PutU32BE(&Writer, 0);
+    PutBytes(&Writer, "IDAT", 4);
+    PutU8(&Writer, 0x78);
+    PutU8(&Writer, 0x01);
+    
+    u8 Row[256*4];
+    u32 RowPixels = sizeof(Row)/4;
+    for(s32 Y = 0;
+        Y < Height;
+        ++Y)
+    {
+        u8 Filter = 0;
+        PutDeflateData(&Writer, &Filter, 1);
+        
+        u8 *SourceRow = Source + (u64)Y*(u64)Width*4;
+        for(s32 X = 0;
+            X < Width;
+            X += (s32)RowPixels)
+        {
+            u64 Count = (u64)(Width - X);
+            if(Count > RowPixels)
+            {
+                Count = RowPixels;
+            }
+            
+            PixelKernels->ARGBToRGBA(Row, SourceRow + (u64)X*4, Count);
+            PutDeflateData(&Writer, Row, Count*4);
+        }
+    }
+    
+    PutU32BE(&Writer, (Writer.AdlerB << 16) | Writer.AdlerA);
+    EndPNGChunk(&Writer, Chunk);
+    
+    Chunk = Writer.At;
+    PutU32BE(&Writer, 0);
+    PutBytes(&Writer, "IEND", 4);
+    EndPNGChunk(&Writer, Chunk);
+    
+    u64 Result = (u64)(Writer.At - Dest);
+    return Result;
+}
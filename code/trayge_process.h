@@ -0,0 +1,265 @@
+//
+// NOTE(trayge): Helpers for the offline tools that drive a trayge instance: a private bus
+// daemon, child processes and their CPU usage, and the client side of the bus. Nothing here is
+// used by trayge itself.
+//
+
+typedef struct bus_daemon
+{
+    pid_t Pid;
+    char Address[512];
+} bus_daemon;
+
+function u64
+GetMonotonicTime(void)
+{
+    struct timespec Now = {};
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    
+    u64 Result = (u64)Now.tv_sec*Billion + (u64)Now.tv_nsec;
+    return Result;
+}
+
+function u64
+MessageSize(DBusMessage *Message)
+{
+    u64 Result = 0;
+    
+    char *Bytes = 0;
+    s32 Count = 0;
+    if(dbus_message_marshal(Message, &Bytes, &Count))
+    {
+        Result = (u64)Count;
+        dbus_free(Bytes);
+    }
+    
+    return Result;
+}
+
+// NOTE(trayge): Writes the path of Name next to ProgramPath, so tools find the trayge binary
+// built alongside them.
+function void
+GetSiblingPath(char *Dest, u64 DestSize, char *ProgramPath, char *Name)
+{
+    snprintf(Dest, DestSize, "%s", ProgramPath);
+    char *Slash = strrchr(Dest, '/');
+    snprintf(Slash ? Slash + 1 : Dest, DestSize - (u64)(Slash ? Slash + 1 - Dest : 0), "%s", Name);
+}
+
+function pid_t
+SpawnProcess(char **Arguments)
+{
+    pid_t Result = fork();
+    if(Result == 0)
+    {
+        execvp(Arguments[0], Arguments);
+        fprintf(stderr, "Could not run %s\n", Arguments[0]);
+        _exit(127);
+    }
+    
+    return Result;
+}
+
+function void
+StopProcess(pid_t Pid)
+{
+    if(Pid > 0)
+    {
+        kill(Pid, SIGTERM);
+        waitpid(Pid, 0, 0);
+    }
+}
+
+// NOTE(trayge): Starts dbus-daemon with the stock session configuration and points
+// DBUS_SESSION_BUS_ADDRESS at it, so both our own connections and spawned children use it.
+function b32
+StartBusDaemon(bus_daemon *Daemon)
+{
+    b32 Result = false;
+    *Daemon = (bus_daemon){};
+    
+    s32 Pipe[2];
+    if(pipe(Pipe) == 0)
+    {
+        char AddressArgument[64];
+        snprintf(AddressArgument, sizeof(AddressArgument), "--print-address=%d", Pipe[1]);
+        
+        char *Arguments[] = {"dbus-daemon", "--session", "--nofork", AddressArgument, 0};
+        Daemon->Pid = SpawnProcess(Arguments);
+        close(Pipe[1]);
+        
+        u64 Length = 0;
+        while(Length < sizeof(Daemon->Address) - 1)
+        {
+            s64 ReadCount = read(Pipe[0], Daemon->Address + Length, 1);
+            if(ReadCount <= 0 || Daemon->Address[Length] == '\n')
+            {
+                break;
+            }
+            
+            ++Length;
+        }
+        Daemon->Address[Length] = 0;
+        close(Pipe[0]);
+        
+        Result = (Daemon->Pid > 0 && Length > 0);
+        if(Result)
+        {
+            setenv("DBUS_SESSION_BUS_ADDRESS", Daemon->Address, 1);
+        }
+        else
+        {
+            StopProcess(Daemon->Pid);
+            Daemon->Pid = 0;
+        }
+    }
+    
+    return Result;
+}
+
+function void
+StopBusDaemon(bus_daemon *Daemon)
+{
+    StopProcess(Daemon->Pid);
+    Daemon->Pid = 0;
+}
+
+// NOTE(trayge): User plus system time in nanoseconds, from fields 14 and 15 of
+// /proc/<pid>/stat. The command name in field 2 may contain spaces, so parsing starts after
+// its closing parenthesis.
+function u64
+GetProcessCPUTime(pid_t Pid)
+{
+    u64 Result = 0;
+    
+    char Path[64];
+    snprintf(Path, sizeof(Path), "/proc/%d/stat", Pid);
+    
+    FILE *File = fopen(Path, "r");
+    if(File)
+    {
+        char Buffer[1024];
+        u64 Count = fread(Buffer, 1, sizeof(Buffer) - 1, File);
+        Buffer[Count] = 0;
+        fclose(File);
+        
+        char *At = strrchr(Buffer, ')');
+        if(At)
+        {
+            unsigned long UserTicks = 0;
+            unsigned long SystemTicks = 0;
+            if(sscanf(At + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &UserTicks, &SystemTicks) == 2)
+            {
+                u64 TicksPerSecond = (u64)sysconf(_SC_CLK_TCK);
+                Result = (u64)(UserTicks + SystemTicks)*Billion / TicksPerSecond;
+            }
+        }
+    }
+    
+    return Result;
+}
+
+function void
+PumpConnectionList(DBusConnection **Connections, u32 Count, s32 TimeoutMilliseconds)
+{
+    struct pollfd PollHandles[256];
+    if(Count > ArrayCount(PollHandles))
+    {
+        Count = ArrayCount(PollHandles);
+    }
+    
+    for(u32 Index = 0;
+        Index < Count;
+        ++Index)
+    {
+        s32 Handle = -1;
+        dbus_connection_get_unix_fd(Connections[Index], &Handle);
+        
+        PollHandles[Index].fd = Handle;
+        PollHandles[Index].events = POLLIN;
+        PollHandles[Index].revents = 0;
+    }
+    
+    poll(PollHandles, Count, TimeoutMilliseconds);
+    
+    for(u32 Index = 0;
+        Index < Count;
+        ++Index)
+    {
+        dbus_connection_read_write(Connections[Index], 0);
+        while(dbus_connection_dispatch(Connections[Index]) == DBUS_DISPATCH_DATA_REMAINS);
+    }
+}
+
+function void
+PrintTraygeStats(DBusConnection *Connection, char *TraygeName)
+{
+    DBusMessage *Request = dbus_message_new_method_call(TraygeName, "/org/trayge/Debug", "org.trayge.Debug", "GetStats");
+    DBusMessage *Reply = dbus_connection_send_with_reply_and_block(Connection, Request, 1000, 0);
+    dbus_message_unref(Request);
+    
+    if(Reply)
+    {
+        printf("trayge:\n");
+        
+        DBusMessageIter ReplyArgs = {};
+        dbus_message_iter_init(Reply, &ReplyArgs);
+        
+        DBusMessageIter Entries = {};
+        dbus_message_iter_recurse(&ReplyArgs, &Entries);
+        while(dbus_message_iter_get_arg_type(&Entries) == DBUS_TYPE_DICT_ENTRY)
+        {
+            DBusMessageIter Entry = {};
+            dbus_message_iter_recurse(&Entries, &Entry);
+            
+            char *Key = 0;
+            dbus_message_iter_get_basic(&Entry, &Key);
+            dbus_message_iter_next(&Entry);
+            
+            DBusMessageIter Variant = {};
+            dbus_message_iter_recurse(&Entry, &Variant);
+            if(dbus_message_iter_get_arg_type(&Variant) == DBUS_TYPE_UINT64)
+            {
+                u64 Value = 0;
+                dbus_message_iter_get_basic(&Variant, &Value);
+                printf("  %-28s %lu\n", Key, Value);
+            }
+            else if(dbus_message_iter_get_arg_type(&Variant) == DBUS_TYPE_DOUBLE)
+            {
+                f64 Value = 0;
+                dbus_message_iter_get_basic(&Variant, &Value);
+                printf("  %-28s %.2f\n", Key, Value);
+            }
+            else if(dbus_message_iter_get_arg_type(&Variant) == DBUS_TYPE_ARRAY)
+            {
+                // NOTE(trayge): Per-item (id, frames, unchanged_frames, dirty_ratio).
+                DBusMessageIter Items = {};
+                dbus_message_iter_recurse(&Variant, &Items);
+                while(dbus_message_iter_get_arg_type(&Items) == DBUS_TYPE_STRUCT)
+                {
+                    DBusMessageIter Item = {};
+                    dbus_message_iter_recurse(&Items, &Item);
+                    
+                    char *Id = 0;
+                    u64 FrameCount = 0;
+                    u64 UnchangedCount = 0;
+                    f64 DirtyRatio = 0;
+                    dbus_message_iter_get_basic(&Item, &Id);
+                    dbus_message_iter_next(&Item);
+                    dbus_message_iter_get_basic(&Item, &FrameCount);
+                    dbus_message_iter_next(&Item);
+                    dbus_message_iter_get_basic(&Item, &UnchangedCount);
+                    dbus_message_iter_next(&Item);
+                    dbus_message_iter_get_basic(&Item, &DirtyRatio);
+                    
+                    printf("  %-28s %lu frames, %lu unchanged, dirty ratio %.3f\n", Id, FrameCount, UnchangedCount, DirtyRatio);
+                    dbus_message_iter_next(&Items);
+                }
+            }
+            
+            dbus_message_iter_next(&Entries);
+        }
+        
+        dbus_message_unref(Reply);
+    }
+}
@@ -0,0 +1,425 @@
+#include <unistd.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/wait.h>
+#include <time.h>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include <dbus/dbus.h>
+
+#include "trayge_types.h"
+#include "trayge_string.h"
+#include "trayge_stats.h"
+#include "trayge_trace.h"
+#include "trayge_process.h"
+
+//
+// NOTE(trayge): Replays a trace taken with trayge --record against a fresh trayge on a private
+// bus. Every sender in the trace gets its own connection, so per-consumer accounting sees the
+// same peers it saw when recording, and messages leave at their recorded offsets (scaled by
+// --speed). By default no host registers with the stub watcher, which keeps trayge from
+// animating: every reply is computed from the same first frame and runs are comparable with
+// each other, but every Get IconPixmap is a template copy. With --animate the stub reports a
+// host, so trayge renders on its own clock while the trace plays and fetches pay for fresh
+// templates the way they did when recording; runs then vary with timing.
+//
+
+#define ReplayMaxSenders 64
+#define ReplayDrainTimeout (5ull*Billion)
+
+typedef struct replay_sender
+{
+    char Name[64];
+    DBusConnection *Connection;
+} replay_sender;
+
+typedef struct replay_state
+{
+    DBusConnection *Watcher;
+    char TraygeName[64];
+    b32 HostRegistered;
+    
+    u32 SenderCount;
+    replay_sender Senders[ReplayMaxSenders];
+    
+    u64 Outstanding;
+    u64 MessagesSent;
+    u64 RepliesReceived;
+    u64 Errors;
+    
+    // NOTE(trayge): Recorded sizes are what trayge accounted when sending, which leaves out
+    // the header fields the bus and libdbus fill in, so only large differences mean much.
+    u64 RecordedReplyBytes;
+    u64 ReplayedReplyBytes;
+    
+    stats_histogram RecordedHandlerTime;
+    stats_histogram Latency;
+} replay_state;
+
+typedef struct replay_call
+{
+    replay_state *State;
+    u64 SendTime;
+} replay_call;
+
+// NOTE(trayge): Just enough of org.kde.StatusNotifierWatcher to learn trayge's unique name
+// from its first registration and, with --animate, to report a host. Every other call is
+// refused so trayge treats it as absent.
+function DBusHandlerResult
+HandleWatcherMessage(DBusConnection *Connection, DBusMessage *Message, void *UserData)
+{
+    replay_state *State = UserData;
+    
+    DBusHandlerResult Result = DBUS_HANDLER_RESULT_NOT_YET_HANDLED;
+    DBusMessage *Response = 0;
+    
+    if(dbus_message_is_method_call(Message, "org.kde.StatusNotifierWatcher", "RegisterStatusNotifierItem"))
+    {
+        const char *Sender = dbus_message_get_sender(Message);
+        if(Sender && !State->TraygeName[0])
+        {
+            snprintf(State->TraygeName, sizeof(State->TraygeName), "%s", Sender);
+        }
+        
+        Response = dbus_message_new_method_return(Message);
+    }
+    else if(State->HostRegistered &&
+            dbus_message_is_method_call(Message, "org.freedesktop.DBus.Properties", "Get"))
+    {
+        char *Interface = 0;
+        char *Name = 0;
+        if(dbus_message_get_args(Message, 0, DBUS_TYPE_STRING, &Interface, DBUS_TYPE_STRING, &Name, DBUS_TYPE_INVALID) &&
+           StringsAreEqual(Str(Name), StrLit("IsStatusNotifierHostRegistered"), 0))
+        {
+            dbus_bool_t Value = true;
+            Response = dbus_message_new_method_return(Message);
+            
+            DBusMessageIter ResponseArgs = {};
+            DBusMessageIter Variant = {};
+            dbus_message_iter_init_append(Response, &ResponseArgs);
+            DeferLoop(dbus_message_iter_open_container(&ResponseArgs, DBUS_TYPE_VARIANT, "b", &Variant),
+                      dbus_message_iter_close_container(&ResponseArgs, &Variant))
+            {
+                dbus_message_iter_append_basic(&Variant, DBUS_TYPE_BOOLEAN, &Value);
+            }
+        }
+        else
+        {
+            Response = dbus_message_new_error(Message, DBUS_ERROR_UNKNOWN_PROPERTY, "Not served by the replay watcher");
+        }
+    }
+    else if(dbus_message_get_type(Message) == DBUS_MESSAGE_TYPE_METHOD_CALL)
+    {
+        Response = dbus_message_new_error(Message, DBUS_ERROR_UNKNOWN_METHOD, "Not served by the replay watcher");
+    }
+    
+    if(Response)
+    {
+        dbus_connection_send(Connection, Response, 0);
+        dbus_message_unref(Response);
+        
+        Result = DBUS_HANDLER_RESULT_HANDLED;
+    }
+    
+    return Result;
+}
+
+function DBusConnection *
+GetSenderConnection(replay_state *State, const char *Name)
+{
+    DBusConnection *Result = 0;
+    
+    if(!Name)
+    {
+        Name = "";
+    }
+    
+    for(u32 SenderIndex = 0;
+        SenderIndex < State->SenderCount;
+        ++SenderIndex)
+    {
+        if(StringsAreEqual(Str(State->Senders[SenderIndex].Name), Str(Name), 0))
+        {
+            Result = State->Senders[SenderIndex].Connection;
+            break;
+        }
+    }
+    
+    if(!Result)
+    {
+        // NOTE(trayge): Past ReplayMaxSenders the remaining senders share the last connection.
+        if(State->SenderCount < ReplayMaxSenders)
+        {
+            replay_sender *Sender = State->Senders + State->SenderCount++;
+            snprintf(Sender->Name, sizeof(Sender->Name), "%s", Name);
+            Sender->Connection = dbus_bus_get_private(DBUS_BUS_SESSION, 0);
+            dbus_connection_set_exit_on_disconnect(Sender->Connection, false);
+        }
+        
+        Result = State->Senders[State->SenderCount - 1].Connection;
+    }
+    
+    return Result;
+}
+
+function void
+HandleReplayReply(DBusPendingCall *Pending, void *UserData)
+{
+    replay_call *Call = UserData;
+    replay_state *State = Call->State;
+    
+    --State->Outstanding;
+    
+    DBusMessage *Reply = dbus_pending_call_steal_reply(Pending);
+    if(Reply)
+    {
+        if(dbus_message_get_type(Reply) == DBUS_MESSAGE_TYPE_ERROR)
+        {
+            ++State->Errors;
+        }
+        else
+        {
+            ++State->RepliesReceived;
+            RecordHistogramValue(&State->Latency, GetMonotonicTime() - Call->SendTime);
+        }
+        
+        State->ReplayedReplyBytes += MessageSize(Reply);
+        
+        dbus_message_unref(Reply);
+    }
+}
+
+function void
+PumpReplayConnections(replay_state *State, s32 TimeoutMilliseconds)
+{
+    DBusConnection *Connections[ReplayMaxSenders + 1];
+    
+    u32 Count = 0;
+    Connections[Count++] = State->Watcher;
+    for(u32 SenderIndex = 0;
+        SenderIndex < State->SenderCount;
+        ++SenderIndex)
+    {
+        Connections[Count++] = State->Senders[SenderIndex].Connection;
+    }
+    
+    PumpConnectionList(Connections, Count, TimeoutMilliseconds);
+}
+
+// NOTE(trayge): The recorded message still carries its original serial, and libdbus only
+// assigns a fresh one to messages without, so what goes out is a copy.
+function void
+ReplayMessage(replay_state *State, trace_record_header *Record, u8 *Bytes)
+{
+    DBusMessage *Recorded = dbus_message_demarshal((char *)Bytes, (s32)Record->MessageSize, 0);
+    if(Recorded)
+    {
+        DBusConnection *Connection = GetSenderConnection(State, dbus_message_get_sender(Recorded));
+        
+        DBusMessage *Message = dbus_message_copy(Recorded);
+        dbus_message_set_destination(Message, State->TraygeName);
+        dbus_message_set_sender(Message, 0);
+        
+        RecordHistogramValue(&State->RecordedHandlerTime, Record->HandlerTime);
+        ++State->MessagesSent;
+        State->RecordedReplyBytes += Record->ReplySize;
+        
+        u64 SendTime = GetMonotonicTime();
+        DBusPendingCall *Pending = 0;
+        if(dbus_message_get_type(Message) == DBUS_MESSAGE_TYPE_METHOD_CALL &&
+           !dbus_message_get_no_reply(Message) &&
+           dbus_connection_send_with_reply(Connection, Message, &Pending, DBUS_TIMEOUT_USE_DEFAULT) && Pending)
+        {
+            replay_call *Call = malloc(sizeof(replay_call));
+            Call->State = State;
+            Call->SendTime = SendTime;
+            
+            ++State->Outstanding;
+            dbus_pending_call_set_notify(Pending, HandleReplayReply, Call, free);
+            dbus_pending_call_unref(Pending);
+        }
+        else
+        {
+            dbus_connection_send(Connection, Message, 0);
+        }
+        
+        dbus_message_unref(Message);
+        dbus_message_unref(Recorded);
+    }
+}
+
+function void
+PrintHistogram(char *Label, stats_histogram *Histogram)
+{
+    printf("%-24s p50 %9.1f  p90 %9.1f  p99 %9.1f  max %9.1f\n", Label,
+           (f64)HistogramPercentile(Histogram, 0.5) / 1000.0,
+           (f64)HistogramPercentile(Histogram, 0.9) / 1000.0,
+           (f64)HistogramPercentile(Histogram, 0.99) / 1000.0,
+           (f64)Histogram->Max / 1000.0);
+}
+
+int
+main(int ArgumentCount, char **Arguments)
+{
+    replay_state State = {};
+    
+    u64 Speed = 1;
+    b32 FlatOut = false;
+    char *TracePath = 0;
+    
+    char DefaultTraygePath[512];
+    GetSiblingPath(DefaultTraygePath, sizeof(DefaultTraygePath), Arguments[0], "trayge");
+    
+    char *TraygeArguments[64] = {DefaultTraygePath};
+    u32 TraygeArgumentCount = 1;
+    
+    for(s32 ArgumentIndex = 1;
+        ArgumentIndex < ArgumentCount;
+        ++ArgumentIndex)
+    {
+        string Argument = Str(Arguments[ArgumentIndex]);
+        
+        if(StringsAreEqual(Argument, StrLit("--speed"), 0) && ArgumentIndex + 1 < ArgumentCount &&
+           ParseU64(Str(Arguments[ArgumentIndex + 1]), &Speed) && Speed)
+        {
+            ++ArgumentIndex;
+        }
+        else if(StringsAreEqual(Argument, StrLit("--flat-out"), 0))
+        {
+            FlatOut = true;
+        }
+        else if(StringsAreEqual(Argument, StrLit("--animate"), 0))
+        {
+            State.HostRegistered = true;
+        }
+        else if(StringsAreEqual(Argument, StrLit("--trayge"), 0) && ArgumentIndex + 1 < ArgumentCount)
+        {
+            TraygeArguments[0] = Arguments[++ArgumentIndex];
+        }
+        else if(StringsAreEqual(Argument, StrLit("--"), 0))
+        {
+            while(++ArgumentIndex < ArgumentCount && TraygeArgumentCount < ArrayCount(TraygeArguments) - 1)
+            {
+                TraygeArguments[TraygeArgumentCount++] = Arguments[ArgumentIndex];
+            }
+        }
+        else if(!TracePath && Argument.Size && Argument.Data[0] != '-')
+        {
+            TracePath = Arguments[ArgumentIndex];
+        }
+        else
+        {
+            TracePath = 0;
+            break;
+        }
+    }
+    
+    if(!TracePath)
+    {
+        fprintf(stderr, "Usage: %s [--speed N] [--flat-out] [--animate] [--trayge path] trace-file [-- trayge arguments]\n", Arguments[0]);
+        return 1;
+    }
+    
+    FILE *TraceFile = fopen(TracePath, "rb");
+    if(!TraceFile || !ReadTraceHeader(TraceFile))
+    {
+        fprintf(stderr, "%s is not a trayge trace\n", TracePath);
+        return 1;
+    }
+    
+    signal(SIGPIPE, SIG_IGN);
+    
+    bus_daemon Daemon = {};
+    if(!StartBusDaemon(&Daemon))
+    {
+        fprintf(stderr, "Could not start dbus-daemon\n");
+        return 1;
+    }
+    
+    State.Watcher = dbus_bus_get_private(DBUS_BUS_SESSION, 0);
+    dbus_connection_set_exit_on_disconnect(State.Watcher, false);
+    dbus_bus_request_name(State.Watcher, "org.kde.StatusNotifierWatcher", DBUS_NAME_FLAG_DO_NOT_QUEUE, 0);
+    dbus_connection_add_filter(State.Watcher, HandleWatcherMessage, &State, 0);
+    
+    pid_t TraygePid = SpawnProcess(TraygeArguments);
+    
+    u64 WaitEnd = GetMonotonicTime() + ReplayDrainTimeout;
+    while(!State.TraygeName[0] && GetMonotonicTime() < WaitEnd)
+    {
+        PumpReplayConnections(&State, 10);
+    }
+    
+    b32 Succeeded = (State.TraygeName[0] != 0);
+    if(Succeeded)
+    {
+        u8 *Buffer = 0;
+        u64 BufferSize = 0;
+        
+        u64 StartTime = GetMonotonicTime();
+        u64 StartCPUTime = GetProcessCPUTime(TraygePid);
+        
+        trace_record_header Record = {};
+        while(ReadTraceRecord(TraceFile, &Record, &Buffer, &BufferSize))
+        {
+            if(!FlatOut)
+            {
+                u64 Due = StartTime + Record.Time / Speed;
+                for(u64 Now = GetMonotonicTime();
+                    Now < Due;
+                    Now = GetMonotonicTime())
+                {
+                    PumpReplayConnections(&State, (s32)((Due - Now + Million - 1) / Million));
+                }
+            }
+            
+            ReplayMessage(&State, &Record, Buffer);
+            PumpReplayConnections(&State, 0);
+        }
+        
+        u64 DrainEnd = GetMonotonicTime() + ReplayDrainTimeout;
+        while(State.Outstanding && GetMonotonicTime() < DrainEnd)
+        {
+            PumpReplayConnections(&State, 10);
+        }
+        
+        u64 CPUTime = GetProcessCPUTime(TraygePid) - StartCPUTime;
+        f64 Elapsed = (f64)(GetMonotonicTime() - StartTime) / Billion;
+        
+        printf("%lu messages from %u senders replayed in %.2fs\n", State.MessagesSent, State.SenderCount, Elapsed);
+        printf("replies %lu, errors %lu, unanswered %lu\n", State.RepliesReceived, State.Errors, State.Outstanding);
+        printf("reply bytes recorded %lu, replayed %lu\n", State.RecordedReplyBytes, State.ReplayedReplyBytes);
+        printf("times in us:\n");
+        PrintHistogram("  recorded handler", &State.RecordedHandlerTime);
+        PrintHistogram("  replayed round trip", &State.Latency);
+        printf("trayge cpu %.1f ms (%.1f%% of one core)\n", (f64)CPUTime / Million, 100.0*(f64)CPUTime / Billion / Elapsed);
+        
+        PrintTraygeStats(State.Watcher, State.TraygeName);
+        
+        free(Buffer);
+    }
+    else
+    {
+        fprintf(stderr, "trayge did not register with the watcher\n");
+    }
+    
+    StopProcess(TraygePid);
+    fclose(TraceFile);
+    
+    for(u32 SenderIndex = 0;
+        SenderIndex < State.SenderCount;
+        ++SenderIndex)
+    {
+        dbus_connection_close(State.Senders[SenderIndex].Connection);
+        dbus_connection_unref(State.Senders[SenderIndex].Connection);
+    }
+    dbus_connection_close(State.Watcher);
+    dbus_connection_unref(State.Watcher);
+    
+    StopBusDaemon(&Daemon);
+    
+    return Succeeded ? 0 : 1;
+}
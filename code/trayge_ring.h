@@ -0,0 +1,90 @@
+//
+// NOTE(trayge): Single-producer single-consumer ring of fixed-size entries. Head belongs to the
+// consumer and Tail to the producer; each side only ever writes its own index, and the two sit
+// on separate cache lines so they do not bounce between cores. Entries are copied in and out,
+// which keeps ownership simple: once RingPush returns, the producer's copy is free again.
+//
+// A consumer that sleeps until woken needs to know when the producer has to wake it. RingPush
+// reports whether the ring was drained at the moment the entry became visible; the index
+// update and the check on each side are sequentially consistent, so either the consumer sees
+// the new entry before it goes to sleep or the producer sees it caught up and sends a wakeup.
+//
+
+typedef struct spsc_ring
+{
+    u8 *Entries;
+    u32 EntrySize;
+    u32 Capacity;
+    
+    __attribute__((aligned(64))) u64 Head;
+    __attribute__((aligned(64))) u64 Tail;
+} spsc_ring;
+
+// NOTE(trayge): Capacity must be a power of two; Entries holds Capacity*EntrySize bytes.
+function void
+InitRing(spsc_ring *Ring, void *Entries, u32 EntrySize, u32 Capacity)
+{
+    Assert((Capacity & (Capacity - 1)) == 0);
+    
+    Ring->Entries = Entries;
+    Ring->EntrySize = EntrySize;
+    Ring->Capacity = Capacity;
+    Ring->Head = 0;
+    Ring->Tail = 0;
+}
+
+function void
+CopyRingEntry(u8 *Dest, u8 *Source, u32 Size)
+{
+    for(u32 Index = 0;
+        Index < Size;
+        ++Index)
+    {
+        Dest[Index] = Source[Index];
+    }
+}
+
+function b32
+RingPush(spsc_ring *Ring, void *Entry, b32 *WasDrained)
+{
+    b32 Result = false;
+    
+    u64 Tail = __atomic_load_n(&Ring->Tail, __ATOMIC_RELAXED);
+    u64 Head = __atomic_load_n(&Ring->Head, __ATOMIC_ACQUIRE);
+    if(Tail - Head < Ring->Capacity)
+    {
+        u8 *Slot = Ring->Entries + (Tail & (Ring->Capacity - 1))*Ring->EntrySize;
+        CopyRingEntry(Slot, Entry, Ring->EntrySize);
+        
+        __atomic_store_n(&Ring->Tail, Tail + 1, __ATOMIC_SEQ_CST);
+        Head = __atomic_load_n(&Ring->Head, __ATOMIC_SEQ_CST);
+        
+        if(WasDrained)
+        {
+            *WasDrained = (Head == Tail);
+        }
+        
+        Result = true;
+    }
+    
+    return Result;
+}
+
+function b32
+RingPop(spsc_ring *Ring, void *Entry)
+{
+    b32 Result = false;
+    
+    u64 Head = __atomic_load_n(&Ring->Head, __ATOMIC_RELAXED);
+    u64 Tail = __atomic_load_n(&Ring->Tail, __ATOMIC_SEQ_CST);
+    if(Head != Tail)
+    {
+        u8 *Slot = Ring->Entries + (Head & (Ring->Capacity - 1))*Ring->EntrySize;
+        CopyRingEntry(Entry, Slot, Ring->EntrySize);
+        
+        __atomic_store_n(&Ring->Head, Head + 1, __ATOMIC_SEQ_CST);
+        Result = true;
+    }
+    
+    return Result;
+}
@@ -0,0 +1,245 @@
+//
+// NOTE(trayge): Counters and histograms are updated with relaxed atomics so they can be bumped
+// from any thread without a lock; readers only ever want a consistent-enough snapshot.
+//
+
+function void
+AtomicAddU64(u64 *Value, u64 Delta)
+{
+    __atomic_fetch_add(Value, Delta, __ATOMIC_RELAXED);
+}
+
+function u64
+AtomicLoadU64(u64 *Value)
+{
+    u64 Result = __atomic_load_n(Value, __ATOMIC_RELAXED);
+    return Result;
+}
+
+function void
+AtomicMaxU64(u64 *Value, u64 Candidate)
+{
+    u64 Current = __atomic_load_n(Value, __ATOMIC_RELAXED);
+    while(Current < Candidate &&
+          !__atomic_compare_exchange_n(Value, &Current, Candidate, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+//
+// NOTE(trayge): Log-linear histogram in the style of HDR histograms: values below
+// HistogramSubBucketCount get a bucket each, every power of two above that is split into
+// HistogramSubBucketCount linear buckets. Relative error stays under 1/16 for any value, and
+// 48 groups reach past 2^51 ns, which is more range than a latency will ever need.
+//
+
+#define HistogramSubBucketBits 4
+#define HistogramSubBucketCount (1 << HistogramSubBucketBits)
+#define HistogramGroupCount 48
+#define HistogramBucketCount (HistogramGroupCount*HistogramSubBucketCount)
+
+typedef struct stats_histogram
+{
+    u64 Count;
+    u64 Sum;
+    u64 Max;
+    u64 Buckets[HistogramBucketCount];
+} stats_histogram;
+
+function u32
+HistogramBucketIndex(u64 Value)
+{
+    u32 Result = (u32)Value;
+    
+    if(Value >= HistogramSubBucketCount)
+    {
+        u32 Exponent = 63 - (u32)__builtin_clzll(Value);
+        u32 Shift = Exponent - HistogramSubBucketBits;
+        
+        Result = (Shift + 1)*HistogramSubBucketCount + (u32)((Value >> Shift) & (HistogramSubBucketCount - 1));
+        if(Result >= HistogramBucketCount)
+        {
+            Result = HistogramBucketCount - 1;
+        }
+    }
+    
+    return Result;
+}
+
+function u64
+HistogramBucketMidpoint(u32 Index)
+{
+    u64 Result = Index;
+    
+    if(Index >= HistogramSubBucketCount)
+    {
+        u32 Shift = Index/HistogramSubBucketCount - 1;
+        u64 Lower = (u64)(HistogramSubBucketCount + Index%HistogramSubBucketCount) << Shift;
+        Result = Lower + ((1ull << Shift) >> 1);
+    }
+    
+    return Result;
+}
+
+function void
+RecordHistogramValue(stats_histogram *Histogram, u64 Value)
+{
+    AtomicAddU64(&Histogram->Buckets[HistogramBucketIndex(Value)], 1);
+    AtomicAddU64(&Histogram->Count, 1);
+    AtomicAddU64(&Histogram->Sum, Value);
+    AtomicMaxU64(&Histogram->Max, Value);
+}
+
+// NOTE(trayge): Fraction is in [0, 1]. The result is the midpoint of the bucket holding that
+// rank, clamped to the largest value seen so p100 reports the real maximum.
+function u64
+HistogramPercentile(stats_histogram *Histogram, f64 Fraction)
+{
+    u64 Result = 0;
+    
+    u64 Count = AtomicLoadU64(&Histogram->Count);
+    if(Count)
+    {
+        u64 Rank = (u64)(Fraction*(f64)Count + 0.5);
+        if(Rank < 1)
+        {
+            Rank = 1;
+        }
+        
+        u64 Seen = 0;
+        for(u32 Index = 0;
+            Index < HistogramBucketCount;
+            ++Index)
+        {
+            Seen += AtomicLoadU64(&Histogram->Buckets[Index]);
+            if(Seen >= Rank)
+            {
+                Result = HistogramBucketMidpoint(Index);
+                break;
+            }
+        }
+        
+        u64 Max = AtomicLoadU64(&Histogram->Max);
+        if(Result > Max)
+        {
+            Result = Max;
+        }
+    }
+    
+    return Result;
+}
+
+//
+// NOTE(trayge): The log is a byte ring that always records, so the recent history can be
+// fetched after the fact. Writing it out is a separate step that only happens when logging is
+// enabled, which keeps terminal I/O off the message path.
+//
+
+#define LogLineMax 256
+
+typedef struct log_ring
+{
+    u8 *Bytes;
+    u64 Size;
+    
+    u64 WritePosition;
+    u64 FlushPosition;
+    
+    b32 Enabled;
+} log_ring;
+
+function void
+InitLogRing(log_ring *Ring, u8 *Bytes, u64 Size)
+{
+    *Ring = (log_ring){};
+    Ring->Bytes = Bytes;
+    Ring->Size = Size;
+}
+
+function u64
+LogRingOldestPosition(log_ring *Ring)
+{
+    u64 Result = (Ring->WritePosition > Ring->Size) ? Ring->WritePosition - Ring->Size : 0;
+    return Result;
+}
+
+function void
+WriteLogBytes(log_ring *Ring, char *Bytes, u64 Count)
+{
+    for(u64 Index = 0;
+        Index < Count;
+        ++Index)
+    {
+        Ring->Bytes[(Ring->WritePosition + Index) % Ring->Size] = (u8)Bytes[Index];
+    }
+    
+    Ring->WritePosition += Count;
+}
+
+function void
+LogLine(log_ring *Ring, char *Format, ...)
+{
+    char Line[LogLineMax];
+    
+    va_list Arguments;
+    va_start(Arguments, Format);
+    s32 Length = vsnprintf(Line, sizeof(Line) - 1, Format, Arguments);
+    va_end(Arguments);
+    
+    if(Length > 0)
+    {
+        u64 Count = ((u64)Length < sizeof(Line) - 2) ? (u64)Length : sizeof(Line) - 2;
+        Line[Count++] = '\n';
+        WriteLogBytes(Ring, Line, Count);
+    }
+}
+
+// NOTE(trayge): Copies out everything still held in the ring, oldest first. Dest must hold
+// Ring->Size bytes. Returns the number of bytes copied.
+function u64
+CopyLogRing(log_ring *Ring, u8 *Dest)
+{
+    u64 Result = 0;
+    
+    for(u64 Position = LogRingOldestPosition(Ring);
+        Position < Ring->WritePosition;
+        ++Position)
+    {
+        Dest[Result++] = Ring->Bytes[Position % Ring->Size];
+    }
+    
+    return Result;
+}
+
+function void
+FlushLogRing(log_ring *Ring, s32 FileHandle)
+{
+    if(Ring->Enabled)
+    {
+        u64 Oldest = LogRingOldestPosition(Ring);
+        if(Ring->FlushPosition < Oldest)
+        {
+            Ring->FlushPosition = Oldest;
+        }
+        
+        while(Ring->FlushPosition < Ring->WritePosition)
+        {
+            u64 Offset = Ring->FlushPosition % Ring->Size;
+            u64 Count = Ring->WritePosition - Ring->FlushPosition;
+            if(Count > Ring->Size - Offset)
+            {
+                Count = Ring->Size - Offset;
+            }
+            
+            s64 Written = write(FileHandle, Ring->Bytes + Offset, Count);
+            if(Written <= 0)
+            {
+                break;
+            }
+            
+            Ring->FlushPosition += (u64)Written;
+        }
+    }
+    else
+    {
+        Ring->FlushPosition = Ring->WritePosition;
+    }
+}
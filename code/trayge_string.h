@@ -4,7 +4,12 @@ typedef struct string
     u64 Size;
 } string;
 
-#define Str(raw) (string){(u8 *)(raw), StringLength(raw)}
+typedef struct hashed_string
+{
+    string String;
+    u32 Hash;
+} hashed_string;
+
 #define StrLit(raw) (string){(u8 *)(raw), sizeof(raw) - 1}
 
 function u64
@@ -22,6 +27,36 @@ StringLength(const char *A)
     return Result;
 }
 
+// NOTE(trayge): A function rather than a macro so the argument is evaluated exactly once;
+// option parsing passes expressions like Arguments[++ArgumentIndex].
+function string
+Str(const char *Raw)
+{
+    string Result = {(u8 *)Raw, StringLength(Raw)};
+    return Result;
+}
+
+function hashed_string
+StrHashed(const char *A)
+{
+    hashed_string Result = {};
+    Result.Hash = 2166136261u;
+    
+    if(A)
+    {
+        u8 *B = (u8 *)A;
+        for(; *B; ++B)
+        {
+            Result.Hash = (Result.Hash ^ *B)*16777619u;
+        }
+        
+        Result.String.Data = (u8 *)A;
+        Result.String.Size = (u64)(B - (u8 *)A);
+    }
+    
+    return Result;
+}
+
 function b32
 StringsAreEqual(string A, string B, u64 Flags)
 {
@@ -43,5 +78,53 @@ StringsAreEqual(string A, string B, u64 Flags)
         }
     }
     
+    return Result;
+}
+
+function b32
+StringHasPrefix(string A, string Prefix)
+{
+    b32 Result = (A.Size >= Prefix.Size &&
+                  StringsAreEqual((string){A.Data, Prefix.Size}, Prefix, 0));
+    return Result;
+}
+
+function string
+StringSkip(string A, u64 Count)
+{
+    if(Count > A.Size)
+    {
+        Count = A.Size;
+    }
+    
+    string Result = {A.Data + Count, A.Size - Count};
+    return Result;
+}
+
+function b32
+ParseU64(string A, u64 *Value)
+{
+    b32 Result = (A.Size > 0);
+    u64 Accumulator = 0;
+    
+    for(u64 Index = 0;
+        Index < A.Size;
+        ++Index)
+    {
+        u8 Digit = A.Data[Index];
+        if(Digit < '0' || Digit > '9')
+        {
+            Result = false;
+            break;
+        }
+        
+        Accumulator = Accumulator*10 + (u64)(Digit - '0');
+    }
+    
+    if(Result)
+    {
+        *Value = Accumulator;
+    }
+    
     return Result;
 }
\ No newline at end of file
@@ -0,0 +1,74 @@
+#define NameTableSize 256
+
+typedef struct name_table_slot
+{
+    u32 Hash;
+    u32 Value;
+    string First;
+    string Second;
+} name_table_slot;
+
+typedef struct name_table
+{
+    name_table_slot Slots[NameTableSize];
+} name_table;
+
+function u32
+CombineNameHashes(u32 First, u32 Second)
+{
+    u32 Result = First ^ (Second*0x9E3779B1u + (First << 6) + (First >> 2));
+    return Result;
+}
+
+function void
+InsertName(name_table *Table, hashed_string First, hashed_string Second, u32 Value)
+{
+    u32 Hash = CombineNameHashes(First.Hash, Second.Hash);
+    
+    b32 Inserted = false;
+    for(u32 Probe = 0;
+        !Inserted && Probe < NameTableSize;
+        ++Probe)
+    {
+        name_table_slot *Slot = Table->Slots + ((Hash + Probe) & (NameTableSize - 1));
+        if(!Slot->Value)
+        {
+            Slot->Hash = Hash;
+            Slot->Value = Value;
+            Slot->First = First.String;
+            Slot->Second = Second.String;
+            Inserted = true;
+        }
+    }
+    
+    Assert(Inserted);
+}
+
+function u32
+LookupName(name_table *Table, hashed_string First, hashed_string Second)
+{
+    u32 Result = 0;
+    
+    u32 Hash = CombineNameHashes(First.Hash, Second.Hash);
+    
+    for(u32 Probe = 0;
+        Probe < NameTableSize;
+        ++Probe)
+    {
+        name_table_slot *Slot = Table->Slots + ((Hash + Probe) & (NameTableSize - 1));
+        if(!Slot->Value)
+        {
+            break;
+        }
+        
+        if(Slot->Hash == Hash &&
+           StringsAreEqual(Slot->Second, Second.String, 0) &&
+           StringsAreEqual(Slot->First, First.String, 0))
+        {
+            Result = Slot->Value;
+            break;
+        }
+    }
+    
+    return Result;
+}
@@ -0,0 +1,154 @@
+typedef enum timer_type
+{
+    Timer_Frame,
+    Timer_DBusTimeout,
+} timer_type;
+
+typedef struct timer_entry
+{
+    timer_type Type;
+    
+    u64 Deadline;
+    u64 Interval;
+    u32 HeapIndex;
+    
+    DBusTimeout *TimeoutHandle;
+} timer_entry;
+
+typedef struct timer_heap
+{
+    u32 Count;
+    u32 Capacity;
+    timer_entry **Entries;
+} timer_heap;
+
+function b32
+TimerIsScheduled(timer_entry *Timer)
+{
+    b32 Result = (Timer->HeapIndex != 0);
+    return Result;
+}
+
+function void
+PlaceTimer(timer_heap *Heap, timer_entry *Timer, u32 Index)
+{
+    Heap->Entries[Index] = Timer;
+    Timer->HeapIndex = Index + 1;
+}
+
+function void
+SiftTimerUp(timer_heap *Heap, u32 Index)
+{
+    timer_entry *Timer = Heap->Entries[Index];
+    
+    while(Index > 0)
+    {
+        u32 ParentIndex = (Index - 1) / 2;
+        timer_entry *Parent = Heap->Entries[ParentIndex];
+        if(Parent->Deadline <= Timer->Deadline)
+        {
+            break;
+        }
+        
+        PlaceTimer(Heap, Parent, Index);
+        Index = ParentIndex;
+    }
+    
+    PlaceTimer(Heap, Timer, Index);
+}
+
+function void
+SiftTimerDown(timer_heap *Heap, u32 Index)
+{
+    timer_entry *Timer = Heap->Entries[Index];
+    
+    while(true)
+    {
+        u32 ChildIndex = Index*2 + 1;
+        if(ChildIndex >= Heap->Count)
+        {
+            break;
+        }
+        
+        if(ChildIndex + 1 < Heap->Count &&
+           Heap->Entries[ChildIndex + 1]->Deadline < Heap->Entries[ChildIndex]->Deadline)
+        {
+            ++ChildIndex;
+        }
+        
+        timer_entry *Child = Heap->Entries[ChildIndex];
+        if(Timer->Deadline <= Child->Deadline)
+        {
+            break;
+        }
+        
+        PlaceTimer(Heap, Child, Index);
+        Index = ChildIndex;
+    }
+    
+    PlaceTimer(Heap, Timer, Index);
+}
+
+function void
+UnscheduleTimer(timer_heap *Heap, timer_entry *Timer)
+{
+    if(TimerIsScheduled(Timer))
+    {
+        u32 Index = Timer->HeapIndex - 1;
+        Timer->HeapIndex = 0;
+        
+        timer_entry *Last = Heap->Entries[--Heap->Count];
+        if(Last != Timer)
+        {
+            PlaceTimer(Heap, Last, Index);
+            SiftTimerUp(Heap, Index);
+            SiftTimerDown(Heap, Last->HeapIndex - 1);
+        }
+    }
+}
+
+function void
+FreeTimerHeap(timer_heap *Heap)
+{
+    free(Heap->Entries);
+    *Heap = (timer_heap){};
+}
+
+function b32
+ScheduleTimer(timer_heap *Heap, timer_entry *Timer, u64 Deadline)
+{
+    b32 Result = true;
+    
+    UnscheduleTimer(Heap, Timer);
+    
+    if(Heap->Count == Heap->Capacity)
+    {
+        u32 Capacity = Heap->Capacity ? Heap->Capacity*2 : 16;
+        timer_entry **Entries = realloc(Heap->Entries, Capacity*sizeof(timer_entry *));
+        if(Entries)
+        {
+            Heap->Entries = Entries;
+            Heap->Capacity = Capacity;
+        }
+        else
+        {
+            Result = false;
+        }
+    }
+    
+    if(Result)
+    {
+        Timer->Deadline = Deadline;
+        PlaceTimer(Heap, Timer, Heap->Count++);
+        SiftTimerUp(Heap, Timer->HeapIndex - 1);
+    }
+    
+    return Result;
+}
+
+function timer_entry *
+PeekTimer(timer_heap *Heap)
+{
+    timer_entry *Result = Heap->Count ? Heap->Entries[0] : 0;
+    return Result;
+}
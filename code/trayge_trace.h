@@ -0,0 +1,78 @@
+//
+// NOTE(trayge): Trace files hold every message HandleDBusMessage saw, in arrival order. Each
+// record is a fixed header followed by the message exactly as it came off the wire
+// (dbus_message_marshal), so sender, path, interface, member and arguments all survive and
+// dbus_message_demarshal gives back the original. Times are nanoseconds since recording began.
+// Everything is host byte order; traces are meant to be replayed on the machine or
+// architecture that made them.
+//
+
+#define TraceMagic "TRAYGETR"
+#define TraceVersion 1
+
+typedef struct trace_file_header
+{
+    u8 Magic[8];
+    u32 Version;
+    u32 Reserved;
+} trace_file_header;
+
+typedef struct trace_record_header
+{
+    u64 Time;
+    u64 HandlerTime;
+    u32 ReplySize;
+    u32 MessageSize;
+} trace_record_header;
+
+function b32
+WriteTraceHeader(FILE *File)
+{
+    trace_file_header Header = {};
+    for(u32 Index = 0;
+        Index < sizeof(Header.Magic);
+        ++Index)
+    {
+        Header.Magic[Index] = (u8)TraceMagic[Index];
+    }
+    Header.Version = TraceVersion;
+    
+    b32 Result = (fwrite(&Header, sizeof(Header), 1, File) == 1);
+    return Result;
+}
+
+function b32
+ReadTraceHeader(FILE *File)
+{
+    trace_file_header Header = {};
+    b32 Result = (fread(&Header, sizeof(Header), 1, File) == 1 &&
+                  StringsAreEqual((string){Header.Magic, sizeof(Header.Magic)}, StrLit(TraceMagic), 0) &&
+                  Header.Version == TraceVersion);
+    return Result;
+}
+
+function void
+WriteTraceRecord(FILE *File, trace_record_header *Record, void *Message)
+{
+    fwrite(Record, sizeof(*Record), 1, File);
+    fwrite(Message, Record->MessageSize, 1, File);
+}
+
+// NOTE(trayge): Buffer grows as needed and is owned by the caller, who frees it with free().
+function b32
+ReadTraceRecord(FILE *File, trace_record_header *Record, u8 **Buffer, u64 *BufferSize)
+{
+    b32 Result = (fread(Record, sizeof(*Record), 1, File) == 1);
+    if(Result)
+    {
+        if(*BufferSize < Record->MessageSize)
+        {
+            *BufferSize = Record->MessageSize;
+            *Buffer = realloc(*Buffer, *BufferSize);
+        }
+        
+        Result = (*Buffer && fread(*Buffer, Record->MessageSize, 1, File) == 1);
+    }
+    
+    return Result;
+}
@@ -22,6 +22,8 @@ typedef double f64;
 #define Million 1000000
 #define Billion 1000000000
 
+#define ArrayCount(array) (sizeof(array) / sizeof((array)[0]))
+
 #define Assert(condition) do{ if(!(condition)){ asm volatile("int3"); } }while(0)
 #define InvalidCodePath Assert(!"InvalidCodePath")
 #define InvalidDefaultCase default: { InvalidCodePath; } break;